@@ -22,6 +22,7 @@
 #include "subdoc/path.h"
 #include "subdoc/match.h"
 #include "subdoc/operations.h"
+#include "subdoc/docfile.h"
 #include "contrib/cliopts/cliopts.h"
 
 using std::string;
@@ -48,6 +49,11 @@ public:
         o_jsfile('f', "json"),
         o_cmd('c', "command"),
         o_mkdirp('M', "create-intermediate"),
+        o_mmap('m', "mmap"),
+        o_sorted('S', "sorted"),
+        o_hint('H', "hint"),
+        o_perf('P', "perf-counters"),
+        o_trace('T', "trace"),
         parser("subdoc-bench")
     {
         o_iter.description("Number of iterations to run");
@@ -56,6 +62,11 @@ public:
         o_jsfile.description("JSON files to operate on. If passing multiple files, each file should be delimited by a comma");
         o_cmd.description("Command to use. Use -c help to show all the commands").mandatory();
         o_mkdirp.description("Create intermediate paths for mutation operations");
+        o_perf.description("Report hardware performance counters for the operations (Linux only)");
+        o_hint.description("Start lookups where the path was found in the previous document");
+        o_sorted.description("The documents' keys are sorted (e.g. by -c canonical)");
+        o_trace.description("Time each phase of the operations, print a summary, and write a Chrome trace (chrome://tracing or Perfetto) to this file");
+        o_mmap.description("Map JSON files into memory rather than reading them. Lookups then only page in the part of the file they scan");
 
         parser.addOption(o_iter);
         parser.addOption(o_path);
@@ -63,6 +74,11 @@ public:
         parser.addOption(o_jsfile);
         parser.addOption(o_cmd);
         parser.addOption(o_mkdirp);
+        parser.addOption(o_mmap);
+        parser.addOption(o_sorted);
+        parser.addOption(o_hint);
+        parser.addOption(o_perf);
+        parser.addOption(o_trace);
 
         totalBytes = 0;
         // Set the opmap
@@ -75,6 +91,7 @@ public:
         opmap["delete"] = OpEntry(SUBDOC_CMD_DELETE, "Delete a value");
         opmap["get"] = OpEntry(SUBDOC_CMD_GET, "Retrieve a value");
         opmap["exists"] = OpEntry(SUBDOC_CMD_EXISTS, "Check if a value exists");
+        opmap["count"] = OpEntry(SUBDOC_CMD_GET_COUNT, "Count the elements of an array or dictionary");
 
         // dict ops
         opmap["add"] = OpEntry(SUBDOC_CMD_DICT_ADD, "Create a new dictionary value");
@@ -84,10 +101,19 @@ public:
         opmap["append"] = OpEntry(SUBDOC_CMD_ARRAY_APPEND, "Insert values to the end of an array");
         opmap["prepend"] = OpEntry(SUBDOC_CMD_ARRAY_PREPEND, "Insert values to the beginning of an array");
         opmap["addunique"] = OpEntry(SUBDOC_CMD_ARRAY_ADD_UNIQUE, "Add a unique value to an array");
+        opmap["insert"] = OpEntry(SUBDOC_CMD_ARRAY_INSERT, "Insert a value at a given array index");
+        opmap["popfront"] = OpEntry(SUBDOC_CMD_ARRAY_POP_FRONT, "Remove the first element of an array");
+        opmap["popback"] = OpEntry(SUBDOC_CMD_ARRAY_POP_BACK, "Remove the last element of an array");
+        opmap["trim"] = OpEntry(SUBDOC_CMD_ARRAY_TRIM, "Keep only the first N elements of an array");
 
         // arithmetic ops
         opmap["incr"] = OpEntry(SUBDOC_CMD_INCREMENT, "Increment a value");
         opmap["decr"] = OpEntry(SUBDOC_CMD_DECREMENT, "Decrement a value");
+        opmap["incrf"] = OpEntry(SUBDOC_CMD_INCREMENT_FLOAT, "Add a floating point delta to a value");
+        opmap["mincr"] = OpEntry(SUBDOC_CMD_MULTI_INCREMENT, "Increment each of a comma-separated list of paths");
+        opmap["project"] = OpEntry(SUBDOC_CMD_PROJECT, "Extract a comma-separated list of paths into a new document");
+        opmap["compact"] = OpEntry(SUBDOC_CMD_COMPACT, "Strip whitespace outside of strings");
+        opmap["canonical"] = OpEntry(SUBDOC_CMD_CANONICALIZE, "Sort the keys of every dictionary and strip whitespace");
         opmap["path"] = OpEntry(0xff, "Check the validity of a path");
     }
 
@@ -97,6 +123,11 @@ public:
     StringOption o_jsfile;
     StringOption o_cmd;
     BoolOption o_mkdirp;
+    BoolOption o_mmap;
+    BoolOption o_sorted;
+    BoolOption o_hint;
+    BoolOption o_perf;
+    StringOption o_trace;
     map<string,OpEntry> opmap;
     Parser parser;
     size_t totalBytes;
@@ -131,6 +162,297 @@ get_nstime(void) {
 }
 #endif
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters for the operation loop, via perf_event_open(2). Counters
+// the kernel or the machine can't provide (e.g. in a VM, or with a
+// restrictive perf_event_paranoid) are skipped. The counters are opened as a
+// single group, so that they (and in particular IPC) cover the same time. If
+// the kernel still has to multiplex a counter, its count is scaled up to the
+// whole run, and marked as such.
+class PerfCounters {
+public:
+    enum { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, LLC_MISSES, NCOUNTERS };
+
+    PerfCounters() {
+        for (size_t ii = 0; ii < NCOUNTERS; ii++) {
+            fds[ii] = -1;
+            is_leader[ii] = false;
+            values[ii] = 0;
+            enabled[ii] = 0;
+            running[ii] = 0;
+        }
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (size_t ii = 0; ii < NCOUNTERS; ii++) {
+            if (fds[ii] != -1) {
+                close(fds[ii]);
+            }
+        }
+#endif
+    }
+
+    bool open() {
+#ifdef __linux__
+        static const struct { uint32_t type; uint64_t config; } events[NCOUNTERS] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+        };
+        int leader = -1;
+        for (size_t ii = 0; ii < NCOUNTERS; ii++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof attr);
+            attr.size = sizeof attr;
+            attr.type = events[ii].type;
+            attr.config = events[ii].config;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                    PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            // Members follow the leader, which starts disabled
+            attr.disabled = leader == -1;
+            fds[ii] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fds[ii] == -1 && leader != -1) {
+                // Can't be in the group; count it on its own
+                attr.disabled = 1;
+                fds[ii] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+                is_leader[ii] = fds[ii] != -1;
+            } else if (fds[ii] != -1 && leader == -1) {
+                leader = fds[ii];
+                is_leader[ii] = true;
+            }
+            if (fds[ii] == -1) {
+                fprintf(stderr, "Counter '%s' unavailable: %s\n", names[ii], strerror(errno));
+            }
+        }
+        return leader != -1;
+#else
+        fprintf(stderr, "Hardware counters are not supported on this platform\n");
+        return false;
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        for (size_t ii = 0; ii < NCOUNTERS; ii++) {
+            if (is_leader[ii]) {
+                ioctl(fds[ii], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(fds[ii], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for (size_t ii = 0; ii < NCOUNTERS; ii++) {
+            if (is_leader[ii]) {
+                ioctl(fds[ii], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
+        for (size_t ii = 0; ii < NCOUNTERS; ii++) {
+            if (fds[ii] == -1) {
+                continue;
+            }
+            // value, time enabled, time running
+            uint64_t buf[3];
+            if (read(fds[ii], buf, sizeof buf) == sizeof buf) {
+                values[ii] = buf[0];
+                enabled[ii] = buf[1];
+                running[ii] = buf[2];
+            } else {
+                close(fds[ii]);
+                fds[ii] = -1;
+                is_leader[ii] = false;
+            }
+        }
+#endif
+    }
+
+    void print(uint64_t nops, uint64_t nbytes) const {
+        bool any_scaled = false;
+        for (size_t ii = 0; ii < NCOUNTERS; ii++) {
+            if (fds[ii] == -1) {
+                continue;
+            }
+            if (running[ii] == 0) {
+                fprintf(stderr, "%-14s %14s\n", names[ii], "<not counted>");
+                continue;
+            }
+            double value = scaled(ii);
+            fprintf(stderr, "%-14s %14.0lf  %12.2lf/op", names[ii], value, value / nops);
+            if (nbytes) {
+                fprintf(stderr, "  %8.4lf/byte", value / nbytes);
+            }
+            if (running[ii] < enabled[ii]) {
+                fprintf(stderr, "  (scaled; counted %.1lf%% of the time)",
+                    100.0 * running[ii] / enabled[ii]);
+                any_scaled = true;
+            }
+            fprintf(stderr, "\n");
+        }
+        if (fds[CYCLES] != -1 && fds[INSTRUCTIONS] != -1 &&
+                running[CYCLES] && running[INSTRUCTIONS]) {
+            fprintf(stderr, "%-14s %14.2lf%s\n", "IPC",
+                scaled(INSTRUCTIONS) / scaled(CYCLES),
+                running[CYCLES] != running[INSTRUCTIONS] ? "  (estimated)" : "");
+        }
+        if (any_scaled) {
+            fprintf(stderr, "Some counters were multiplexed by the kernel; "
+                "their counts are estimates\n");
+        }
+    }
+
+private:
+    // The count extrapolated to the whole time the counter was enabled
+    double scaled(size_t ii) const {
+        if (running[ii] == 0 || running[ii] >= enabled[ii]) {
+            return (double)values[ii];
+        }
+        return (double)values[ii] * enabled[ii] / running[ii];
+    }
+
+    static const char *names[NCOUNTERS];
+    int fds[NCOUNTERS];
+    // Set for the group leader, and for any counter outside the group
+    bool is_leader[NCOUNTERS];
+    uint64_t values[NCOUNTERS];
+    uint64_t enabled[NCOUNTERS];
+    uint64_t running[NCOUNTERS];
+};
+
+const char *PerfCounters::names[PerfCounters::NCOUNTERS] = {
+    "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses"
+};
+
+static PerfCounters perfCounters;
+
+// Per-phase timings of the operation loop (see subdoc/timing.h). The first
+// MAX_OPS operations are kept for the trace; the summary covers them all
+class PhaseTrace {
+public:
+    static const size_t MAX_OPS = 100000;
+
+    PhaseTrace() : timings(), ns_begin(0), cycles_begin(0), ns_per_cycle(1) {}
+
+    void start() {
+        ns_begin = get_nstime();
+        cycles_begin = subdoc_cycles();
+    }
+
+    void stop() {
+        uint64_t ns = get_nstime() - ns_begin;
+        uint64_t cycles = subdoc_cycles() - cycles_begin;
+        if (cycles) {
+            ns_per_cycle = (double)ns / cycles;
+        }
+    }
+
+    void record(uint8_t opcode) {
+        if (ops.size() < MAX_OPS) {
+            ops.push_back(timings.last);
+            opcodes.push_back(opcode);
+        }
+    }
+
+    // Chrome trace-event format: one complete ("X") event per operation,
+    // with one nested event per phase. Times are in microseconds
+    void write(const string& fname, const map<string,OpEntry>& opmap) const {
+        FILE *fp = fopen(fname.c_str(), "w");
+        if (fp == NULL) {
+            throw fname + ": " + strerror(errno);
+        }
+        fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        const char *sep = "\n";
+        for (size_t ii = 0; ii < ops.size(); ii++) {
+            const subdoc_PHASE_TIMES& t = ops[ii];
+            string name = opName(opmap, opcodes[ii]);
+            fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"op\",\"ph\":\"X\","
+                "\"ts\":%.3lf,\"dur\":%.3lf,\"pid\":1,\"tid\":1}",
+                sep, name.c_str(), toUsec(t.begin), cyclesToUsec(t.end - t.begin));
+            sep = ",\n";
+            for (int jj = 0; jj < SUBDOC_PHASE_MAX; jj++) {
+                if (t.phase_begin[jj] == 0) {
+                    continue;
+                }
+                fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\","
+                    "\"ts\":%.3lf,\"dur\":%.3lf,\"pid\":1,\"tid\":1,"
+                    "\"args\":{\"cycles\":%llu}}",
+                    subdoc_phase_name(subdoc_PHASE(jj)), toUsec(t.phase_begin[jj]),
+                    cyclesToUsec(t.cycles[jj]), (unsigned long long)t.cycles[jj]);
+            }
+        }
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+        fprintf(stderr, "Wrote %lu operations to %s\n",
+            (unsigned long)ops.size(), fname.c_str());
+    }
+
+    void print(const map<string,OpEntry>& opmap) const {
+        for (size_t ii = 0; ii < 256; ii++) {
+            uint64_t count = timings.count[ii], total = 0;
+            if (count == 0) {
+                continue;
+            }
+            for (int jj = 0; jj < SUBDOC_PHASE_MAX; jj++) {
+                total += timings.cycles[ii][jj];
+            }
+            fprintf(stderr, "%s: %llu ops, %.1lf cycles/op\n",
+                opName(opmap, ii).c_str(), (unsigned long long)count,
+                (double)total / count);
+            for (int jj = 0; jj < SUBDOC_PHASE_MAX; jj++) {
+                uint64_t cycles = timings.cycles[ii][jj];
+                fprintf(stderr, "  %-12s %12.1lf/op  %5.1lf%%\n",
+                    subdoc_phase_name(subdoc_PHASE(jj)), (double)cycles / count,
+                    total ? cycles * 100.0 / total : 0.0);
+            }
+        }
+    }
+
+    subdoc_OP_TIMINGS timings;
+
+private:
+    static string opName(const map<string,OpEntry>& opmap, unsigned opcode) {
+        map<string,OpEntry>::const_iterator iter = opmap.begin();
+        for (; iter != opmap.end(); ++iter) {
+            if (iter->second.opcode == opcode) {
+                return iter->first;
+            }
+        }
+        char buf[8];
+        snprintf(buf, sizeof buf, "0x%x", opcode);
+        return buf;
+    }
+
+    double cyclesToUsec(uint64_t cycles) const {
+        return cycles * ns_per_cycle / 1000.0;
+    }
+
+    double toUsec(uint64_t stamp) const {
+        return cyclesToUsec(stamp - cycles_begin);
+    }
+
+    vector<subdoc_PHASE_TIMES> ops;
+    vector<uint8_t> opcodes;
+    uint64_t ns_begin;
+    uint64_t cycles_begin;
+    double ns_per_cycle;
+};
+
+static PhaseTrace phaseTrace;
+
 static void
 readJsonFile(string& name, vector<string>& out)
 {
@@ -150,6 +472,8 @@ execOperation(Options& o)
 {
     vector<string> fileNames;
     vector<string> inputStrs;
+    vector<subdoc_DOCFILE> docFiles;
+    vector<subdoc_LOC> inputs;
     string flist = o.o_jsfile.const_result();
     if (flist.find(',') == string::npos) {
         fileNames.push_back(flist);
@@ -170,8 +494,26 @@ execOperation(Options& o)
         throw string("At least one file must be passed!");
     }
     for (size_t ii = 0; ii < fileNames.size(); ii++) {
-        readJsonFile(fileNames[ii], inputStrs);
-        o.totalBytes += inputStrs.back().length();
+        if (o.o_mmap.passed()) {
+            subdoc_DOCFILE df;
+            int rv = subdoc_docfile_open(&df, fileNames[ii].c_str());
+            if (rv != 0) {
+                throw fileNames[ii] + ": " + strerror(rv);
+            }
+            docFiles.push_back(df);
+        } else {
+            readJsonFile(fileNames[ii], inputStrs);
+        }
+    }
+    for (size_t ii = 0; ii < inputStrs.size(); ii++) {
+        subdoc_LOC loc = { inputStrs[ii].c_str(), inputStrs[ii].size() };
+        inputs.push_back(loc);
+    }
+    for (size_t ii = 0; ii < docFiles.size(); ii++) {
+        inputs.push_back(docFiles[ii].doc);
+    }
+    for (size_t ii = 0; ii < inputs.size(); ii++) {
+        o.totalBytes += inputs[ii].length;
     }
 
     uint8_t opcode = o.opmap[o.o_cmd.result()];
@@ -189,7 +531,8 @@ execOperation(Options& o)
     case SUBDOC_CMD_INCREMENT:
     case SUBDOC_CMD_INCREMENT_P:
     case SUBDOC_CMD_DECREMENT:
-    case SUBDOC_CMD_DECREMENT_P: {
+    case SUBDOC_CMD_DECREMENT_P:
+    case SUBDOC_CMD_ARRAY_TRIM: {
         int64_t ctmp = (uint64_t)strtoll(vbuf, NULL, 10);
         if (ctmp == LLONG_MAX && errno == ERANGE) {
             throw string("Invalid delta for arithmetic operation!");
@@ -200,27 +543,82 @@ execOperation(Options& o)
         nvbuf = sizeof dummy;
         break;
     }
+    case SUBDOC_CMD_INCREMENT_FLOAT:
+    case SUBDOC_CMD_INCREMENT_FLOAT_P: {
+        double dtmp = strtod(vbuf, NULL);
+        memcpy(&dummy, &dtmp, sizeof dummy);
+        dummy = htonll(dummy);
+        vbuf = (const char *)&dummy;
+        nvbuf = sizeof dummy;
+        break;
+    }
     }
 
-    subdoc_OPERATION *op = subdoc_op_alloc();
+    vector<string> multiPaths;
+    vector<subdoc_MULTI_SPEC> multiSpecs;
+    if (opcode == SUBDOC_CMD_MULTI_INCREMENT || opcode == SUBDOC_CMD_PROJECT) {
+        int64_t delta = strtoll(value.c_str(), NULL, 10);
+        size_t begin = 0, end;
+        do {
+            end = path.find(',', begin);
+            multiPaths.push_back(path.substr(begin, end - begin));
+            begin = end + 1;
+        } while (end != string::npos);
+        for (size_t ii = 0; ii < multiPaths.size(); ii++) {
+            subdoc_MULTI_SPEC spec = {};
+            spec.path = multiPaths[ii].c_str();
+            spec.npath = multiPaths[ii].size();
+            spec.delta = delta;
+            multiSpecs.push_back(spec);
+        }
+    }
 
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    subdoc_PATH_HINT hint = {};
+    if (o.o_hint.passed()) {
+        op->path_hint = &hint;
+    }
+    if (o.o_trace.passed()) {
+        op->timings = &phaseTrace.timings;
+        phaseTrace.start();
+    }
 
     size_t itermax = o.o_iter.result();
+    if (o.o_perf.passed()) {
+        perfCounters.start();
+    }
     for (size_t ii = 0; ii < itermax; ii++) {
         subdoc_op_clear(op);
-        const string& curInput = inputStrs[ii % inputStrs.size()];
+        const subdoc_LOC& curInput = inputs[ii % inputs.size()];
         SUBDOC_OP_SETCODE(op, subdoc_OPTYPE(opcode));
-        SUBDOC_OP_SETDOC(op, curInput.c_str(), curInput.size());
+        if (o.o_sorted.passed()) {
+            SUBDOC_OP_SETDOC_SORTED(op, curInput.at, curInput.length);
+        } else {
+            SUBDOC_OP_SETDOC(op, curInput.at, curInput.length);
+        }
         SUBDOC_OP_SETVALUE(op, vbuf, nvbuf);
+        if (!multiSpecs.empty()) {
+            SUBDOC_OP_SETMULTI(op, &multiSpecs[0], multiSpecs.size());
+        }
 
         subdoc_ERRORS rv = subdoc_op_exec(op, path.c_str(), path.size());
         if (rv != SUBDOC_STATUS_SUCCESS) {
             throw rv;
         }
+        if (op->timings) {
+            phaseTrace.record(opcode);
+        }
+    }
+    if (o.o_perf.passed()) {
+        perfCounters.stop();
+    }
+    if (op->timings) {
+        phaseTrace.stop();
     }
 
     // Print the result.
-    if (opcode == SUBDOC_CMD_GET || opcode == SUBDOC_CMD_EXISTS) {
+    if (opcode == SUBDOC_CMD_GET || opcode == SUBDOC_CMD_EXISTS ||
+            opcode == SUBDOC_CMD_GET_COUNT) {
         string match(op->match.loc_match.at, op->match.loc_match.length);
         printf("%s\n", match.c_str());
     } else {
@@ -232,7 +630,14 @@ execOperation(Options& o)
         printf("%s\n", newdoc.c_str());
     }
 
+    if (o.o_hint.passed()) {
+        fprintf(stderr, "Hint hits: %lu, misses: %lu\n",
+            (unsigned long)hint.hits, (unsigned long)hint.misses);
+    }
     subdoc_op_free(op);
+    for (size_t ii = 0; ii < docFiles.size(); ii++) {
+        subdoc_docfile_close(&docFiles[ii]);
+    }
 }
 
 static void
@@ -242,6 +647,9 @@ execPathParse(Options& o)
     string path = o.o_path.const_result();
     subdoc_PATH *pth = subdoc_path_alloc();
 
+    if (o.o_perf.passed()) {
+        perfCounters.start();
+    }
     for (size_t ii = 0; ii < itermax; ii++) {
         subdoc_path_clear(pth);
         int rv = subdoc_path_parse(pth, path.c_str(), path.size());
@@ -250,6 +658,9 @@ execPathParse(Options& o)
             throw string("Failed to parse path!");
         }
     }
+    if (o.o_perf.passed()) {
+        perfCounters.stop();
+    }
 
     subdoc_path_free(pth);
 }
@@ -263,6 +674,10 @@ void runMain(int argc, char **argv)
     // Determine the command
     string cmdStr = o.o_cmd.const_result();
 
+    if (o.o_perf.passed() && !perfCounters.open()) {
+        throw string("No hardware counters available");
+    }
+
     uint64_t t_begin = get_nstime();
 
     if (cmdStr == "help") {
@@ -300,6 +715,13 @@ void runMain(int argc, char **argv)
     fprintf(stderr, "DURATION=%.2lfs. OPS=%u\n", n_seconds, o.o_iter.result());
     fprintf(stderr, "%.2lf OPS/s\n",  ops_per_sec);
     fprintf(stderr, "%.2lf MB/s\n", mb_per_sec);
+    if (o.o_perf.passed()) {
+        perfCounters.print(o.o_iter.result(), (uint64_t)o.totalBytes * o.o_iter.result());
+    }
+    if (o.o_trace.passed()) {
+        phaseTrace.print(o.opmap);
+        phaseTrace.write(o.o_trace.const_result(), o.opmap);
+    }
 }
 
 int main(int argc, char **argv)
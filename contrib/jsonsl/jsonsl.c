@@ -99,10 +99,19 @@ static char get_escape_equiv(unsigned);
 JSONSL_API
 jsonsl_t jsonsl_new(int nlevels)
 {
-    struct jsonsl_st *jsn = (struct jsonsl_st *)
+    struct jsonsl_st *jsn;
+#ifdef JSONSL_STATE_COMPACT
+    if (nlevels > JSONSL_STATE_LEVELS_MAX) {
+        return NULL;
+    }
+#endif
+    jsn = (struct jsonsl_st *)
             calloc(1, sizeof (*jsn) +
                     ( (nlevels-1) * sizeof (struct jsonsl_state_st) )
             );
+    if (jsn == NULL) {
+        return NULL;
+    }
 
     jsn->levels_max = nlevels;
     jsn->max_callback_level = -1;
@@ -137,44 +146,75 @@ void jsonsl_destroy(jsonsl_t jsn)
     }
 }
 
+/*
+ * In C++ the loop below is jsonsl_feed_handler(), and jsonsl_feed() is its
+ * instantiation for a handler which goes through the callback pointers.
+ * JSONSL_WANTS, JSONSL_EMIT and JSONSL_ERROR are the only differences.
+ */
+#ifdef __cplusplus
+#define JSONSL_WANTS(T) handler.call_##T(jsn)
+#define JSONSL_EMIT(action) \
+    handler.on_##action(jsn, state, (jsonsl_char_t*)c)
+#define JSONSL_ERROR(err) handler.on_error(jsn, err, state, (char*)c)
+
+template <class Handler> static void
+jsonsl_feed_handler(jsonsl_t jsn, const jsonsl_char_t *bytes, size_t nbytes,
+    Handler& handler)
+#else
+#define JSONSL_WANTS(T) jsn->call_##T
+#define JSONSL_EMIT(action) \
+    if (jsn->action_callback_##action) { \
+        jsn->action_callback_##action(jsn, JSONSL_ACTION_##action, state, (jsonsl_char_t*)c); \
+    } else if (jsn->action_callback) { \
+        jsn->action_callback(jsn, JSONSL_ACTION_##action, state, (jsonsl_char_t*)c); \
+    }
+#define JSONSL_ERROR(err) jsn->error_callback(jsn, err, state, (char*)c)
+
 JSONSL_API
 void
 jsonsl_feed(jsonsl_t jsn, const jsonsl_char_t *bytes, size_t nbytes)
+#endif
 {
 
 #define INVOKE_ERROR(eb) \
-    if (jsn->error_callback(jsn, JSONSL_ERROR_##eb, state, (char*)c)) { \
+    if (JSONSL_ERROR(JSONSL_ERROR_##eb)) { \
         goto GT_AGAIN; \
     } \
     return;
 
 #define STACK_PUSH \
     if (jsn->level >= (levels_max-1)) { \
-        jsn->error_callback(jsn, JSONSL_ERROR_LEVELS_EXCEEDED, state, (char*)c); \
+        JSONSL_ERROR(JSONSL_ERROR_LEVELS_EXCEEDED); \
         return; \
     } \
     state = jsn->stack + (++jsn->level); \
     state->ignore_callback = jsn->stack[jsn->level-1].ignore_callback; \
     state->pos_begin = jsn->pos;
 
+#ifdef JSONSL_STATE_COMPACT
+#define SET_POS_CUR(st)
+#else
+#define SET_POS_CUR(st) (st)->pos_cur = jsn->pos
+#endif
+
 #define STACK_POP_NOPOS \
-    state->pos_cur = jsn->pos; \
+    SET_POS_CUR(state); \
     state = jsn->stack + (--jsn->level);
 
 
 #define STACK_POP \
     STACK_POP_NOPOS; \
-    state->pos_cur = jsn->pos;
+    SET_POS_CUR(state);
 
 #define CALLBACK_AND_POP_NOPOS(T) \
-        state->pos_cur = jsn->pos; \
+        SET_POS_CUR(state); \
         DO_CALLBACK(T, POP); \
         state->nescapes = 0; \
         state = jsn->stack + (--jsn->level);
 
 #define CALLBACK_AND_POP(T) \
         CALLBACK_AND_POP_NOPOS(T); \
-        state->pos_cur = jsn->pos;
+        SET_POS_CUR(state);
 
 #define SPECIAL_POP \
     CALLBACK_AND_POP(SPECIAL); \
@@ -184,15 +224,11 @@ jsonsl_feed(jsonsl_t jsn, const jsonsl_char_t *bytes, size_t nbytes)
 #define CUR_CHAR (*(jsonsl_uchar_t*)c)
 
 #define DO_CALLBACK(T, action) \
-    if (jsn->call_##T && \
+    if (JSONSL_WANTS(T) && \
             jsn->max_callback_level > state->level && \
             state->ignore_callback == 0) { \
         \
-        if (jsn->action_callback_##action) { \
-            jsn->action_callback_##action(jsn, JSONSL_ACTION_##action, state, (jsonsl_char_t*)c); \
-        } else if (jsn->action_callback) { \
-            jsn->action_callback(jsn, JSONSL_ACTION_##action, state, (jsonsl_char_t*)c); \
-        } \
+        JSONSL_EMIT(action); \
         if (jsn->stopfl) { return; } \
     }
 
@@ -216,7 +252,7 @@ jsonsl_feed(jsonsl_t jsn, const jsonsl_char_t *bytes, size_t nbytes)
     jsn->base = bytes;
 
     for (; nbytes; nbytes--, jsn->pos++, c++) {
-        register unsigned state_type;
+        unsigned state_type;
         INCR_METRIC(TOTAL);
         /* Special escape handling for some stuff */
         if (jsn->in_escape) {
@@ -482,7 +518,7 @@ jsonsl_feed(jsonsl_t jsn, const jsonsl_char_t *bytes, size_t nbytes)
                 DO_CALLBACK(OBJECT, POP);
             }
             state = jsn->stack + jsn->level;
-            state->pos_cur = jsn->pos;
+            SET_POS_CUR(state);
             goto GT_NEXT;
 
         default:
@@ -531,6 +567,44 @@ jsonsl_feed(jsonsl_t jsn, const jsonsl_char_t *bytes, size_t nbytes)
     }
 }
 
+#ifdef __cplusplus
+/* Handler for jsonsl_feed(), honouring the call_* flags and callback
+ * pointers of the parser */
+struct jsonsl_pointer_handler {
+#define X(T) \
+    static int call_##T(jsonsl_t jsn) { return jsn->call_##T; }
+    X(OBJECT) X(LIST) X(STRING) X(HKEY) X(SPECIAL) X(UESCAPE)
+#undef X
+
+#define X(action) \
+    static void on_##action(jsonsl_t jsn, struct jsonsl_state_st *state, \
+        const jsonsl_char_t *c) \
+    { \
+        if (jsn->action_callback_##action) { \
+            jsn->action_callback_##action(jsn, JSONSL_ACTION_##action, state, c); \
+        } else if (jsn->action_callback) { \
+            jsn->action_callback(jsn, JSONSL_ACTION_##action, state, c); \
+        } \
+    }
+    X(PUSH) X(POP) X(UESCAPE)
+#undef X
+
+    static int on_error(jsonsl_t jsn, jsonsl_error_t err,
+        struct jsonsl_state_st *state, jsonsl_char_t *at)
+    {
+        return jsn->error_callback(jsn, err, state, at);
+    }
+};
+
+JSONSL_API
+void
+jsonsl_feed(jsonsl_t jsn, const jsonsl_char_t *bytes, size_t nbytes)
+{
+    jsonsl_pointer_handler handler;
+    jsonsl_feed_handler(jsn, bytes, nbytes, handler);
+}
+#endif /* __cplusplus */
+
 JSONSL_API
 const char* jsonsl_strerror(jsonsl_error_t err)
 {
@@ -243,6 +243,35 @@ typedef enum {
  * an ad-hoc hierarchy on top of the JSON one.
  *
  */
+#ifdef JSONSL_STATE_COMPACT
+/**
+ * Compact layout of the state (see below for the meaning of the fields),
+ * for better cache use with deep documents. Positions are 32 bits unless
+ * JSONSL_STATE_POS64 is defined, so only the first 4GB of input can be
+ * parsed; levels are limited to JSONSL_STATE_LEVELS_MAX.
+ *
+ * Strings have no elements, so nescapes shares storage with nelem. There is
+ * no pos_cur; use jsonsl_st::pos in POP callbacks instead.
+ */
+#ifdef JSONSL_STATE_POS64
+typedef size_t jsonsl_spos_t;
+#else
+typedef uint32_t jsonsl_spos_t;
+#endif
+#define JSONSL_STATE_POS_MAX ((jsonsl_spos_t)-1)
+#define JSONSL_STATE_LEVELS_MAX 256
+
+struct jsonsl_state_st {
+    union {
+        uint64_t nelem;
+        uint64_t nescapes;
+    };
+    jsonsl_spos_t pos_begin;
+    unsigned type;
+    uint16_t special_flags;
+    uint8_t level;
+    uint8_t ignore_callback;
+#else
 struct jsonsl_state_st {
     /**
      * The JSON object type
@@ -317,6 +346,8 @@ struct jsonsl_state_st {
      * if the private data points to allocated memory, it should be freed
      * when the object is popped, as the state object will be re-used)
      */
+#endif /* JSONSL_STATE_COMPACT */
+
 #ifndef JSONSL_STATE_GENERIC
     JSONSL_STATE_USER_FIELDS
 #else
@@ -916,6 +947,49 @@ size_t jsonsl_util_unescape_ex(const char *in,
 
 #ifdef __cplusplus
 }
+
+/**
+ * Base for the handlers of jsonsl_feed_handler(). A handler derives from
+ * this and hides the members it needs:
+ *
+ * - call_OBJECT() .. call_UESCAPE() stand in for the call_* flags of
+ *   jsonsl_st. Returning a constant compiles out the events not wanted.
+ * - on_PUSH(), on_POP() and on_UESCAPE() stand in for the action callbacks.
+ * - on_error() stands in for the error callback.
+ *
+ * max_callback_level, ignore_callback, return_UESCAPE and jsonsl_stop()
+ * work as they do with jsonsl_feed().
+ */
+struct jsonsl_handler_base {
+    static int call_OBJECT(jsonsl_t) { return 1; }
+    static int call_LIST(jsonsl_t) { return 1; }
+    static int call_STRING(jsonsl_t) { return 1; }
+    static int call_HKEY(jsonsl_t) { return 1; }
+    static int call_SPECIAL(jsonsl_t) { return 1; }
+    static int call_UESCAPE(jsonsl_t) { return 0; }
+
+    static void on_PUSH(jsonsl_t, struct jsonsl_state_st *,
+        const jsonsl_char_t *) {}
+    static void on_POP(jsonsl_t, struct jsonsl_state_st *,
+        const jsonsl_char_t *) {}
+    static void on_UESCAPE(jsonsl_t, struct jsonsl_state_st *,
+        const jsonsl_char_t *) {}
+    static int on_error(jsonsl_t, jsonsl_error_t, struct jsonsl_state_st *,
+        jsonsl_char_t *) { return 0; }
+};
+
+/**
+ * Feeds data into the lexer, as jsonsl_feed(), but calls the members of
+ * `handler` directly rather than through the pointers in the lexer, so that
+ * they can be inlined into the loop. The lexer's callback pointers and
+ * call_* flags are ignored.
+ *
+ * This is a template defined in jsonsl.c, so it is only available where that
+ * file is included into a C++ translation unit.
+ */
+template <class Handler> static void
+jsonsl_feed_handler(jsonsl_t jsn, const jsonsl_char_t *bytes, size_t nbytes,
+    Handler& handler);
 #endif /* __cplusplus */
 
 #endif /* JSONSL_H_ */
@@ -0,0 +1,182 @@
+/* Runs a single command over many documents on a small work-stealing pool.
+ *
+ * Each worker owns a contiguous range of document indices which it consumes
+ * from the front, a chunk at a time. A worker whose range is exhausted steals
+ * the back half of another worker's range. Ranges are guarded by a per-worker
+ * mutex, which is uncontended except while stealing. */
+
+#include "batch.h"
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+/* Number of documents a worker takes from its own range at a time */
+const size_t BATCH_CHUNK = 16;
+
+struct Worker {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+    subdoc_OPERATION *op = NULL;
+};
+
+struct Batch {
+    const subdoc_LOC *docs;
+    subdoc_BATCH_RESULT *results;
+    std::vector<Worker> workers;
+
+    explicit Batch(size_t nworkers) : workers(nworkers) {}
+};
+
+bool
+take_own(Worker& w, size_t& begin, size_t& end)
+{
+    std::lock_guard<std::mutex> guard(w.mutex);
+    if (w.begin == w.end) {
+        return false;
+    }
+    begin = w.begin;
+    end = std::min(w.begin + BATCH_CHUNK, w.end);
+    w.begin = end;
+    return true;
+}
+
+bool
+steal(Batch& batch, size_t self, size_t& begin, size_t& end)
+{
+    size_t nworkers = batch.workers.size();
+    for (size_t ii = 1; ii < nworkers; ii++) {
+        Worker& victim = batch.workers[(self + ii) % nworkers];
+        std::lock_guard<std::mutex> guard(victim.mutex);
+        size_t remaining = victim.end - victim.begin;
+        if (remaining == 0) {
+            continue;
+        }
+        begin = victim.end - (remaining + 1) / 2;
+        end = victim.end;
+        victim.end = begin;
+        return true;
+    }
+    return false;
+}
+
+void
+exec_one(Batch& batch, subdoc_OPERATION *op, size_t ix)
+{
+    const subdoc_LOC *doc = &batch.docs[ix];
+    subdoc_BATCH_RESULT *res = &batch.results[ix];
+
+    /* Only the match state needs resetting; the path is retained */
+    memset(&op->match, 0, sizeof op->match);
+    op->doc_new_len = 0;
+    SUBDOC_OP_SETDOC(op, doc->at, doc->length);
+
+    res->status = subdoc_op_exec_compiled(op);
+    if (res->status == SUBDOC_STATUS_SUCCESS) {
+        res->loc = op->match.loc_match;
+        res->type = op->match.type;
+    } else {
+        res->loc.at = NULL;
+        res->loc.length = 0;
+        res->type = 0;
+    }
+}
+
+void
+run_worker(Batch *batch, size_t self)
+{
+    Worker& w = batch->workers[self];
+    size_t begin, end;
+
+    while (true) {
+        if (!take_own(w, begin, end)) {
+            if (!steal(*batch, self, begin, end)) {
+                return;
+            }
+            /* Make the stolen range our own, so it can be stolen in turn */
+            std::lock_guard<std::mutex> guard(w.mutex);
+            w.begin = begin;
+            w.end = end;
+            continue;
+        }
+        for (; begin < end; begin++) {
+            exec_one(*batch, w.op, begin);
+        }
+    }
+}
+
+} // namespace
+
+subdoc_ERRORS
+subdoc_batch_exec(const subdoc_LOC *docs, size_t ndocs,
+    const char *path, size_t npath, subdoc_OPTYPE optype,
+    subdoc_BATCH_RESULT *results, unsigned nthreads)
+{
+    subdoc_ERRORS status = SUBDOC_STATUS_SUCCESS;
+    size_t ii;
+
+    switch (optype) {
+    case SUBDOC_CMD_GET:
+    case SUBDOC_CMD_EXISTS:
+        break;
+    default:
+        return SUBDOC_STATUS_GLOBAL_ENOSUPPORT;
+    }
+
+    if (nthreads == 0) {
+        nthreads = std::thread::hardware_concurrency();
+    }
+    if (nthreads > ndocs) {
+        nthreads = (unsigned)ndocs;
+    }
+    if (nthreads == 0) {
+        nthreads = 1;
+    }
+
+    Batch batch(nthreads);
+    batch.docs = docs;
+    batch.results = results;
+
+    for (ii = 0; ii < nthreads; ii++) {
+        Worker& w = batch.workers[ii];
+        w.begin = (ndocs * ii) / nthreads;
+        w.end = (ndocs * (ii + 1)) / nthreads;
+        w.op = subdoc_op_alloc();
+        if (w.op == NULL) {
+            status = SUBDOC_STATUS_GLOBAL_ENOMEM;
+            goto GT_DONE;
+        }
+        SUBDOC_OP_SETCODE(w.op, optype);
+        if (subdoc_path_parse(w.op->path, path, npath) != 0) {
+            status = SUBDOC_STATUS_PATH_EINVAL;
+            goto GT_DONE;
+        }
+    }
+
+    {
+        std::vector<std::thread> threads;
+        for (ii = 1; ii < nthreads; ii++) {
+            try {
+                threads.push_back(std::thread(run_worker, &batch, ii));
+            } catch (std::exception&) {
+                /* Remaining ranges will be stolen by the running workers */
+                break;
+            }
+        }
+        run_worker(&batch, 0);
+        for (ii = 0; ii < threads.size(); ii++) {
+            threads[ii].join();
+        }
+    }
+
+    GT_DONE:
+    for (ii = 0; ii < nthreads; ii++) {
+        if (batch.workers[ii].op) {
+            subdoc_op_free(batch.workers[ii].op);
+        }
+    }
+    return status;
+}
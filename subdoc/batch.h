@@ -0,0 +1,51 @@
+#ifndef SUBDOC_BATCH_H
+#define SUBDOC_BATCH_H
+
+#include "operations.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Per-document result of subdoc_batch_exec() */
+typedef struct {
+    /** Status of the operation on this document */
+    subdoc_ERRORS status;
+    /** Type of the match (jsonsl_type_t), if successful */
+    unsigned type;
+    /** Location of the match within the input document, if successful */
+    subdoc_LOC loc;
+} subdoc_BATCH_RESULT;
+
+/**
+ * Executes the same read-only command over many documents.
+ *
+ * The path is parsed once per worker, and each worker owns its own operation
+ * (and thus its own parser), so per-document setup is limited to resetting the
+ * match state. Documents are distributed over a work-stealing pool of
+ * `nthreads` workers (the calling thread being one of them).
+ *
+ * @param docs Array of documents
+ * @param ndocs Number of documents
+ * @param path The path to execute for each document
+ * @param npath Length of the path
+ * @param optype Command to execute. Only non-mutating commands are supported,
+ *        as results must not reference any per-worker storage
+ * @param results Caller-owned array of `ndocs` results, populated on return
+ * @param nthreads Number of workers. If 0, the number of hardware threads
+ *        is used
+ *
+ * @return SUBDOC_STATUS_SUCCESS if all documents were processed (individual
+ * statuses are in `results`); SUBDOC_STATUS_PATH_EINVAL if the path is
+ * invalid; SUBDOC_STATUS_GLOBAL_ENOSUPPORT if the command cannot be batched;
+ * SUBDOC_STATUS_GLOBAL_ENOMEM on allocation failure.
+ */
+subdoc_ERRORS
+subdoc_batch_exec(const subdoc_LOC *docs, size_t ndocs,
+    const char *path, size_t npath, subdoc_OPTYPE optype,
+    subdoc_BATCH_RESULT *results, unsigned nthreads);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
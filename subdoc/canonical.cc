@@ -0,0 +1,212 @@
+/* Canonical (sorted-key) documents. The document is parsed once to record the
+ * extent of every value and key, and then written out again from that tree,
+ * visiting dictionary members in key order. See canonical.h */
+
+#define INCLUDE_JSONSL_SRC
+#include "canonical.h"
+#include <vector>
+#include <algorithm>
+#include <new>
+
+namespace {
+
+const size_t NONE = (size_t)-1;
+
+struct Node {
+    size_t begin; /* First byte of the value */
+    size_t end; /* One past the last byte of the value */
+    size_t key_begin; /* Opening quote of the key, if the parent is a dict */
+    size_t key_end; /* One past the closing quote */
+    size_t next; /* Next sibling */
+    size_t first_child;
+    size_t last_child;
+    size_t nchildren;
+    unsigned type;
+};
+
+struct Tree {
+    std::vector<Node> nodes;
+    /* Index of the open node at each level */
+    size_t open[COMPONENTS_ALLOC + 1];
+    size_t key_begin;
+    size_t key_end;
+    jsonsl_error_t err;
+};
+
+Tree *get_tree(jsonsl_t jsn)
+{
+    return (Tree *)jsn->data;
+}
+
+void
+push_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_state_st *st,
+    const jsonsl_char_t *)
+{
+    Tree *t = get_tree(jsn);
+    if (st->type == JSONSL_T_HKEY) {
+        t->key_begin = st->pos_begin;
+        return;
+    }
+
+    Node n;
+    n.begin = st->pos_begin;
+    n.end = NONE;
+    n.key_begin = t->key_begin;
+    n.key_end = t->key_end;
+    n.next = NONE;
+    n.first_child = NONE;
+    n.last_child = NONE;
+    n.nchildren = 0;
+    n.type = st->type;
+
+    size_t ix = t->nodes.size();
+    t->nodes.push_back(n);
+    t->open[st->level] = ix;
+
+    if (st->level > 1) {
+        Node& parent = t->nodes[t->open[st->level - 1]];
+        if (parent.last_child == NONE) {
+            parent.first_child = ix;
+        } else {
+            t->nodes[parent.last_child].next = ix;
+        }
+        parent.last_child = ix;
+        parent.nchildren++;
+    }
+}
+
+void
+pop_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_state_st *st,
+    const jsonsl_char_t *)
+{
+    Tree *t = get_tree(jsn);
+    if (st->type == JSONSL_T_HKEY) {
+        t->key_end = jsn->pos + 1;
+        return;
+    }
+    Node& n = t->nodes[t->open[st->level]];
+    n.end = jsn->pos;
+    if (st->type != JSONSL_T_SPECIAL) {
+        n.end++; /* Include the terminating token */
+    }
+}
+
+int
+err_callback(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_state_st *,
+    jsonsl_char_t *)
+{
+    get_tree(jsn)->err = err;
+    return 0;
+}
+
+struct Handler : jsonsl_handler_base {
+    static void on_PUSH(jsonsl_t jsn, struct jsonsl_state_st *st,
+        const jsonsl_char_t *at) {
+        push_callback(jsn, JSONSL_ACTION_PUSH, st, at);
+    }
+    static void on_POP(jsonsl_t jsn, struct jsonsl_state_st *st,
+        const jsonsl_char_t *at) {
+        pop_callback(jsn, JSONSL_ACTION_POP, st, at);
+    }
+    static int on_error(jsonsl_t jsn, jsonsl_error_t err,
+        struct jsonsl_state_st *st, jsonsl_char_t *at) {
+        return err_callback(jsn, err, st, at);
+    }
+};
+
+struct Writer {
+    const char *doc;
+    const std::vector<Node>& nodes;
+    char *out;
+    size_t nout;
+
+    void put(const char *s, size_t n) {
+        memcpy(out + nout, s, n);
+        nout += n;
+    }
+
+    void put(size_t begin, size_t end) {
+        put(doc + begin, end - begin);
+    }
+
+    bool key_less(size_t a, size_t b) const {
+        const Node& na = nodes[a];
+        const Node& nb = nodes[b];
+        return subdoc_compare_keys(doc + na.key_begin + 1,
+            na.key_end - na.key_begin - 2, doc + nb.key_begin + 1,
+            nb.key_end - nb.key_begin - 2) < 0;
+    }
+
+    void write(size_t ix) {
+        const Node& n = nodes[ix];
+        if (n.type != JSONSL_T_OBJECT && n.type != JSONSL_T_LIST) {
+            put(n.begin, n.end);
+            return;
+        }
+
+        std::vector<size_t> children;
+        children.reserve(n.nchildren);
+        for (size_t cur = n.first_child; cur != NONE; cur = nodes[cur].next) {
+            children.push_back(cur);
+        }
+
+        if (n.type == JSONSL_T_OBJECT) {
+            std::stable_sort(children.begin(), children.end(),
+                [this](size_t a, size_t b) { return key_less(a, b); });
+        }
+
+        put(doc + n.begin, 1);
+        for (size_t ii = 0; ii < children.size(); ii++) {
+            const Node& child = nodes[children[ii]];
+            if (ii) {
+                put(",", 1);
+            }
+            if (n.type == JSONSL_T_OBJECT) {
+                put(child.key_begin, child.key_end);
+                put(":", 1);
+            }
+            write(children[ii]);
+        }
+        put(doc + n.end - 1, 1);
+    }
+};
+
+} // namespace
+
+int
+subdoc_canonicalize(const char *value, size_t nvalue, jsonsl_t jsn,
+    char *out, size_t *nout)
+{
+    Tree tree;
+    Handler handler;
+    tree.key_begin = tree.key_end = 0;
+    tree.err = JSONSL_ERROR_SUCCESS;
+
+    if (nvalue > SUBDOC_DOC_MAX) {
+        return SUBDOC_VALIDATE_E2BIG;
+    }
+    try {
+        jsn->max_callback_level = -1;
+        jsn->data = &tree;
+        jsonsl_feed_handler(jsn, value, nvalue, handler);
+
+        if (tree.err == JSONSL_ERROR_SUCCESS &&
+                (jsn->level != 0 || tree.nodes.empty() ||
+                        tree.nodes[0].end == NONE)) {
+            /* Empty or truncated */
+            tree.err = JSONSL_ERROR_GENERIC;
+        }
+        jsonsl_reset(jsn);
+        if (tree.err != JSONSL_ERROR_SUCCESS) {
+            return tree.err;
+        }
+
+        Writer w = { value, tree.nodes, out, 0 };
+        w.write(0);
+        *nout = w.nout;
+        return 0;
+    } catch (std::bad_alloc&) {
+        jsonsl_reset(jsn);
+        return -1;
+    }
+}
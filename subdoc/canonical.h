@@ -0,0 +1,46 @@
+#ifndef SUBDOC_CANONICAL_H
+#define SUBDOC_CANONICAL_H
+
+#include "match.h"
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Order of dictionary keys in a canonical document. Keys are compared by
+ * their raw (still escaped) bytes, excluding the quotes; a key sorts before
+ * any longer key it is a prefix of.
+ */
+static inline int
+subdoc_compare_keys(const char *a, size_t na, const char *b, size_t nb)
+{
+    int rv = memcmp(a, b, na < nb ? na : nb);
+    if (rv != 0) {
+        return rv;
+    }
+    return na < nb ? -1 : na > nb;
+}
+
+/**
+ * Rewrite a document in canonical form: the members of every dictionary are
+ * sorted by key (see subdoc_compare_keys(); members with equal keys keep
+ * their order), and whitespace between tokens is removed. Strings and numbers
+ * are copied as they are. The document must be a dictionary or an array.
+ *
+ * @param out Receives the result. Must have room for `nvalue` bytes; the
+ *        canonical form is never longer than the original
+ * @param[out] nout Length of the result
+ * @return 0 on success, -1 on allocation failure, SUBDOC_VALIDATE_E2BIG if
+ *         the document is longer than SUBDOC_DOC_MAX, or the jsonsl_error_t
+ *         describing why the document could not be parsed
+ */
+int
+subdoc_canonicalize(const char *value, size_t nvalue, jsonsl_t jsn,
+    char *out, size_t *nout);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,136 @@
+/* Whitespace removal. Outside strings, blocks without whitespace or quotes
+ * are copied whole and blocks of indentation are skipped whole; inside
+ * strings, blocks without quotes or backslashes are copied whole. Only the
+ * bytes around the interesting characters are handled one at a time. See
+ * compact.h */
+
+#include "compact.h"
+#include "subdoc-util.h"
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define COMPACT_USE_SSE2
+#endif
+
+static inline int
+is_ws(unsigned char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/* Whether `c` may be part of a string, number or literal. Whitespace between
+ * two of these would join separate tokens, and is never valid JSON */
+static inline int
+is_token(unsigned char c)
+{
+    return c != '{' && c != '}' && c != '[' && c != ']' && c != ',' && c != ':';
+}
+
+#ifdef COMPACT_USE_SSE2
+/* Masks of the positions of whitespace and of quotes in a block */
+static inline void
+classify(__m128i v, unsigned *ws, unsigned *quote)
+{
+    __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i cr = _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'));
+    __m128i tab = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+    __m128i q = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    *ws = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(sp, nl), _mm_or_si128(cr, tab)));
+    *quote = (unsigned)_mm_movemask_epi8(q);
+}
+
+/* Mask of the positions of quotes and backslashes in a block */
+static inline unsigned
+string_specials(__m128i v)
+{
+    __m128i q = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    __m128i bs = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(q, bs));
+}
+#endif
+
+int
+subdoc_compact(const char *value, size_t nvalue, char *out, size_t *nout)
+{
+    size_t ii = 0, jj = 0;
+    int in_str = 0;
+    /* Set if whitespace was skipped since the last byte written */
+    int skipped = 0;
+
+    while (ii < nvalue) {
+#ifdef COMPACT_USE_SSE2
+        /* The output never gets ahead of the input, so there is always room
+         * to store a whole block at `jj`, even if only part of it is kept */
+        if (nvalue - ii >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(value + ii));
+            _mm_storeu_si128((__m128i *)(out + jj), v);
+
+            if (in_str) {
+                unsigned mask = string_specials(v);
+                if (mask == 0) {
+                    ii += 16;
+                    jj += 16;
+                    continue;
+                }
+                /* Keep everything before the quote or backslash */
+                unsigned n = subdoc_ctz64(mask);
+                ii += n;
+                jj += n;
+            } else {
+                unsigned ws, quote;
+                classify(v, &ws, &quote);
+                if (ws == 0xffff) {
+                    ii += 16;
+                    skipped = 1;
+                    continue;
+                }
+                if (skipped && !((ws | quote) & 1)) {
+                    /* Written in place of the whitespace skipped before it */
+                    if (jj && is_token(out[jj-1]) && is_token(value[ii])) {
+                        return -1;
+                    }
+                    skipped = 0;
+                }
+                if ((ws | quote) == 0) {
+                    ii += 16;
+                    jj += 16;
+                    continue;
+                }
+                unsigned n = subdoc_ctz64(ws | quote);
+                ii += n;
+                jj += n;
+            }
+        }
+#endif
+        unsigned char c = (unsigned char)value[ii++];
+        if (in_str) {
+            out[jj++] = (char)c;
+            if (c == '\\') {
+                if (ii == nvalue) {
+                    return -1;
+                }
+                out[jj++] = value[ii++];
+            } else if (c == '"') {
+                in_str = 0;
+            }
+        } else if (is_ws(c)) {
+            skipped = 1;
+        } else {
+            if (skipped && jj && is_token(out[jj-1]) && is_token(c)) {
+                return -1;
+            }
+            skipped = 0;
+            out[jj++] = (char)c;
+            in_str = c == '"';
+        }
+    }
+
+    if (in_str) {
+        return -1;
+    }
+    *nout = jj;
+    return 0;
+}
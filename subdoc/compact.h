@@ -0,0 +1,31 @@
+#ifndef SUBDOC_COMPACT_H
+#define SUBDOC_COMPACT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Remove all whitespace outside of strings from a document.
+ *
+ * The document is not parsed, only scanned for strings, so this is much
+ * cheaper than a lookup. It follows that it is not validated either, beyond
+ * refusing to join two tokens (e.g. `[1 2]` would otherwise become `[12]`).
+ * Validate the document first (as SUBDOC_CMD_COMPACT does) if it may not be
+ * JSON.
+ *
+ * @param out Receives the result. Must have room for `nvalue` bytes, and must
+ *        not overlap `value`
+ * @param[out] nout Length of the result
+ * @return 0 on success, or -1 if the document ends inside a string, or
+ *         whitespace separates two tokens
+ */
+int
+subdoc_compact(const char *value, size_t nvalue, char *out, size_t *nout);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
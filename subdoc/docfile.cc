@@ -0,0 +1,114 @@
+/* File-backed documents. See docfile.h */
+
+#include "docfile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define DOCFILE_USE_MMAP
+#endif
+
+/* Fallback: read the entire file onto the heap */
+static int
+read_file(subdoc_DOCFILE *df, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    char *buf = NULL;
+    size_t nbuf = 0, nread;
+    int rv = 0;
+
+    if (fp == NULL) {
+        return errno;
+    }
+    do {
+        char *tmp = (char *)realloc(buf, nbuf + 65536);
+        if (tmp == NULL) {
+            rv = ENOMEM;
+            break;
+        }
+        buf = tmp;
+        nread = fread(buf + nbuf, 1, 65536, fp);
+        nbuf += nread;
+    } while (nread == 65536);
+
+    if (rv == 0 && ferror(fp)) {
+        rv = EIO;
+    }
+    fclose(fp);
+    if (rv != 0) {
+        free(buf);
+        return rv;
+    }
+    df->base = buf;
+    df->nbase = nbuf;
+    df->doc.at = buf;
+    df->doc.length = nbuf;
+    return 0;
+}
+
+int
+subdoc_docfile_open(subdoc_DOCFILE *df, const char *path)
+{
+    memset(df, 0, sizeof(*df));
+
+#ifdef DOCFILE_USE_MMAP
+    struct stat sb;
+    void *map;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        return errno;
+    }
+    if (fstat(fd, &sb) == -1) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    if (!S_ISREG(sb.st_mode) || sb.st_size == 0) {
+        /* Can't (or needn't) map pipes or empty files */
+        close(fd);
+        return read_file(df, path);
+    }
+
+    map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return read_file(df, path);
+    }
+
+    /* The parser only moves forward, so aggressive read-ahead (and early
+     * reclaim of what's behind us) is what we want */
+    (void)madvise(map, (size_t)sb.st_size, MADV_SEQUENTIAL);
+
+    df->base = map;
+    df->nbase = (size_t)sb.st_size;
+    df->mapped = 1;
+    df->doc.at = (const char *)map;
+    df->doc.length = df->nbase;
+    return 0;
+#else
+    return read_file(df, path);
+#endif
+}
+
+void
+subdoc_docfile_close(subdoc_DOCFILE *df)
+{
+#ifdef DOCFILE_USE_MMAP
+    if (df->mapped) {
+        munmap(df->base, df->nbase);
+    } else {
+        free(df->base);
+    }
+#else
+    free(df->base);
+#endif
+    memset(df, 0, sizeof(*df));
+}
@@ -0,0 +1,43 @@
+#ifndef SUBDOC_DOCFILE_H
+#define SUBDOC_DOCFILE_H
+
+#include "match.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A read-only document backed by a file.
+ *
+ * Where supported, the file is mapped into memory rather than read, and the
+ * kernel is advised that it will be accessed sequentially. Since the parser
+ * reads the document front to back and read-only lookups stop as soon as the
+ * match is complete, only the prefix of the file up to the match is paged in.
+ * This allows lookups on documents larger than available memory.
+ */
+typedef struct {
+    /** The document contents. Valid until subdoc_docfile_close() */
+    subdoc_LOC doc;
+
+    /* Internal: mapping (or heap buffer) backing #doc */
+    void *base;
+    size_t nbase;
+    int mapped;
+} subdoc_DOCFILE;
+
+/**
+ * Open the file at `path` as a document.
+ * @return 0 on success, or an errno value on failure
+ */
+int
+subdoc_docfile_open(subdoc_DOCFILE *df, const char *path);
+
+/** Release the document. Locations pointing into it become invalid */
+void
+subdoc_docfile_close(subdoc_DOCFILE *df);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
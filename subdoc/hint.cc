@@ -0,0 +1,263 @@
+/* Speculative matching at a previously seen location. See hint.h */
+
+#include "hint.h"
+#include <string.h>
+
+namespace {
+
+const size_t NPOS = (size_t)-1;
+
+/* One of the containers enclosing the hinted location */
+struct Level {
+    size_t open; /* Offset of the opening token */
+    size_t key_begin; /* Opening quote of its key, if the parent is a dict */
+    size_t key_end; /* Closing quote of the key */
+    size_t index; /* Position within the parent */
+    size_t nsep; /* Separators seen so far at this level */
+    bool is_obj;
+};
+
+inline bool
+is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/* Whether the container at `lv` is the child of `parent` selected by `comp` */
+bool
+child_matches(const char *doc, const Level& parent, const Level& lv,
+    const struct jsonsl_jpr_component_st *comp)
+{
+    if (!parent.is_obj) {
+        return comp->ptype == JSONSL_PATH_NUMERIC && !comp->is_neg &&
+                comp->idx == lv.index;
+    }
+    if (comp->pstr == NULL || comp->is_arridx) {
+        return false;
+    }
+    return comp->len == lv.key_end - lv.key_begin - 1 &&
+            memcmp(doc + lv.key_begin + 1, comp->pstr, comp->len) == 0;
+}
+
+/* Walk the document up to `end`, keeping track of the containers enclosing
+ * the current position. Returns the nesting depth there, or NPOS */
+size_t
+walk(const char *doc, size_t end, Level *levels)
+{
+    size_t depth = 0, pos, last_str = 0, last_str_end = 0;
+
+    for (pos = 0; pos < end; pos++) {
+        char c = doc[pos];
+        if (c == '"') {
+            last_str = pos;
+            for (pos++; pos < end && doc[pos] != '"'; pos++) {
+                if (doc[pos] == '\\') {
+                    pos++;
+                }
+            }
+            last_str_end = pos;
+        } else if (c == '{' || c == '[') {
+            if (depth == COMPONENTS_ALLOC) {
+                return NPOS;
+            }
+            Level& lv = levels[++depth];
+            lv.open = pos;
+            lv.is_obj = c == '{';
+            lv.nsep = 0;
+            if (depth > 1) {
+                /* In valid JSON, the last string at the parent's level is
+                 * the key of a container in a dictionary */
+                lv.key_begin = last_str;
+                lv.key_end = last_str_end;
+                lv.index = levels[depth - 1].nsep;
+            }
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return NPOS;
+            }
+            depth--;
+        } else if (c == ',' && depth) {
+            levels[depth].nsep++;
+        }
+    }
+    return pos == end ? depth : NPOS;
+}
+
+/* Whether the containers enclosing a position, up to `depth`, are those named
+ * by the path */
+bool
+levels_match(const char *doc, const Level *levels, size_t depth,
+    const struct jsonsl_jpr_st *jpr)
+{
+    for (size_t ii = 2; ii <= depth; ii++) {
+        if (!child_matches(doc, levels[ii - 1], levels[ii],
+                &jpr->components[ii - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Verify that the hinted member is the one named by the last component of
+ * the path. On success, returns the offset of its value, and sets its
+ * position within the parent and the length of its key (0 in an array).
+ * Adds the number of bytes examined to `*nscanned` */
+size_t
+verify(const char *doc, size_t ndoc, const struct jsonsl_jpr_st *jpr,
+    const subdoc_PATH_HINT *hint, size_t *position, size_t *nkey,
+    size_t *nscanned)
+{
+    const size_t parent_level = jpr->ncomponents - 1;
+    const size_t member = hint->member_pos;
+    const struct jsonsl_jpr_component_st *comp;
+    Level levels[COMPONENTS_ALLOC + 1];
+    size_t pos;
+
+    if (member >= ndoc || hint->parent_pos >= member ||
+            (doc[hint->parent_pos] != '{' && doc[hint->parent_pos] != '[')) {
+        return NPOS;
+    }
+    *nscanned += member;
+    if (walk(doc, member, levels) != parent_level ||
+            levels[parent_level].open != hint->parent_pos ||
+            !levels_match(doc, levels, parent_level, jpr)) {
+        return NPOS;
+    }
+
+    /* And finally the member itself */
+    const Level& parent = levels[parent_level];
+    comp = &jpr->components[parent_level];
+    *position = parent.nsep;
+    *nkey = 0;
+    if (!parent.is_obj) {
+        if (comp->ptype != JSONSL_PATH_NUMERIC || comp->is_neg ||
+                comp->idx != parent.nsep || is_ws(doc[member])) {
+            return NPOS;
+        }
+        return member;
+    }
+
+    if (comp->pstr == NULL || comp->is_arridx ||
+            ndoc - member < comp->len + 2 || doc[member] != '"' ||
+            memcmp(doc + member + 1, comp->pstr, comp->len) != 0 ||
+            doc[member + comp->len + 1] != '"') {
+        return NPOS;
+    }
+    *nkey = comp->len + 2;
+    for (pos = member + *nkey; pos < ndoc && is_ws(doc[pos]); pos++) {
+    }
+    if (pos == ndoc || doc[pos] != ':') {
+        return NPOS;
+    }
+    for (pos++; pos < ndoc && is_ws(doc[pos]); pos++) {
+    }
+    *nscanned += pos - member;
+    return pos < ndoc ? pos : NPOS;
+}
+
+/* Parse just the value at `vpos`, presenting it to the parser as the sole
+ * element of an array */
+bool
+match_value(const char *doc, size_t ndoc, size_t vpos, jsonsl_t jsn,
+    subdoc_MATCH *m)
+{
+    subdoc_PATH tmp;
+    subdoc_LOC bufs[2];
+
+    tmp.jpr_base.components = tmp.components_s;
+    tmp.jpr_base.ncomponents = 2;
+    tmp.has_negix = 0;
+    tmp.has_wildcard = 0;
+    memset(tmp.components_s, 0, sizeof(tmp.components_s[0]) * 2);
+    tmp.components_s[0].ptype = JSONSL_PATH_ROOT;
+    tmp.components_s[1].ptype = JSONSL_PATH_NUMERIC;
+    tmp.components_s[1].is_arridx = 1;
+
+    bufs[0].at = "[";
+    bufs[0].length = 1;
+    bufs[1].at = doc + vpos;
+    bufs[1].length = ndoc - vpos;
+
+    memset(m, 0, sizeof(*m));
+    m->stop_on_match = 1;
+    subdoc_match_exec_bufs(bufs, 2, &tmp, jsn, m);
+    return m->status == JSONSL_ERROR_SUCCESS &&
+            m->matchres == JSONSL_MATCH_COMPLETE;
+}
+
+} // namespace
+
+int
+subdoc_hint_verify_container(const char *value, size_t nvalue,
+    const subdoc_PATH *pth, size_t pos)
+{
+    const struct jsonsl_jpr_st *jpr = &pth->jpr_base;
+    Level levels[COMPONENTS_ALLOC + 1];
+
+    if (pos >= nvalue || (value[pos] != '{' && value[pos] != '[') ||
+            pth->has_negix) {
+        return 0;
+    }
+    /* Include the opening token, so that the container is the innermost */
+    return walk(value, pos + 1, levels) == jpr->ncomponents &&
+            levels[jpr->ncomponents].open == pos &&
+            levels_match(value, levels, jpr->ncomponents, jpr);
+}
+
+int
+subdoc_match_exec_hinted(const char *value, size_t nvalue,
+    const subdoc_PATH *pth, jsonsl_t jsn, subdoc_MATCH *result,
+    subdoc_PATH_HINT *hint)
+{
+    const struct jsonsl_jpr_st *jpr = &pth->jpr_base;
+    subdoc_MATCH m;
+    size_t vpos, position = 0, nkey = 0;
+    int rv;
+
+    if (nvalue > SUBDOC_DOC_MAX) {
+        result->status = SUBDOC_VALIDATE_E2BIG;
+        return 0;
+    }
+    if (hint->valid && !pth->has_negix && jpr->ncomponents > 1 &&
+            (vpos = verify(value, nvalue, jpr, hint, &position, &nkey,
+                    &result->bytes_scanned)) != NPOS &&
+            match_value(value, nvalue, vpos, jsn, &m)) {
+        /* Describe it as the full scan would have */
+        result->status = JSONSL_ERROR_SUCCESS;
+        result->matchres = JSONSL_MATCH_COMPLETE;
+        result->type = m.type;
+        result->sflags = m.sflags;
+        result->numval = m.numval;
+        /* Less the '[' match_value() parses first */
+        result->bytes_scanned += m.bytes_scanned - 1;
+        result->loc_match = m.loc_match;
+        result->match_level = (uint16_t)jpr->ncomponents;
+        result->position = (unsigned)position;
+        result->immediate_parent_found = 1;
+        result->loc_parent.at = value + hint->parent_pos;
+        if (nkey) {
+            result->has_key = 1;
+            result->loc_key.at = value + hint->member_pos;
+            result->loc_key.length = nkey;
+        }
+        hint->hits++;
+        return 0;
+    }
+
+    hint->misses++;
+    result->stop_on_match = 1;
+    rv = subdoc_match_exec(value, nvalue, pth, jsn, result);
+    if (rv == 0 && !pth->has_negix &&
+            result->matchres == JSONSL_MATCH_COMPLETE &&
+            result->status == JSONSL_ERROR_SUCCESS &&
+            result->match_level > 1) {
+        hint->parent_pos = result->loc_parent.at - value;
+        if (result->has_key) {
+            hint->member_pos = result->loc_key.at - value;
+        } else {
+            hint->member_pos = result->loc_match.at - value;
+        }
+        hint->valid = 1;
+    }
+    return rv;
+}
@@ -0,0 +1,65 @@
+#ifndef SUBDOC_HINT_H
+#define SUBDOC_HINT_H
+
+#include "match.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Where a path was last found. Documents of the same type tend to have the
+ * same layout, so the next document will often have the match at (or near
+ * enough to verify at) the same offsets.
+ *
+ * A hint is only ever a guess: it may come from a different document, or even
+ * from a different path, without affecting the result. Zero it before first
+ * use.
+ */
+typedef struct {
+    /** Offset of the opening token of the match's parent */
+    size_t parent_pos;
+    /** Offset of the match's key, or of the match itself if the parent is an
+     * array */
+    size_t member_pos;
+    /** Set once a location has been recorded */
+    int valid;
+    /** Number of lookups which used the hint, and which fell back to a full
+     * scan */
+    size_t hits;
+    size_t misses;
+} subdoc_PATH_HINT;
+
+/**
+ * Like subdoc_match_exec() with subdoc_MATCH::stop_on_match set, but first
+ * tries the location recorded in `hint`.
+ *
+ * The hinted location is verified with a structural scan of the document up
+ * to it, which only tracks strings, nesting, and the keys and indices of the
+ * enclosing containers, and is much cheaper than parsing. If the enclosing
+ * containers are those named by the path, only the matched value itself is
+ * parsed. Otherwise the whole document is matched as usual, and the hint
+ * updated from the result.
+ *
+ * On a hit, the document before the match is not validated (as with
+ * stop_on_match, nothing after it is either), and #num_siblings is not set.
+ * Paths with negative indices always use a full scan.
+ */
+int
+subdoc_match_exec_hinted(const char *value, size_t nvalue,
+    const subdoc_PATH *pth, jsonsl_t jsn, subdoc_MATCH *result,
+    subdoc_PATH_HINT *hint);
+
+/**
+ * Check, with the structural scan used by subdoc_match_exec_hinted(), that
+ * the array or dictionary opening at offset `pos` is the one named by `pth`.
+ * Returns nonzero if so. As with a hint, nothing else is validated.
+ */
+int
+subdoc_hint_verify_container(const char *value, size_t nvalue,
+    const subdoc_PATH *pth, size_t pos);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
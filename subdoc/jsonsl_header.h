@@ -10,6 +10,13 @@
 
 #define JSONSL_STATE_USER_FIELDS \
     short mres;
+
+/* Use the 24 byte parser state, unless SUBDOC_JSONSL_WIDE is defined. Its
+ * positions are 32 bits unless JSONSL_STATE_POS64 is also defined (see
+ * SUBDOC_STATUS_DOC_E2BIG) */
+#ifndef SUBDOC_JSONSL_WIDE
+#define JSONSL_STATE_COMPACT
+#endif
 #ifdef INCLUDE_JSONSL_SRC
 #if defined(__GNUC__) || defined(__clang__)
 #define JSONSL_API __attribute__((unused)) static
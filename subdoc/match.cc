@@ -5,12 +5,23 @@
 #include "jsonsl_header.h"
 #include "subdoc-api.h"
 #include "match.h"
+#include "canonical.h"
+#include "subdoc-util.h"
+
+/* Which callbacks a path match is delivering events to. See match_handler */
+enum {
+    MATCH_MODE_ROOT = 0, /* initial_callback() for the root */
+    MATCH_MODE_PATH, /* push_callback() and pop_callback() */
+    MATCH_MODE_UNIQUE /* unique_callback() within the matched array */
+};
 
 typedef struct {
     const char *curhk;
     jsonsl_jpr_t jpr;
     size_t hklen;
     subdoc_MATCH *match;
+    uint64_t unique_hash; /* Hash of ensure_unique, if unique_hashed */
+    int mode;
 } parse_ctx;
 
 static void push_callback(jsonsl_t jsn,jsonsl_action_t, struct jsonsl_state_st *, const jsonsl_char_t *);
@@ -31,11 +42,49 @@ err_callback(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_state_st *state,
     return 0;
 }
 
+static void
+update_possible_m(subdoc_MATCH *m, const struct jsonsl_state_st *state, const char *at)
+{
+    m->loc_parent.at = at;
+    m->match_level = state->level;
+}
+
 static void
 update_possible(parse_ctx *ctx, const struct jsonsl_state_st *state, const char *at)
 {
-    ctx->match->loc_parent.at = at;
-    ctx->match->match_level = state->level;
+    update_possible_m(ctx->match, state, at);
+}
+
+/* Accelerated comparison for unique_callback(), used if unique_hashed is set.
+ * Every element is hashed (containers included), and only compared in full
+ * if both its length and hash are equal to those of the new value */
+static void
+unique_hashed_check(jsonsl_t jsn, const struct jsonsl_state_st *st)
+{
+    parse_ctx *ctx = get_ctx(jsn);
+    subdoc_MATCH *m = ctx->match;
+    size_t slen = jsn->pos - st->pos_begin;
+    uint64_t hash;
+
+    if (st->type != JSONSL_T_SPECIAL) {
+        slen++; /* Include the closing token */
+    }
+    hash = subdoc_unique_hash(ctx->curhk, slen);
+
+    if (m->unique_index) {
+        /* Failure is recorded within the index itself */
+        subdoc_unique_index_add(m->unique_index, hash);
+    }
+    if (m->unique_item_found || hash != ctx->unique_hash ||
+            slen != m->ensure_unique.length) {
+        return;
+    }
+    if (memcmp(ctx->curhk, m->ensure_unique.at, slen) == 0) {
+        m->unique_item_found = 1;
+        if (m->unique_index == NULL) {
+            jsn->max_callback_level = 1;
+        }
+    }
 }
 
 static void
@@ -55,13 +104,17 @@ unique_callback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *st
 
     if (st->level == jsn->max_callback_level-2) {
         /* Popping the parent state! */
-        jsn->action_callback_POP = pop_callback;
-        jsn->action_callback_PUSH = push_callback;
+        ctx->mode = MATCH_MODE_PATH;
         pop_callback(jsn, action, st, at);
         return;
     }
 
-    slen = st->pos_cur - st->pos_begin;
+    if (m->unique_hashed) {
+        unique_hashed_check(jsn, st);
+        return;
+    }
+
+    slen = jsn->pos - st->pos_begin;
 
     if (st->type == JSONSL_T_STRING) {
         slen++;
@@ -102,6 +155,20 @@ unique_callback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *st
 #define M_COMPLETE JSONSL_MATCH_COMPLETE
 #define IS_CONTAINER JSONSL_STATE_IS_CONTAINER
 
+/* With keys_sorted, called for each non-matching key of the deepest possible
+ * match. Returns true if the key sorts after the one the path wants at this
+ * level, in which case the wanted key doesn't exist */
+static int
+key_passed(const parse_ctx *ctx, const struct jsonsl_state_st *parent)
+{
+    const struct jsonsl_jpr_component_st *comp =
+            &ctx->jpr->components[parent->level];
+    if (comp->pstr == NULL || comp->is_arridx) {
+        return 0;
+    }
+    return subdoc_compare_keys(ctx->curhk, ctx->hklen, comp->pstr, comp->len) > 0;
+}
+
 static void
 push_callback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *st,
     const jsonsl_char_t *at)
@@ -150,17 +217,37 @@ push_callback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *st,
                     m->matchres = JSONSL_MATCH_TYPE_MISMATCH;
                     st->ignore_callback = 1;
                 } else {
-                    jsn->action_callback_POP = unique_callback;
-                    jsn->action_callback_PUSH = unique_callback;
+                    if (m->unique_hashed) {
+                        ctx->unique_hash = subdoc_unique_hash(
+                            m->ensure_unique.at, m->ensure_unique.length);
+                    }
+                    ctx->mode = MATCH_MODE_UNIQUE;
                     unique_callback(jsn, action, st, at);
                 }
             }
 
         } else if (st->mres == JSONSL_MATCH_NOMATCH) {
             st->ignore_callback = 1;
+            if (m->keys_sorted && prtype == JSONSL_T_OBJECT &&
+                    m->loc_next_key.at == NULL &&
+                    parent->level == m->match_level && key_passed(ctx, parent)) {
+                m->loc_next_key.at = ctx->curhk - 1;
+                m->loc_next_key.length = ctx->hklen + 2;
+                if (m->stop_on_match) {
+                    /* Nothing further in this dictionary can match */
+                    m->type = prtype;
+                    if (parent->level == ctx->jpr->ncomponents - 1) {
+                        m->immediate_parent_found = 1;
+                    }
+                    jsn->max_callback_level = 1;
+                    jsonsl_stop(jsn);
+                }
+            }
 
         } else if (st->mres == JSONSL_MATCH_POSSIBLE) {
             update_possible(ctx, st, at);
+            /* Only possible if the keys weren't really sorted */
+            m->loc_next_key.at = NULL;
 
         } else if (st->mres == JSONSL_MATCH_TYPE_MISMATCH) {
             st->ignore_callback = 1;
@@ -185,7 +272,7 @@ pop_callback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state
 
     if (state->type == JSONSL_T_HKEY) {
         /* Keep the hashkey! */
-        ctx->hklen = state->pos_cur - (state->pos_begin + 1);
+        ctx->hklen = jsn->pos - (state->pos_begin + 1);
         return;
     }
 
@@ -194,11 +281,22 @@ pop_callback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state
         m->loc_match.length = end_pos - state->pos_begin;
         if (state->type != JSONSL_T_SPECIAL) {
             m->loc_match.length++; /* Include the terminating token */
+            if (state->type == JSONSL_T_OBJECT) {
+                m->numval = state->nelem / 2;
+            } else {
+                m->numval = state->nelem;
+            }
         } else {
             m->sflags = state->special_flags;
             m->numval = state->nelem;
         }
 
+        if (m->stop_on_match) {
+            jsn->max_callback_level = 1;
+            jsonsl_stop(jsn);
+            return;
+        }
+
         /* Ignore the callback level for this depth: */
         jsn->max_callback_level = state->level;
         return;
@@ -226,7 +324,11 @@ pop_callback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state
                 m->loc_key.at = NULL;
                 m->type = child->type;
                 m->sflags = child->special_flags;
-                m->numval = child->nelem;
+                if (child->type == JSONSL_T_OBJECT) {
+                    m->numval = child->nelem / 2;
+                } else {
+                    m->numval = child->nelem;
+                }
             }
         }
         if (m->matchres == JSONSL_MATCH_COMPLETE) {
@@ -242,6 +344,8 @@ pop_callback(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state
                     /* printf("Next component expected list, but we are object\n"); */
                     m->matchres = JSONSL_MATCH_TYPE_MISMATCH;
                 }
+            } else if (next_comp->ptype == JSONSL_PATH_NUMERIC) {
+                /* Either an index or a key (from a JSON Pointer) */
             } else {
                 if (state->type != JSONSL_T_OBJECT) {
                     /* printf("Next component expected object key, but we are list!\n"); */
@@ -270,7 +374,7 @@ static void initial_callback(jsonsl_t jsn, jsonsl_action_t action,
     parse_ctx *ctx = get_ctx(jsn);
     /* state is the parent */
     state->mres = jsonsl_jpr_match(ctx->jpr, JSONSL_T_UNKNOWN, 0, NULL, 0);
-    jsn->action_callback_PUSH = push_callback;
+    ctx->mode = MATCH_MODE_PATH;
 
     if (state->mres == JSONSL_MATCH_POSSIBLE) {
         update_possible(ctx, state, at);
@@ -278,6 +382,7 @@ static void initial_callback(jsonsl_t jsn, jsonsl_action_t action,
     } else if (state->mres == JSONSL_MATCH_COMPLETE) {
         /* Match the root element. Simple */
         ctx->match->match_level = state->level;
+        ctx->match->type = state->type;
         ctx->match->has_key = 0;
         ctx->match->loc_match.at = at;
         ctx->match->loc_parent.at = at;
@@ -289,28 +394,82 @@ static void initial_callback(jsonsl_t jsn, jsonsl_action_t action,
     (void)action; /* always push */
 }
 
-static int
-exec_match_simple(const char *value, size_t nvalue, jsonsl_jpr_t jpr,
-    jsonsl_t jsn, subdoc_MATCH *result)
-{
-    parse_ctx ctx = { NULL };
+/* Events of a path match. The callbacks are called directly, switching
+ * between them by parse_ctx::mode, so that they can be inlined into the
+ * parser loop */
+struct match_handler : jsonsl_handler_base {
+    static void
+    on_PUSH(jsonsl_t jsn, struct jsonsl_state_st *st, const jsonsl_char_t *at)
+    {
+        switch (get_ctx(jsn)->mode) {
+        case MATCH_MODE_ROOT:
+            initial_callback(jsn, JSONSL_ACTION_PUSH, st, at);
+            break;
+        case MATCH_MODE_PATH:
+            push_callback(jsn, JSONSL_ACTION_PUSH, st, at);
+            break;
+        default:
+            unique_callback(jsn, JSONSL_ACTION_PUSH, st, at);
+            break;
+        }
+    }
+    static void
+    on_POP(jsonsl_t jsn, struct jsonsl_state_st *st, const jsonsl_char_t *at)
+    {
+        if (get_ctx(jsn)->mode == MATCH_MODE_UNIQUE) {
+            unique_callback(jsn, JSONSL_ACTION_POP, st, at);
+        } else {
+            pop_callback(jsn, JSONSL_ACTION_POP, st, at);
+        }
+    }
+    static int
+    on_error(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_state_st *st,
+        jsonsl_char_t *at)
+    {
+        return err_callback(jsn, err, st, at);
+    }
+};
 
-    ctx.match = result;
-    ctx.jpr = (jsonsl_jpr_t)jpr;
+/* Prepare the parser to match `jpr`. The context must stay in place until
+ * parsing is finished */
+static void
+begin_match(jsonsl_t jsn, parse_ctx *ctx, jsonsl_jpr_t jpr, subdoc_MATCH *result)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->match = result;
+    ctx->jpr = jpr;
     result->status = JSONSL_ERROR_SUCCESS;
 
-    jsonsl_enable_all_callbacks(jsn);
-    jsn->action_callback_PUSH = initial_callback;
-    jsn->action_callback_POP = pop_callback;
-    jsn->error_callback = err_callback;
-    jsn->max_callback_level = ctx.jpr->ncomponents + 1;
-    jsn->data = &ctx;
+    jsn->max_callback_level = jpr->ncomponents + 1;
+    jsn->data = ctx;
+}
 
-    jsonsl_feed(jsn, value, nvalue);
+static int
+exec_match_bufs(const subdoc_LOC *bufs, size_t nbufs, jsonsl_jpr_t jpr,
+    jsonsl_t jsn, subdoc_MATCH *result)
+{
+    size_t ii;
+    parse_ctx ctx;
+    match_handler handler;
+
+    begin_match(jsn, &ctx, jpr, result);
+    for (ii = 0; ii < nbufs && !jsn->stopfl; ii++) {
+        jsonsl_feed_handler(jsn, bufs[ii].at, bufs[ii].length, handler);
+    }
+    /* A stop leaves pos at the character being processed */
+    result->bytes_scanned += jsn->stopfl ? jsn->pos + 1 : jsn->pos;
     jsonsl_reset(jsn);
     return 0;
 }
 
+static int
+exec_match_simple(const char *value, size_t nvalue, jsonsl_jpr_t jpr,
+    jsonsl_t jsn, subdoc_MATCH *result)
+{
+    subdoc_LOC loc = { value, nvalue };
+    return exec_match_bufs(&loc, 1, jpr, jsn, result);
+}
+
 static int
 exec_match_negix(const char *value, size_t nvalue, const subdoc_PATH *pth,
     jsonsl_t jsn, subdoc_MATCH *result)
@@ -363,8 +522,10 @@ exec_match_negix(const char *value, size_t nvalue, const subdoc_PATH *pth,
         tmp_jpr.components[0].ptype = JSONSL_PATH_ROOT;
 
         /* Clear the match. There's no good way to preserve info here,
-         * unfortunately. */
+         * unfortunately, other than the running count of bytes read. */
+        size_t nscanned = result->bytes_scanned;
         memset(result, 0, sizeof *result);
+        result->bytes_scanned = nscanned;
 
         /* Always set this */
         result->get_last_child_pos = 1;
@@ -439,6 +600,10 @@ int
 subdoc_match_exec(const char *value, size_t nvalue,
     const subdoc_PATH *pth, jsonsl_t jsn, subdoc_MATCH *result)
 {
+    if (nvalue > SUBDOC_DOC_MAX) {
+        result->status = SUBDOC_VALIDATE_E2BIG;
+        return 0;
+    }
     if (!pth->has_negix) {
         return exec_match_simple(value, nvalue,
             (const jsonsl_jpr_t)&pth->jpr_base, jsn, result);
@@ -447,12 +612,538 @@ subdoc_match_exec(const char *value, size_t nvalue,
     }
 }
 
+int
+subdoc_match_exec_bufs(const subdoc_LOC *bufs, size_t nbufs,
+    const subdoc_PATH *pth, jsonsl_t jsn, subdoc_MATCH *result)
+{
+    size_t ii, total = 0;
+
+    if (pth->has_negix) {
+        return -1;
+    }
+    for (ii = 0; ii < nbufs; ii++) {
+        if (bufs[ii].length > SUBDOC_DOC_MAX - total) {
+            result->status = SUBDOC_VALIDATE_E2BIG;
+            return 0;
+        }
+        total += bufs[ii].length;
+    }
+    return exec_match_bufs(bufs, nbufs,
+        (const jsonsl_jpr_t)&pth->jpr_base, jsn, result);
+}
+
+struct subdoc_STREAM_st {
+    jsonsl_t jsn;
+    parse_ctx ctx;
+    /* Everything fed so far. Locations in the match point in here */
+    char *buf;
+    size_t nbuf;
+    size_t nalloc;
+    int done;
+};
+
+subdoc_STREAM *
+subdoc_stream_alloc(void)
+{
+    subdoc_STREAM *s = (subdoc_STREAM *)calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->jsn = subdoc_jsn_alloc();
+    if (s->jsn == NULL) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void
+subdoc_stream_free(subdoc_STREAM *s)
+{
+    subdoc_jsn_free(s->jsn);
+    free(s->buf);
+    free(s);
+}
+
+int
+subdoc_stream_begin(subdoc_STREAM *s, const subdoc_PATH *pth, subdoc_MATCH *result)
+{
+    if (pth->has_negix) {
+        return -1;
+    }
+    jsonsl_reset(s->jsn);
+    s->nbuf = 0;
+    s->done = 0;
+    begin_match(s->jsn, &s->ctx, (jsonsl_jpr_t)&pth->jpr_base, result);
+    return 0;
+}
+
+/* Point `*p` at the same offset within `newbuf` as it had within the old
+ * buffer, if it pointed in there at all */
+static void
+rebase_ptr(const char **p, const subdoc_STREAM *s, char *newbuf)
+{
+    if (*p != NULL && *p >= s->buf && *p <= s->buf + s->nbuf) {
+        *p = newbuf + (*p - s->buf);
+    }
+}
+
+static int
+stream_reserve(subdoc_STREAM *s, size_t n)
+{
+    size_t nalloc = s->nalloc ? s->nalloc : 4096;
+    subdoc_MATCH *m = s->ctx.match;
+    char *buf;
+
+    if (s->nalloc - s->nbuf >= n) {
+        return 0;
+    }
+    while (nalloc - s->nbuf < n) {
+        if (nalloc * 2 < nalloc) {
+            return -1;
+        }
+        nalloc *= 2;
+    }
+    /* Not realloc(), as anything the parser has already located must be
+     * moved along with the data */
+    buf = (char *)malloc(nalloc);
+    if (buf == NULL) {
+        return -1;
+    }
+    if (s->nbuf) {
+        memcpy(buf, s->buf, s->nbuf);
+        rebase_ptr(&m->loc_match.at, s, buf);
+        rebase_ptr(&m->loc_key.at, s, buf);
+        rebase_ptr(&m->loc_parent.at, s, buf);
+        rebase_ptr(&m->loc_next_key.at, s, buf);
+        rebase_ptr(&s->ctx.curhk, s, buf);
+    }
+    free(s->buf);
+    s->buf = buf;
+    s->nalloc = nalloc;
+    return 0;
+}
+
+int
+subdoc_stream_feed(subdoc_STREAM *s, const char *data, size_t ndata)
+{
+    if (ndata == 0) {
+        /* End of input; whatever we have now is all there will be */
+        s->done = 1;
+        return 1;
+    }
+    if (ndata > SUBDOC_DOC_MAX - s->nbuf || stream_reserve(s, ndata) != 0) {
+        return -1;
+    }
+    memcpy(s->buf + s->nbuf, data, ndata);
+    s->nbuf += ndata;
+
+    if (!s->done) {
+        match_handler handler;
+        jsonsl_feed_handler(s->jsn, s->buf + s->nbuf - ndata, ndata, handler);
+        if (s->jsn->stopfl || s->ctx.match->status != JSONSL_ERROR_SUCCESS) {
+            s->done = 1;
+        }
+    }
+    return s->done;
+}
+
+subdoc_LOC
+subdoc_stream_doc(const subdoc_STREAM *s)
+{
+    subdoc_LOC loc = { s->buf, s->nbuf };
+    return loc;
+}
+
+/* Context for subdoc_match_exec_multi() */
+typedef struct {
+    const subdoc_PATH * const *paths;
+    subdoc_MATCH *results;
+    size_t npaths;
+    size_t nresolved;
+    const char *curhk;
+    size_t hklen;
+    /* Indexed by level. Paths which may match beneath the state at that
+     * level, and paths which the state itself completes */
+    uint64_t possible[COMPONENTS_ALLOC + 1];
+    uint64_t complete[COMPONENTS_ALLOC + 1];
+} multi_ctx;
+
+static int
+multi_err_callback(jsonsl_t jsn, jsonsl_error_t err,
+    struct jsonsl_state_st *state, jsonsl_char_t *at)
+{
+    multi_ctx *ctx = (multi_ctx *)jsn->data;
+    size_t ii;
+    for (ii = 0; ii < ctx->npaths; ii++) {
+        ctx->results[ii].status = err;
+    }
+    (void)state; (void)at;
+    return 0;
+}
+
+static void
+multi_push_callback(jsonsl_t jsn, jsonsl_action_t action,
+    struct jsonsl_state_st *st, const jsonsl_char_t *at)
+{
+    multi_ctx *ctx = (multi_ctx *)jsn->data;
+    uint64_t pmask, possible = 0, complete = 0;
+    size_t ii;
+
+    if (st->type == JSONSL_T_HKEY) {
+        ctx->curhk = at+1;
+        return;
+    }
+
+    if (st->level == 1) {
+        /* Root. Everything is possible */
+        for (ii = 0; ii < ctx->npaths; ii++) {
+            update_possible_m(&ctx->results[ii], st, at);
+            ctx->results[ii].matchres = JSONSL_MATCH_POSSIBLE;
+        }
+        possible = ctx->npaths == 64 ? ~(uint64_t)0 : ((uint64_t)1 << ctx->npaths) - 1;
+
+    } else {
+        const struct jsonsl_state_st *parent = jsonsl_last_state(jsn, st);
+        size_t nkey = (parent->type == JSONSL_T_OBJECT) ? ctx->hklen : parent->nelem - 1;
+
+        for (pmask = ctx->possible[parent->level]; pmask; pmask &= pmask - 1) {
+            subdoc_MATCH *m;
+            jsonsl_jpr_t jpr;
+            int mres;
+
+            ii = subdoc_ctz64(pmask);
+            m = &ctx->results[ii];
+            jpr = (jsonsl_jpr_t)&ctx->paths[ii]->jpr_base;
+            mres = jsonsl_jpr_match(jpr, parent->type, parent->level, ctx->curhk, nkey);
+
+            if (mres == JSONSL_MATCH_COMPLETE) {
+                complete |= (uint64_t)1 << ii;
+                m->matchres = JSONSL_MATCH_COMPLETE;
+                m->loc_match.at = at;
+                m->match_level = st->level;
+                m->type = st->type;
+                if (parent->type == JSONSL_T_OBJECT) {
+                    m->has_key = 1;
+                    m->loc_key.at = ctx->curhk-1;
+                    m->loc_key.length = ctx->hklen+2;
+                }
+            } else if (mres == JSONSL_MATCH_POSSIBLE) {
+                if (JSONSL_STATE_IS_CONTAINER(st)) {
+                    possible |= (uint64_t)1 << ii;
+                    update_possible_m(m, st, at);
+                } else {
+                    m->matchres = JSONSL_MATCH_TYPE_MISMATCH;
+                }
+            } else if (mres == JSONSL_MATCH_TYPE_MISMATCH) {
+                m->matchres = JSONSL_MATCH_TYPE_MISMATCH;
+            }
+        }
+    }
+
+    ctx->possible[st->level] = possible;
+    ctx->complete[st->level] = complete;
+    if (!possible && !complete) {
+        st->ignore_callback = 1;
+    }
+    (void)action;
+}
+
+static void
+multi_pop_callback(jsonsl_t jsn, jsonsl_action_t action,
+    struct jsonsl_state_st *st, const jsonsl_char_t *at)
+{
+    multi_ctx *ctx = (multi_ctx *)jsn->data;
+    uint64_t mask;
+    size_t ii;
+
+    if (st->type == JSONSL_T_HKEY) {
+        ctx->hklen = jsn->pos - (st->pos_begin + 1);
+        return;
+    }
+
+    for (mask = ctx->complete[st->level]; mask; mask &= mask - 1) {
+        subdoc_MATCH *m = &ctx->results[subdoc_ctz64(mask)];
+        m->loc_match.length = jsn->pos - st->pos_begin;
+        if (st->type == JSONSL_T_SPECIAL) {
+            m->sflags = st->special_flags;
+            m->numval = st->nelem;
+        } else {
+            m->loc_match.length++;
+            m->numval = st->type == JSONSL_T_OBJECT ? st->nelem / 2 : st->nelem;
+        }
+        ctx->nresolved++;
+    }
+
+    for (mask = ctx->possible[st->level]; mask; mask &= mask - 1) {
+        const struct jsonsl_jpr_st *jpr;
+        subdoc_MATCH *m;
+
+        ii = subdoc_ctz64(mask);
+        m = &ctx->results[ii];
+        if (m->matchres == JSONSL_MATCH_COMPLETE || m->loc_parent.length) {
+            continue;
+        }
+
+        /* Deepest parent of a path which was not found */
+        jpr = &ctx->paths[ii]->jpr_base;
+        m->loc_parent.length = jsn->pos - st->pos_begin + 1;
+        m->type = st->type;
+        m->num_siblings = st->type == JSONSL_T_OBJECT ? st->nelem / 2 : st->nelem;
+        if (m->matchres == JSONSL_MATCH_POSSIBLE) {
+            if (jpr->components[st->level].is_arridx) {
+                if (st->type != JSONSL_T_LIST) {
+                    m->matchres = JSONSL_MATCH_TYPE_MISMATCH;
+                }
+            } else if (jpr->components[st->level].ptype != JSONSL_PATH_NUMERIC &&
+                    st->type != JSONSL_T_OBJECT) {
+                m->matchres = JSONSL_MATCH_TYPE_MISMATCH;
+            }
+        }
+        if (st->level == jpr->ncomponents-1) {
+            m->immediate_parent_found = 1;
+        }
+        ctx->nresolved++;
+    }
+
+    if (ctx->nresolved == ctx->npaths) {
+        jsonsl_stop(jsn);
+    }
+    (void)action; (void)at;
+}
+
+struct multi_handler : jsonsl_handler_base {
+    static void
+    on_PUSH(jsonsl_t jsn, struct jsonsl_state_st *st, const jsonsl_char_t *at)
+    {
+        multi_push_callback(jsn, JSONSL_ACTION_PUSH, st, at);
+    }
+    static void
+    on_POP(jsonsl_t jsn, struct jsonsl_state_st *st, const jsonsl_char_t *at)
+    {
+        multi_pop_callback(jsn, JSONSL_ACTION_POP, st, at);
+    }
+    static int
+    on_error(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_state_st *st,
+        jsonsl_char_t *at)
+    {
+        return multi_err_callback(jsn, err, st, at);
+    }
+};
+
+int
+subdoc_match_exec_multi(const char *value, size_t nvalue,
+    const subdoc_PATH * const *paths, size_t npaths, jsonsl_t jsn,
+    subdoc_MATCH *results)
+{
+    multi_ctx ctx;
+    multi_handler handler;
+    size_t ii, maxlevel = 0;
+
+    if (npaths == 0 || npaths > SUBDOC_MULTI_MAX) {
+        return -1;
+    }
+    for (ii = 0; ii < npaths; ii++) {
+        if (paths[ii]->has_negix || paths[ii]->has_wildcard ||
+                paths[ii]->jpr_base.ncomponents < 2) {
+            return -1;
+        }
+        if (paths[ii]->jpr_base.ncomponents > maxlevel) {
+            maxlevel = paths[ii]->jpr_base.ncomponents;
+        }
+        results[ii].status = JSONSL_ERROR_SUCCESS;
+        if (nvalue > SUBDOC_DOC_MAX) {
+            results[ii].status = SUBDOC_VALIDATE_E2BIG;
+        }
+    }
+    if (nvalue > SUBDOC_DOC_MAX) {
+        return 0;
+    }
+
+    memset(&ctx, 0, sizeof ctx);
+    ctx.paths = paths;
+    ctx.results = results;
+    ctx.npaths = npaths;
+
+    jsn->max_callback_level = maxlevel + 1;
+    jsn->data = &ctx;
+
+    jsonsl_feed_handler(jsn, value, nvalue, handler);
+    jsonsl_reset(jsn);
+    return 0;
+}
+
+/* Context for subdoc_match_exec_all() */
+typedef struct {
+    jsonsl_jpr_t jpr;
+    const char *value;
+    subdoc_MATCH_CALLBACK callback;
+    void *cookie;
+    jsonsl_error_t status;
+    const char *curhk;
+    size_t hklen;
+} all_ctx;
+
+static int
+all_err_callback(jsonsl_t jsn, jsonsl_error_t err,
+    struct jsonsl_state_st *state, jsonsl_char_t *at)
+{
+    ((all_ctx *)jsn->data)->status = err;
+    (void)state; (void)at;
+    return 0;
+}
+
+static void
+all_push_callback(jsonsl_t jsn, jsonsl_action_t action,
+    struct jsonsl_state_st *st, const jsonsl_char_t *at)
+{
+    all_ctx *ctx = (all_ctx *)jsn->data;
+    const struct jsonsl_state_st *parent;
+
+    if (st->type == JSONSL_T_HKEY) {
+        ctx->curhk = at+1;
+        return;
+    }
+
+    if (st->level == 1) {
+        st->mres = jsonsl_jpr_match(ctx->jpr, JSONSL_T_UNKNOWN, 0, NULL, 0);
+        return;
+    }
+
+    parent = jsonsl_last_state(jsn, st);
+    if (parent->mres != M_POSSIBLE) {
+        /* Beneath a complete match */
+        st->mres = M_NOMATCH;
+    } else {
+        size_t nkey = (parent->type == JSONSL_T_OBJECT) ? ctx->hklen : parent->nelem - 1;
+        st->mres = jsonsl_jpr_match(ctx->jpr, parent->type, parent->level, ctx->curhk, nkey);
+    }
+    if (st->mres == M_POSSIBLE && IS_CONTAINER(st) == 0) {
+        st->mres = M_NOMATCH;
+    }
+    if (st->mres != M_POSSIBLE && st->mres != M_COMPLETE) {
+        st->ignore_callback = 1;
+    }
+    (void)action;
+}
+
+static void
+all_pop_callback(jsonsl_t jsn, jsonsl_action_t action,
+    struct jsonsl_state_st *st, const jsonsl_char_t *at)
+{
+    all_ctx *ctx = (all_ctx *)jsn->data;
+    subdoc_MATCH m;
+
+    if (st->type == JSONSL_T_HKEY) {
+        ctx->hklen = jsn->pos - (st->pos_begin + 1);
+        return;
+    }
+    if (st->mres != M_COMPLETE) {
+        return;
+    }
+
+    memset(&m, 0, sizeof m);
+    m.matchres = JSONSL_MATCH_COMPLETE;
+    m.type = st->type;
+    m.match_level = st->level;
+    m.loc_match.at = ctx->value + st->pos_begin;
+    m.loc_match.length = jsn->pos - st->pos_begin;
+    if (st->type == JSONSL_T_SPECIAL) {
+        m.sflags = st->special_flags;
+        m.numval = st->nelem;
+    } else {
+        m.loc_match.length++;
+        m.numval = st->type == JSONSL_T_OBJECT ? st->nelem / 2 : st->nelem;
+    }
+
+    if (st->level > 1) {
+        /* Nothing has been pushed to the parent since this match began, so
+         * its count and the last key still describe the match */
+        const struct jsonsl_state_st *parent = jsonsl_last_state(jsn, st);
+        if (parent->type == JSONSL_T_OBJECT) {
+            m.has_key = 1;
+            m.loc_key.at = ctx->curhk-1;
+            m.loc_key.length = ctx->hklen+2;
+            m.position = (parent->nelem - 1) / 2;
+        } else {
+            m.position = parent->nelem - 1;
+        }
+    }
+
+    if (ctx->callback(&m, ctx->cookie) != 0) {
+        jsonsl_stop(jsn);
+    }
+    (void)action; (void)at;
+}
+
+struct all_handler : jsonsl_handler_base {
+    static void
+    on_PUSH(jsonsl_t jsn, struct jsonsl_state_st *st, const jsonsl_char_t *at)
+    {
+        all_push_callback(jsn, JSONSL_ACTION_PUSH, st, at);
+    }
+    static void
+    on_POP(jsonsl_t jsn, struct jsonsl_state_st *st, const jsonsl_char_t *at)
+    {
+        all_pop_callback(jsn, JSONSL_ACTION_POP, st, at);
+    }
+    static int
+    on_error(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_state_st *st,
+        jsonsl_char_t *at)
+    {
+        return all_err_callback(jsn, err, st, at);
+    }
+};
+
+jsonsl_error_t
+subdoc_match_exec_all(const char *value, size_t nvalue,
+    const subdoc_PATH *pth, jsonsl_t jsn,
+    subdoc_MATCH_CALLBACK callback, void *cookie)
+{
+    all_ctx ctx;
+    all_handler handler;
+
+    if (pth->has_negix) {
+        return JSONSL_ERROR_JPR_BADPATH;
+    }
+    if (nvalue > SUBDOC_DOC_MAX) {
+        return (jsonsl_error_t)SUBDOC_VALIDATE_E2BIG;
+    }
+
+    memset(&ctx, 0, sizeof ctx);
+    ctx.jpr = (jsonsl_jpr_t)&pth->jpr_base;
+    ctx.value = value;
+    ctx.callback = callback;
+    ctx.cookie = cookie;
+
+    /* Nothing beneath a complete match is of interest */
+    jsn->max_callback_level = ctx.jpr->ncomponents + 1;
+    jsn->data = &ctx;
+
+    jsonsl_feed_handler(jsn, value, nvalue, handler);
+    jsonsl_reset(jsn);
+    return ctx.status;
+}
+
 jsonsl_t
 subdoc_jsn_alloc(void)
 {
     return jsonsl_new(COMPONENTS_ALLOC);
 }
 
+jsonsl_t
+subdoc_jsn_init(void *storage)
+{
+    jsonsl_t jsn = (jsonsl_t)storage;
+
+    /* As jsonsl_new() */
+    memset(jsn, 0, SUBDOC_JSN_SIZE);
+    jsn->levels_max = COMPONENTS_ALLOC;
+    jsn->max_callback_level = -1;
+    jsonsl_reset(jsn);
+    return jsn;
+}
+
 void
 subdoc_jsn_free(jsonsl_t jsn)
 {
@@ -512,6 +1203,28 @@ validate_callback(jsonsl_t jsn, jsonsl_action_t action,
     (void)state;(void)at;
 }
 
+/* Hash keys are not needed to validate */
+struct validate_handler : jsonsl_handler_base {
+    static int call_HKEY(jsonsl_t) { return 0; }
+
+    static void
+    on_PUSH(jsonsl_t jsn, struct jsonsl_state_st *st, const jsonsl_char_t *at)
+    {
+        validate_callback(jsn, JSONSL_ACTION_PUSH, st, at);
+    }
+    static void
+    on_POP(jsonsl_t jsn, struct jsonsl_state_st *st, const jsonsl_char_t *at)
+    {
+        validate_callback(jsn, JSONSL_ACTION_POP, st, at);
+    }
+    static int
+    on_error(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_state_st *st,
+        jsonsl_char_t *at)
+    {
+        return validate_err_callback(jsn, err, st, at);
+    }
+};
+
 static const subdoc_LOC validate_ARRAY_PRE = { "[", 1 };
 static const subdoc_LOC validate_ARRAY_POST = { "]", 1 };
 static const subdoc_LOC validate_DICT_PRE = { "{\"k\":", 5 };
@@ -525,19 +1238,17 @@ subdoc_validate(const char *s, size_t n, jsonsl_t jsn, int mode)
     int type = mode & SUBDOC_VALIDATE_MODEMASK;
     int flags = mode & SUBDOC_VALIDATE_FLAGMASK;
     const subdoc_LOC *l_pre, *l_post;
+    validate_handler handler;
 
     validate_ctx ctx = { 0,0 };
+    if (n > SUBDOC_DOC_MAX) {
+        return (jsonsl_error_t)SUBDOC_VALIDATE_E2BIG;
+    }
     if (jsn == NULL) {
         jsn = jsonsl_new(COMPONENTS_ALLOC);
         need_free_jsn = 1;
     }
 
-    jsn->action_callback_POP = NULL;
-    jsn->action_callback_PUSH = NULL;
-
-    jsn->action_callback = validate_callback;
-    jsn->error_callback = validate_err_callback;
-
     if (flags) {
         ctx.flags = flags;
         jsn->max_callback_level = 3;
@@ -545,12 +1256,6 @@ subdoc_validate(const char *s, size_t n, jsonsl_t jsn, int mode)
         jsn->max_callback_level = 2;
     }
 
-    jsn->call_OBJECT = 1;
-    jsn->call_LIST = 1;
-    jsn->call_STRING = 1;
-    jsn->call_SPECIAL = 1;
-    jsn->call_HKEY = 0;
-    jsn->call_UESCAPE = 0;
     jsn->data = &ctx;
 
     if (type == SUBDOC_VALIDATE_PARENT_NONE) {
@@ -566,9 +1271,9 @@ subdoc_validate(const char *s, size_t n, jsonsl_t jsn, int mode)
         goto GT_ERR;
     }
 
-    jsonsl_feed(jsn, l_pre->at, l_pre->length);
-    jsonsl_feed(jsn, s, n);
-    jsonsl_feed(jsn, l_post->at, l_post->length);
+    jsonsl_feed_handler(jsn, l_pre->at, l_pre->length, handler);
+    jsonsl_feed_handler(jsn, s, n, handler);
+    jsonsl_feed_handler(jsn, l_post->at, l_post->length, handler);
 
     if (ctx.err == JSONSL_ERROR_SUCCESS) {
         if (ctx.rootcount < 2) {
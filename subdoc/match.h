@@ -2,11 +2,24 @@
 #define SUBDOC_MATCH_H
 
 #include "path.h"
+#include "unique.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Largest document (or value) which can be parsed. With the compact parser
+ * state (see jsonsl_header.h) positions are 32 bits, less a little room for
+ * the bytes some functions feed ahead of the document. Longer input is
+ * rejected with SUBDOC_VALIDATE_E2BIG (or SUBDOC_STATUS_DOC_E2BIG)
+ */
+#if defined(JSONSL_STATE_COMPACT) && !defined(JSONSL_STATE_POS64)
+#define SUBDOC_DOC_MAX ((size_t)JSONSL_STATE_POS_MAX - 16)
+#else
+#define SUBDOC_DOC_MAX ((size_t)-1)
+#endif
+
 /** Structure describing a position and length of a buffer (e.g. IOV) */
 typedef struct {
     const char *at;
@@ -35,7 +48,8 @@ typedef struct {
      */
     uint16_t match_level;
 
-    /* Value of 'nelem' */
+    /* Value of 'nelem'. For a matched array or dictionary, this is the number
+     * of elements or keys respectively */
     uint64_t numval;
 
     /**
@@ -83,6 +97,28 @@ typedef struct {
      * already exists */
     unsigned char unique_item_found;
 
+    /**Request flag; used with #ensure_unique. Elements are compared by length
+     * and hash before their contents, and array or dictionary elements are
+     * compared byte-for-byte rather than causing a type mismatch */
+    unsigned char unique_hashed;
+
+    /**Used with #unique_hashed. If set, the hash of every element of the
+     * array is added to this index, and the scan does not stop at the first
+     * duplicate */
+    subdoc_UNIQUE_INDEX *unique_index;
+
+    /**Request flag; stop parsing as soon as the match is complete, rather
+     * than at the end of its parent. The rest of the document is neither read
+     * nor validated, and #loc_parent and #num_siblings are not set. Used by
+     * read-only commands */
+    unsigned char stop_on_match;
+
+    /**Request flag; the keys of every dictionary in the document are sorted
+     * (see subdoc_canonicalize()). A missing key is then known to be absent
+     * as soon as a greater key is seen; its location is returned in
+     * #loc_next_key, and with #stop_on_match parsing stops there */
+    unsigned char keys_sorted;
+
     /** Location describing the matched item, if the match is found */
     subdoc_LOC loc_match;
 
@@ -93,6 +129,20 @@ typedef struct {
      * is true then this is the direct parent of the match.*/
     subdoc_LOC loc_parent;
 
+    /**Used with #keys_sorted. If the final key of the path (or the first
+     * missing one) is absent from its dictionary, this is the key which sorts
+     * immediately after it, i.e. where it would be inserted. `at` is NULL if
+     * the key would sort last */
+    subdoc_LOC loc_next_key;
+
+    /**Number of bytes read to produce this result, by the parser or by the
+     * cheaper scans standing in for it (path hints, the unique index). Less
+     * than the document's length if parsing stopped early (see
+     * #stop_on_match), and may be more if parts of it were read again
+     * (negative array indices). Each match adds to this, so that it covers
+     * every scan made for an operation; zero it first */
+    size_t bytes_scanned;
+
     /**If set to true, will also descend each child element to ensure that
      * the contents here are unique. Will set an error code accordingly, if
      * types are mismatched. */
@@ -104,9 +154,116 @@ int
 subdoc_match_exec(const char *value, size_t nvalue,
     const subdoc_PATH *nj, jsonsl_t jsn, subdoc_MATCH *result);
 
+/**
+ * Like subdoc_match_exec(), but the document is the concatenation of
+ * `nbufs` buffers, which are fed to the parser in turn. Locations in the
+ * result point into whichever buffer contains them. Paths with negative
+ * indices are not supported (-1 is returned).
+ */
+int
+subdoc_match_exec_bufs(const subdoc_LOC *bufs, size_t nbufs,
+    const subdoc_PATH *pth, jsonsl_t jsn, subdoc_MATCH *result);
+
+/**
+ * Resumable match over a document which arrives in pieces (e.g. from a
+ * socket). Chunks are pushed as they arrive, and the result is available as
+ * soon as the parser has seen enough of the document to determine it; with
+ * subdoc_MATCH::stop_on_match set, that is as soon as the matched value ends.
+ *
+ * The stream keeps a copy of everything fed to it, so the locations in the
+ * match remain valid (even if they span chunks) until the next
+ * subdoc_stream_begin() or subdoc_stream_free(). The retained document is
+ * available via subdoc_stream_doc().
+ */
+typedef struct subdoc_STREAM_st subdoc_STREAM;
+
+subdoc_STREAM *
+subdoc_stream_alloc(void);
+
+void
+subdoc_stream_free(subdoc_STREAM *s);
+
+/**
+ * Start matching `pth` against a new document, discarding the previous one.
+ * `result` should be zeroed apart from any request flags, and it and `pth`
+ * must remain valid while the document is fed. Returns -1 if the path has
+ * negative indices, as these require the whole document.
+ */
+int
+subdoc_stream_begin(subdoc_STREAM *s, const subdoc_PATH *pth, subdoc_MATCH *result);
+
+/**
+ * Append the next chunk of the document. A zero-length chunk marks the end of
+ * the input.
+ *
+ * @return 1 if the result is final (further chunks are retained but not
+ * parsed), 0 if more data is needed, or -1 on allocation failure or if the
+ * document would exceed SUBDOC_DOC_MAX
+ */
+int
+subdoc_stream_feed(subdoc_STREAM *s, const char *data, size_t ndata);
+
+/** The document as fed so far */
+subdoc_LOC
+subdoc_stream_doc(const subdoc_STREAM *s);
+
+/**
+ * Called by subdoc_match_exec_all() for each match. The match (but not the
+ * locations it points to) is only valid for the duration of the call. Return
+ * nonzero to stop scanning.
+ */
+typedef int (*subdoc_MATCH_CALLBACK)(const subdoc_MATCH *match, void *cookie);
+
+/**
+ * Finds every match of a path in a single pass, passing each to `callback` in
+ * document order. This is intended for wildcard paths (e.g. `items[*].price`),
+ * but any path without a negative index may be used.
+ *
+ * Each match has `loc_match`, `type`, `sflags`, `numval`, `match_level` and
+ * `position` set, and `loc_key` if its parent is a dictionary. No parent
+ * information is provided.
+ *
+ * @return JSONSL_ERROR_SUCCESS, or the error encountered while parsing. Matches
+ * found before an error have already been delivered.
+ */
+jsonsl_error_t
+subdoc_match_exec_all(const char *value, size_t nvalue,
+    const subdoc_PATH *pth, jsonsl_t jsn,
+    subdoc_MATCH_CALLBACK callback, void *cookie);
+
+/** Maximum number of paths for subdoc_match_exec_multi() */
+#define SUBDOC_MULTI_MAX 64
+
+/**
+ * Matches several paths in a single pass over the document. `results` must
+ * point to `npaths` zeroed matches, each of which is populated as
+ * subdoc_match_exec() would for the corresponding path (except that
+ * `position` is not set). Subtrees which cannot contain any of the paths
+ * are skipped, and parsing stops once every path has been resolved.
+ *
+ * At most SUBDOC_MULTI_MAX paths may be given. The root path and paths with
+ * negative indices or wildcards are not supported; -1 is returned for these.
+ */
+int
+subdoc_match_exec_multi(const char *value, size_t nvalue,
+    const subdoc_PATH * const *paths, size_t npaths, jsonsl_t jsn,
+    subdoc_MATCH *results);
+
 jsonsl_t
 subdoc_jsn_alloc(void);
 
+/** Storage needed by subdoc_jsn_init(): a parser with its stack */
+#define SUBDOC_JSN_SIZE (sizeof(struct jsonsl_st) + \
+    (COMPONENTS_ALLOC - 1) * sizeof(struct jsonsl_state_st))
+
+/**
+ * Like subdoc_jsn_alloc(), but in caller-provided storage of
+ * SUBDOC_JSN_SIZE bytes, aligned as a struct jsonsl_st. The parser must not
+ * be passed to subdoc_jsn_free()
+ */
+jsonsl_t
+subdoc_jsn_init(void *storage);
+
 void
 subdoc_jsn_free(jsonsl_t);
 
@@ -136,7 +293,11 @@ typedef enum {
      * PARENT_NONE is specified, and multiple items are found! */
     SUBDOC_VALIDATE_EMULTIELEM,
     /* No parse error, but a full JSON value could not be parsed */
-    SUBDOC_VALIDATE_EPARTIAL
+    SUBDOC_VALIDATE_EPARTIAL,
+    /* The value is longer than SUBDOC_DOC_MAX. The match functions report
+     * this in subdoc_MATCH::status, and subdoc_match_exec_all() and
+     * subdoc_canonicalize() return it */
+    SUBDOC_VALIDATE_E2BIG
 } subdoc_VALIDSTATUS;
 
 /**
@@ -2,21 +2,98 @@
 #define INCLUDE_SUBDOC_NTOHLL
 
 #include "operations.h"
+#include "pscan.h"
+#include "canonical.h"
+#include "compact.h"
+#include "probes.h"
 #include <limits.h>
+#include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <charconv>
+#include <cmath>
 
 static subdoc_LOC loc_COMMA = { ",", 1 };
 static subdoc_LOC loc_QUOTE = { "\"", 1 };
 static subdoc_LOC loc_COMMA_QUOTE = { ",\"", 2 };
 static subdoc_LOC loc_QUOTE_COLON = { "\":", 2 };
 
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Formats an integer into `buf` (which must have room for 20 characters),
+ * two digits at a time, and returns the length */
+static size_t
+format_i64(char *buf, int64_t num)
+{
+    char tmp[20];
+    char *p = tmp + sizeof tmp;
+    size_t len;
+    uint64_t v = num < 0 ? 0 - (uint64_t)num : (uint64_t)num;
+
+    while (v >= 100) {
+        unsigned ix = (unsigned)(v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        memcpy(p, digit_pairs + ix, 2);
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + v * 2, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+    if (num < 0) {
+        *--p = '-';
+    }
+    len = (tmp + sizeof tmp) - p;
+    memcpy(buf, p, len);
+    return len;
+}
+
+/* Phase timing; free unless op->timings is set */
+static inline uint64_t
+phase_begin(const subdoc_OPERATION *op)
+{
+    return op->timings ? subdoc_cycles() : 0;
+}
+
+static inline void
+phase_end(subdoc_OPERATION *op, subdoc_PHASE phase, uint64_t t0)
+{
+    subdoc_PHASE_TIMES *t;
+    uint64_t t1;
+
+    if (op->timings == NULL) {
+        return;
+    }
+    t1 = subdoc_cycles();
+    t = &op->timings->last;
+    if (t->phase_begin[phase] == 0) {
+        t->phase_begin[phase] = t0;
+    }
+    t->phase_end[phase] = t1;
+    t->cycles[phase] += t1 - t0;
+}
+
 static subdoc_ERRORS
-do_match_common(subdoc_OPERATION *op)
+match_status(const subdoc_OPERATION *op)
 {
-    subdoc_match_exec(op->doc_cur.at, op->doc_cur.length, op->path, op->jsn, &op->match);
+    SUBDOC_PROBE5(match__done, op->optype, op->match.matchres,
+        op->match.match_level, op->doc_cur.length, op->match.bytes_scanned);
     if (op->match.matchres == JSONSL_MATCH_TYPE_MISMATCH) {
         return SUBDOC_STATUS_PATH_MISMATCH;
+    } else if (op->match.status == SUBDOC_VALIDATE_E2BIG) {
+        return SUBDOC_STATUS_DOC_E2BIG;
     } else if (op->match.status != JSONSL_ERROR_SUCCESS) {
         return SUBDOC_STATUS_DOC_NOTJSON;
     } else {
@@ -24,6 +101,41 @@ do_match_common(subdoc_OPERATION *op)
     }
 }
 
+static subdoc_ERRORS
+do_match_common(subdoc_OPERATION *op)
+{
+    uint64_t t0 = phase_begin(op);
+
+    op->match.keys_sorted = op->doc_sorted;
+    subdoc_match_exec(op->doc_cur.at, op->doc_cur.length, op->path, op->jsn, &op->match);
+    phase_end(op, SUBDOC_PHASE_MATCH, t0);
+    return match_status(op);
+}
+
+/* Like do_match_common(), but may scan the document in parallel. Only for
+ * use by read-only commands */
+static subdoc_ERRORS
+do_match_readonly(subdoc_OPERATION *op)
+{
+    uint64_t t0;
+
+    /* Nothing past the match is needed; don't read (or page in) the rest */
+    op->match.stop_on_match = 1;
+    if (op->path_hint == NULL && op->scan_threads < 2) {
+        return do_match_common(op);
+    }
+    t0 = phase_begin(op);
+    if (op->path_hint) {
+        subdoc_match_exec_hinted(op->doc_cur.at, op->doc_cur.length, op->path,
+            op->jsn, &op->match, op->path_hint);
+    } else {
+        subdoc_match_exec_parallel(op->doc_cur.at, op->doc_cur.length,
+            op->path, op->jsn, &op->match, op->scan_threads);
+    }
+    phase_end(op, SUBDOC_PHASE_MATCH, t0);
+    return match_status(op);
+}
+
 static subdoc_ERRORS
 do_get(subdoc_OPERATION *op)
 {
@@ -33,6 +145,25 @@ do_get(subdoc_OPERATION *op)
     return SUBDOC_STATUS_SUCCESS;
 }
 
+static subdoc_ERRORS
+do_get_count(subdoc_OPERATION *op)
+{
+    size_t len;
+    subdoc_MATCH *m = &op->match;
+
+    if (m->matchres != JSONSL_MATCH_COMPLETE) {
+        return SUBDOC_STATUS_PATH_ENOENT;
+    }
+    if (m->type != JSONSL_T_LIST && m->type != JSONSL_T_OBJECT) {
+        return SUBDOC_STATUS_PATH_MISMATCH;
+    }
+
+    len = format_i64(op->numbufs, (int64_t)m->numval);
+    m->loc_match.at = op->numbufs;
+    m->loc_match.length = len;
+    return SUBDOC_STATUS_SUCCESS;
+}
+
 /* Define how the 'until' parameter is treated. INCLUSIVE will make the result
  * overlap with 'until' (on a single byte)
  * whereas EXCLUSIVE will make sure they don't
@@ -112,6 +243,14 @@ strip_comma(subdoc_LOC *loc, int mode)
     }
 }
 
+static void
+strip_trailing_ws(subdoc_LOC *loc)
+{
+    while (loc->length && isspace((unsigned char)loc->at[loc->length-1])) {
+        loc->length--;
+    }
+}
+
 #define MKDIR_P_ARRAY 0
 #define MKDIR_P_DICT 1
 static subdoc_ERRORS do_mkdir_p(subdoc_OPERATION *op, int mode);
@@ -204,6 +343,23 @@ do_store_dict(subdoc_OPERATION *op)
         mk_begin_at_end(&op->doc_cur, &m->loc_match, &op->doc_new[2], LOC_EXCL);
         op->doc_new_len = 3;
 
+    } else if (m->type == JSONSL_T_LIST) {
+        /* The deepest existing parent is an array, and the missing component
+         * is an index (or a JSON Pointer segment) which is out of range */
+        return SUBDOC_STATUS_PATH_ENOENT;
+
+    } else if (m->immediate_parent_found && m->loc_next_key.at) {
+        /* Keep the dictionary sorted by inserting before the next key */
+        mk_end_at_begin(&op->doc_cur, &m->loc_next_key, &op->doc_new[0], LOC_EXCL);
+        op->doc_new[1] = loc_QUOTE;
+        op->doc_new[2].at = jpr->components[jpr->ncomponents-1].pstr;
+        op->doc_new[2].length = jpr->components[jpr->ncomponents-1].len;
+        op->doc_new[3] = loc_QUOTE_COLON;
+        op->doc_new[4] = op->user_in;
+        op->doc_new[5] = loc_COMMA;
+        mk_begin_at_begin(&op->doc_cur, &m->loc_next_key, &op->doc_new[6]);
+        op->doc_new_len = 7;
+
     } else if (m->immediate_parent_found) {
         mk_end_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[0], LOC_EXCL);
         /*TODO: The key might have a literal '"' in it, which has been escaped? */
@@ -239,8 +395,14 @@ do_mkdir_p(subdoc_OPERATION *op, int mode)
     jsonsl_jpr_t jpr = &op->path->jpr_base;
     unsigned ii;
     subdoc_MATCH *m = &op->match;
+    /* In a sorted dictionary, the new key goes before the next greater one */
+    int sorted = m->loc_next_key.at != NULL;
 
-    mk_end_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[0], LOC_EXCL);
+    if (sorted) {
+        mk_end_at_begin(&op->doc_cur, &m->loc_next_key, &op->doc_new[0], LOC_EXCL);
+    } else {
+        mk_end_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[0], LOC_EXCL);
+    }
 
     #define DO_APPEND(s, n) if (subdoc_string_append(&op->bkbuf_extra, s, n) != 0) { return SUBDOC_STATUS_GLOBAL_ENOMEM; }
     #define DO_APPENDZ(s) DO_APPEND(s, sizeof(s)-1)
@@ -256,7 +418,7 @@ do_mkdir_p(subdoc_OPERATION *op, int mode)
 
     /* figure out the components missing */
     /* THIS IS RESERVED FOR doc_new[1]! */
-    if (m->num_siblings) {
+    if (m->num_siblings && !sorted) {
         DO_APPENDZ(",")
     }
 
@@ -272,7 +434,7 @@ do_mkdir_p(subdoc_OPERATION *op, int mode)
      * newly created key */
     for (ii = m->match_level + 1; ii < jpr->ncomponents; ii++) {
         comp = &jpr->components[ii];
-        if (comp->ptype != JSONSL_PATH_STRING) {
+        if (comp->is_arridx) {
             return SUBDOC_STATUS_PATH_ENOENT;
         }
         DO_APPENDZ("{\"");
@@ -292,6 +454,9 @@ do_mkdir_p(subdoc_OPERATION *op, int mode)
     for (ii = m->match_level+1; ii < jpr->ncomponents; ii++) {
         DO_APPENDZ("}");
     }
+    if (sorted) {
+        DO_APPENDZ(",");
+    }
     op->doc_new[3].length = op->bkbuf_extra.nused - op->doc_new[1].length;
 
     /* Set the buffers */
@@ -299,7 +464,11 @@ do_mkdir_p(subdoc_OPERATION *op, int mode)
     op->doc_new[3].at = op->bkbuf_extra.base + op->doc_new[1].length;
     op->doc_new[2] = op->user_in;
 
-    mk_begin_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[4], LOC_INC);
+    if (sorted) {
+        mk_begin_at_begin(&op->doc_cur, &m->loc_next_key, &op->doc_new[4]);
+    } else {
+        mk_begin_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[4], LOC_INC);
+    }
     op->doc_new_len = 5;
 
     return SUBDOC_STATUS_SUCCESS;
@@ -356,6 +525,163 @@ find_last_element(subdoc_OPERATION *op)
     return SUBDOC_STATUS_SUCCESS;
 }
 
+static uint64_t
+hash_path(const jsonsl_jpr_t jpr)
+{
+    uint64_t hash = jpr->ncomponents;
+    size_t ii;
+
+    for (ii = 1; ii < jpr->ncomponents; ii++) {
+        const struct jsonsl_jpr_component_st *comp = &jpr->components[ii];
+        hash *= 0x100000001B3ULL;
+        if (comp->ptype == JSONSL_PATH_STRING) {
+            hash ^= subdoc_unique_hash(comp->pstr, comp->len);
+        } else {
+            hash ^= comp->idx;
+        }
+    }
+    return hash;
+}
+
+/* Whether the document still contains the array described by the unique
+ * index, at the recorded location. Only the structure leading up to it is
+ * scanned, and its text digested; both count towards bytes_scanned */
+static int
+unique_index_applies(subdoc_OPERATION *op, const subdoc_UNIQUE_INDEX *uidx)
+{
+    const char *doc = op->doc_cur.at;
+    size_t ndoc = op->doc_cur.length;
+
+    if (uidx->array_pos >= ndoc || uidx->array_len > ndoc - uidx->array_pos ||
+            uidx->array_len < 2 || doc[uidx->array_pos] != '[' ||
+            doc[uidx->array_pos + uidx->array_len - 1] != ']') {
+        return 0;
+    }
+    op->match.bytes_scanned += uidx->array_pos + 1;
+    if (!subdoc_hint_verify_container(doc, ndoc, op->path, uidx->array_pos)) {
+        return 0;
+    }
+    op->match.bytes_scanned += uidx->array_len;
+    return subdoc_unique_digest(doc + uidx->array_pos, uidx->array_len) ==
+            uidx->array_digest;
+}
+
+/* Sets up the match as find_first_element() would, for the array described
+ * by the unique index, without parsing it. loc_match.length is not set */
+static subdoc_ERRORS
+locate_indexed_array(subdoc_OPERATION *op, const subdoc_UNIQUE_INDEX *uidx)
+{
+    subdoc_MATCH *m = &op->match;
+    const char *first = op->doc_cur.at + uidx->array_pos + 1;
+
+    while (isspace((unsigned char)*first)) {
+        first++;
+    }
+    m->status = JSONSL_ERROR_SUCCESS;
+    m->immediate_parent_found = 1;
+    m->unique_item_found = 0;
+    m->loc_parent.at = op->doc_cur.at + uidx->array_pos;
+    m->loc_parent.length = uidx->array_len;
+    if (*first == ']') {
+        m->matchres = JSONSL_MATCH_NOMATCH;
+        return SUBDOC_STATUS_PATH_ENOENT;
+    }
+    m->matchres = JSONSL_MATCH_COMPLETE;
+    m->match_level = op->path->jpr_base.ncomponents + 1;
+    m->has_key = 0;
+    m->position = 0;
+    m->loc_match.at = first;
+    m->loc_match.length = 0;
+    return SUBDOC_STATUS_SUCCESS;
+}
+
+/* Like find_first_element(), but also checks whether the new value already
+ * exists in the array (see subdoc_MATCH::ensure_unique), consulting and
+ * maintaining the operation's unique index if one is attached. */
+static subdoc_ERRORS
+find_first_unique(subdoc_OPERATION *op)
+{
+    subdoc_UNIQUE_INDEX *uidx = op->unique_index;
+    subdoc_MATCH *m = &op->match;
+    subdoc_ERRORS rv;
+    uint64_t pathhash;
+
+    m->ensure_unique = op->user_in;
+    if (uidx == NULL) {
+        return find_first_element(op);
+    }
+
+    m->unique_hashed = 1;
+    pathhash = hash_path(&op->path->jpr_base);
+
+    if (uidx->valid && uidx->path_hash == pathhash &&
+            unique_index_applies(op, uidx)) {
+        if (!subdoc_unique_index_has(uidx,
+                subdoc_unique_hash(op->user_in.at, op->user_in.length))) {
+            /* Definitely not present; only the array's location is needed */
+            return locate_indexed_array(op, uidx);
+        }
+        return find_first_element(op);
+    }
+
+    /* (Re)build the index during this scan */
+    subdoc_unique_index_clear(uidx);
+    uidx->path_hash = pathhash;
+    m->unique_index = uidx;
+    rv = find_first_element(op);
+    m->unique_index = NULL;
+
+    if (rv == SUBDOC_STATUS_SUCCESS ||
+            (rv == SUBDOC_STATUS_PATH_ENOENT && m->immediate_parent_found)) {
+        /* Scanned the entire array (or it is empty) */
+        uidx->valid = !uidx->error;
+        uidx->array_pos = m->loc_parent.at - op->doc_cur.at;
+        uidx->array_len = m->loc_parent.length;
+        uidx->array_digest = subdoc_unique_digest(m->loc_parent.at, m->loc_parent.length);
+    }
+    return rv;
+}
+
+/* Records a value added by ADD_UNIQUE in the unique index, along with the
+ * array as it appears in the new document */
+static void
+update_unique_index(subdoc_OPERATION *op)
+{
+    subdoc_UNIQUE_INDEX *uidx = op->unique_index;
+    subdoc_UNIQUE_DIGEST dg;
+    size_t ii, pos, newlen = 0, begin, end;
+
+    if (uidx == NULL || !uidx->valid) {
+        return;
+    }
+    if (subdoc_unique_index_add(uidx,
+            subdoc_unique_hash(op->user_in.at, op->user_in.length)) != 0) {
+        uidx->valid = 0;
+        return;
+    }
+
+    /* Only the array changed, so it starts at the same offset, and its length
+     * changed by as much as the document's */
+    for (ii = 0; ii < op->doc_new_len; ii++) {
+        newlen += op->doc_new[ii].length;
+    }
+    begin = uidx->array_pos;
+    end = begin + uidx->array_len + newlen - op->doc_cur.length;
+
+    subdoc_unique_digest_init(&dg);
+    for (ii = 0, pos = 0; ii < op->doc_new_len && pos < end; ii++) {
+        const subdoc_LOC *frag = &op->doc_new[ii];
+        size_t lo = begin > pos ? begin - pos : 0;
+        size_t hi = end - pos < frag->length ? end - pos : frag->length;
+        if (lo < hi) {
+            subdoc_unique_digest_update(&dg, frag->at + lo, hi - lo);
+        }
+        pos += frag->length;
+    }
+    uidx->array_len = end - begin;
+    uidx->array_digest = subdoc_unique_digest_final(&dg);
+}
+
 /* Inserts a single element into an empty array */
 static subdoc_ERRORS
 insert_singleton_element(subdoc_OPERATION *op)
@@ -395,7 +721,146 @@ do_list_op(subdoc_OPERATION *op)
 
     subdoc_ERRORS rv;
     subdoc_MATCH *m = &op->match;
-    if (op->optype == SUBDOC_CMD_ARRAY_PREPEND) {
+    if (op->optype == SUBDOC_CMD_ARRAY_INSERT) {
+        const jsonsl_jpr_t jpr = &op->path->jpr_base;
+        const struct jsonsl_jpr_component_st *comp;
+
+        comp = &jpr->components[jpr->ncomponents-1];
+        if (jpr->ncomponents == 1 || comp->ptype != JSONSL_PATH_NUMERIC || comp->is_neg) {
+            return SUBDOC_STATUS_PATH_EINVAL;
+        }
+
+        rv = do_match_common(op);
+        if (rv != SUBDOC_STATUS_SUCCESS) {
+            return rv;
+        }
+        if (m->matchres != JSONSL_MATCH_COMPLETE && !m->immediate_parent_found) {
+            return SUBDOC_STATUS_PATH_ENOENT;
+        }
+        /* A numeric JSON Pointer segment may also name a dictionary key */
+        if (m->loc_parent.at == NULL || *m->loc_parent.at != '[') {
+            return SUBDOC_STATUS_PATH_MISMATCH;
+        }
+        if (m->matchres == JSONSL_MATCH_COMPLETE) {
+            /* Insert right before the existing element */
+            goto GT_PREPEND_FOUND;
+        }
+        if (comp->idx != m->num_siblings) {
+            return SUBDOC_STATUS_PATH_ENOENT;
+        }
+        if (m->num_siblings == 0) {
+            return insert_singleton_element(op);
+        }
+
+        /* One past the end. Append before the closing bracket; this doesn't
+         * need the location of the last element.
+         * NEWDOC[0] = [ ..., LAST
+         * NEWDOC[1] = ,
+         * NEWDOC[2] = USER
+         * NEWDOC[3] = ]
+         */
+        mk_end_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[0], LOC_EXCL);
+        op->doc_new[1] = loc_COMMA;
+        op->doc_new[2] = op->user_in;
+        mk_begin_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[3], LOC_INC);
+        op->doc_new_len = 4;
+        return SUBDOC_STATUS_SUCCESS;
+
+    } else if (op->optype == SUBDOC_CMD_ARRAY_POP_FRONT) {
+        rv = find_first_element(op);
+        if (rv != SUBDOC_STATUS_SUCCESS) {
+            return rv;
+        }
+
+        /* LAYOUT:
+         * NEWDOC[0] = .... [
+         * [removed]
+         * NEWDOC[1] = (---> , <---) REST
+         */
+        mk_end_at_begin(&op->doc_cur, &m->loc_match, &op->doc_new[0], LOC_EXCL);
+        mk_begin_at_end(&op->doc_cur, &m->loc_match, &op->doc_new[1], LOC_EXCL);
+        if (m->num_siblings) {
+            strip_comma(&op->doc_new[1], STRIP_FIRST_COMMA);
+        }
+        op->doc_new_len = 2;
+        return SUBDOC_STATUS_SUCCESS;
+
+    } else if (op->optype == SUBDOC_CMD_ARRAY_POP_BACK) {
+        rv = find_last_element(op);
+        if (rv != SUBDOC_STATUS_SUCCESS) {
+            return rv;
+        }
+        /* The last element extends up to the parent's closing token */
+        strip_trailing_ws(&m->loc_match);
+
+        /* LAYOUT:
+         * NEWDOC[0] = .... [ ..., ... (---> , <---)
+         * [removed]
+         * NEWDOC[1] = ]
+         */
+        mk_end_at_begin(&op->doc_cur, &m->loc_match, &op->doc_new[0], LOC_EXCL);
+        if (m->num_siblings) {
+            strip_comma(&op->doc_new[0], STRIP_LAST_COMMA);
+        }
+        mk_begin_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[1], LOC_INC);
+        op->doc_new_len = 2;
+        return SUBDOC_STATUS_SUCCESS;
+
+    } else if (op->optype == SUBDOC_CMD_ARRAY_TRIM) {
+        uint64_t nkeep;
+        jsonsl_error_t jrv;
+
+        if (op->user_in.length != 8) {
+            return SUBDOC_STATUS_GLOBAL_EINVAL;
+        }
+        memcpy(&nkeep, op->user_in.at, 8);
+        nkeep = ntohll(nkeep);
+        if (nkeep > INT64_MAX) {
+            return SUBDOC_STATUS_GLOBAL_EINVAL;
+        }
+
+        /* Find the first element to be removed */
+        jrv = subdoc_path_add_arrindex(op->path, nkeep);
+        if (jrv != JSONSL_ERROR_SUCCESS) {
+            return SUBDOC_STATUS_PATH_E2BIG;
+        }
+        rv = do_match_common(op);
+        subdoc_path_pop_component(op->path);
+        if (rv != SUBDOC_STATUS_SUCCESS) {
+            return rv;
+        }
+
+        if (m->matchres != JSONSL_MATCH_COMPLETE) {
+            if (!m->immediate_parent_found) {
+                return SUBDOC_STATUS_PATH_ENOENT;
+            }
+            /* Nothing to remove; the document is unchanged */
+            op->doc_new[0] = op->doc_cur;
+            op->doc_new_len = 1;
+            m->loc_match.at = NULL;
+            m->loc_match.length = 0;
+            return SUBDOC_STATUS_SUCCESS;
+        }
+
+        /* The removed elements extend up to the parent's closing token */
+        m->loc_match.length = (m->loc_parent.at + m->loc_parent.length) - m->loc_match.at;
+        m->loc_match.length--;
+        strip_trailing_ws(&m->loc_match);
+
+        /* LAYOUT:
+         * NEWDOC[0] = .... [ ..., ... (---> , <---)
+         * [removed]
+         * NEWDOC[1] = ]
+         */
+        mk_end_at_begin(&op->doc_cur, &m->loc_match, &op->doc_new[0], LOC_EXCL);
+        if (nkeep) {
+            strip_comma(&op->doc_new[0], STRIP_LAST_COMMA);
+        }
+        mk_begin_at_end(&op->doc_cur, &m->loc_parent, &op->doc_new[1], LOC_INC);
+        op->doc_new_len = 2;
+        return SUBDOC_STATUS_SUCCESS;
+
+    } else if (op->optype == SUBDOC_CMD_ARRAY_PREPEND) {
         /* Find the array itself. */
         rv = find_first_element(op);
 
@@ -463,8 +928,7 @@ do_list_op(subdoc_OPERATION *op)
         goto GT_ARR_P_COMMON;
 
     } else if (op->optype == SUBDOC_CMD_ARRAY_ADD_UNIQUE) {
-        m->ensure_unique = op->user_in;
-        rv = find_first_element(op);
+        rv = find_first_unique(op);
         HANDLE_LISTADD_ENOENT(rv);
 
         GT_ADD_UNIQUE:
@@ -478,8 +942,7 @@ do_list_op(subdoc_OPERATION *op)
         goto GT_PREPEND_FOUND;
 
     } else if (op->optype == SUBDOC_CMD_ARRAY_ADD_UNIQUE_P) {
-        m->ensure_unique = op->user_in;
-        rv = find_first_element(op);
+        rv = find_first_unique(op);
         HANDLE_LISTADD_ENOENT_P(rv);
         goto GT_ADD_UNIQUE;
     }
@@ -487,6 +950,107 @@ do_list_op(subdoc_OPERATION *op)
     return SUBDOC_STATUS_SUCCESS;
 }
 
+/* Replaces the matched number with the contents of numbufs */
+static subdoc_ERRORS
+splice_number(subdoc_OPERATION *op, size_t n_buf)
+{
+    /* Preamble */
+    mk_end_at_begin(&op->doc_cur, &op->match.loc_match, &op->doc_new[0], LOC_EXCL);
+
+    /* New number */
+    op->doc_new[1].at = op->numbufs;
+    op->doc_new[1].length = n_buf;
+
+    /* Postamble */
+    mk_begin_at_end(&op->doc_cur, &op->match.loc_match, &op->doc_new[2], LOC_EXCL);
+    op->doc_new_len = 3;
+
+    op->match.loc_match.at = op->numbufs;
+    op->match.loc_match.length = n_buf;
+    return SUBDOC_STATUS_SUCCESS;
+}
+
+/* Creates the missing path with the contents of numbufs as its value */
+static subdoc_ERRORS
+create_number(subdoc_OPERATION *op, size_t n_buf)
+{
+    subdoc_ERRORS status;
+
+    switch (op->optype) {
+    case SUBDOC_CMD_INCREMENT:
+    case SUBDOC_CMD_DECREMENT:
+    case SUBDOC_CMD_INCREMENT_FLOAT:
+        if (!op->match.immediate_parent_found) {
+            return SUBDOC_STATUS_PATH_ENOENT;
+        }
+        break;
+    }
+
+    if (op->match.type != JSONSL_T_OBJECT) {
+        return SUBDOC_STATUS_PATH_ENOENT;
+    }
+
+    op->user_in.at = op->numbufs;
+    op->user_in.length = n_buf;
+    op->optype = SUBDOC_CMD_DICT_ADD_P;
+    if ((status = do_store_dict(op)) != SUBDOC_STATUS_SUCCESS) {
+        return status;
+    }
+    op->match.loc_match = op->user_in;
+    return SUBDOC_STATUS_SUCCESS;
+}
+
+/* Adds `delta` to the integer counter at `m`, placing the sum in `result` */
+static subdoc_ERRORS
+apply_delta(const subdoc_MATCH *m, int64_t delta, int64_t *result)
+{
+    int64_t num_i;
+    size_t ndigits;
+
+    if (m->type != JSONSL_T_SPECIAL) {
+        return SUBDOC_STATUS_PATH_MISMATCH;
+    } else if (m->sflags & ~(JSONSL_SPECIALf_NUMERIC)) {
+        return SUBDOC_STATUS_PATH_MISMATCH;
+    }
+
+    /* The lexer has already accumulated the digits into numval. This is exact
+     * for up to 19 digits; anything longer cannot fit in an int64_t anyway */
+    ndigits = m->loc_match.length;
+    if (m->sflags & JSONSL_SPECIALf_SIGNED) {
+        ndigits--;
+    }
+    if (ndigits > 19) {
+        return SUBDOC_STATUS_NUM_E2BIG;
+    }
+    if (m->sflags & JSONSL_SPECIALf_SIGNED) {
+        if (m->numval > (uint64_t)INT64_MAX + 1) {
+            return SUBDOC_STATUS_NUM_E2BIG;
+        }
+        num_i = (int64_t)(0 - m->numval);
+    } else {
+        if (m->numval > (uint64_t)INT64_MAX) {
+            return SUBDOC_STATUS_NUM_E2BIG;
+        }
+        num_i = (int64_t)m->numval;
+    }
+
+    /* Calculate what to place inside the buffer. We want to be gentle here
+     * and not force 64 bit C arithmetic to confuse users, so use proper
+     * integer overflow/underflow with a 64 (or rather, 63) bit limit. */
+    if (delta >= 0 && num_i >= 0) {
+        if (INT64_MAX - delta <= num_i) {
+            return SUBDOC_STATUS_DELTA_E2BIG;
+        }
+    } else if (delta < 0 && num_i < 0) {
+        if (delta <= INT64_MIN - num_i) {
+            return SUBDOC_STATUS_DELTA_E2BIG;
+        }
+    }
+
+    *result = num_i + delta;
+    return SUBDOC_STATUS_SUCCESS;
+}
+
 static subdoc_ERRORS
 do_arith_op(subdoc_OPERATION *op)
 {
@@ -494,7 +1058,6 @@ do_arith_op(subdoc_OPERATION *op)
     int64_t num_i;
     int64_t delta;
     uint64_t tmp;
-    size_t n_buf;
 
     /* Scan the match first */
     if (op->user_in.length != 8) {
@@ -522,94 +1085,614 @@ do_arith_op(subdoc_OPERATION *op)
         return status;
     }
 
+    if (op->match.matchres != JSONSL_MATCH_COMPLETE) {
+        return create_number(op, format_i64(op->numbufs, delta));
+    }
+
+    status = apply_delta(&op->match, delta, &num_i);
+    if (status != SUBDOC_STATUS_SUCCESS) {
+        return status;
+    }
+    return splice_number(op, format_i64(op->numbufs, num_i));
+}
+
+static subdoc_ERRORS
+do_arith_float_op(subdoc_OPERATION *op)
+{
+    subdoc_ERRORS status;
+    double num_d, delta;
+    uint64_t tmp;
+    std::to_chars_result res;
+
+    if (op->user_in.length != 8) {
+        return SUBDOC_STATUS_GLOBAL_EINVAL;
+    }
+    memcpy(&tmp, op->user_in.at, 8);
+    tmp = ntohll(tmp);
+    memcpy(&delta, &tmp, 8);
+    if (!std::isfinite(delta)) {
+        return SUBDOC_STATUS_GLOBAL_EINVAL;
+    }
+
+    status = do_match_common(op);
+    if (status != SUBDOC_STATUS_SUCCESS) {
+        return status;
+    }
+
     if (op->match.matchres == JSONSL_MATCH_COMPLETE) {
+        const char *begin = op->match.loc_match.at;
+        const char *end = begin + op->match.loc_match.length;
+
         if (op->match.type != JSONSL_T_SPECIAL) {
             return SUBDOC_STATUS_PATH_MISMATCH;
-        } else if (op->match.sflags & ~(JSONSL_SPECIALf_NUMERIC)) {
+        } else if (op->match.sflags &
+                ~(JSONSL_SPECIALf_NUMERIC|JSONSL_SPECIALf_NUMNOINT)) {
             return SUBDOC_STATUS_PATH_MISMATCH;
-        } else  {
-            num_i = strtoll(op->match.loc_match.at, NULL, 10);
-            if (num_i == LLONG_MAX && errno == ERANGE) {
-                return SUBDOC_STATUS_NUM_E2BIG;
-            }
+        }
+        std::from_chars_result parsed = std::from_chars(begin, end, num_d);
+        if (parsed.ec != std::errc() || parsed.ptr != end) {
+            /* e.g. 1e400. num_d is unset on a range error */
+            return SUBDOC_STATUS_NUM_E2BIG;
+        }
+        num_d += delta;
+        if (!std::isfinite(num_d)) {
+            return SUBDOC_STATUS_DELTA_E2BIG;
+        }
+    } else {
+        num_d = delta;
+    }
 
-            /* Calculate what to place inside the buffer. We want to be gentle here
-             * and not force 64 bit C arithmetic to confuse users, so use proper
-             * integer overflow/underflow with a 64 (or rather, 63) bit limit. */
-            if (delta >= 0 && num_i >= 0) {
-                if (INT64_MAX - delta <= num_i) {
-                    return SUBDOC_STATUS_DELTA_E2BIG;
-                }
-            } else if (delta < 0 && num_i < 0) {
-                if (delta <= INT64_MIN - num_i) {
-                    return SUBDOC_STATUS_DELTA_E2BIG;
+    /* Shortest representation which parses back to the same value */
+    res = std::to_chars(op->numbufs, op->numbufs + sizeof op->numbufs, num_d);
+    if (res.ec != std::errc()) {
+        return SUBDOC_STATUS_NUM_E2BIG;
+    }
+
+    if (op->match.matchres == JSONSL_MATCH_COMPLETE) {
+        return splice_number(op, res.ptr - op->numbufs);
+    } else {
+        return create_number(op, res.ptr - op->numbufs);
+    }
+}
+
+/* Storage for the multi-path commands (SUBDOC_CMD_MULTI_INCREMENT and
+ * SUBDOC_CMD_PROJECT). This holds a full path for each, so it is only
+ * allocated if one of these is used */
+struct subdoc_MULTI_CTX_st {
+    subdoc_PATH paths[SUBDOC_MULTI_MAX];
+    const subdoc_PATH *ppaths[SUBDOC_MULTI_MAX];
+    subdoc_MATCH matches[SUBDOC_MULTI_MAX];
+    /* Counters, in document order */
+    size_t order[SUBDOC_MULTI_MAX];
+    /* Offset of each new value within bkbuf_extra */
+    size_t valoffs[SUBDOC_MULTI_MAX];
+    /* Output fragments. Those with a NULL `at` live in bkbuf_extra, at the
+     * corresponding offset in fragoffs */
+    subdoc_LOC frags[SUBDOC_MULTI_MAX * 2 + 1];
+    size_t fragoffs[SUBDOC_MULTI_MAX * 2 + 1];
+};
+
+/* Where the counter's new text goes: over the existing number, or just before
+ * the closing brace of the parent it is to be created in */
+static const char *
+multi_target(const subdoc_MATCH *m)
+{
+    if (m->matchres == JSONSL_MATCH_COMPLETE) {
+        return m->loc_match.at;
+    }
+    return m->loc_parent.at + m->loc_parent.length - 1;
+}
+
+/* Returns true if counters `a` and `b` refer to the same number */
+static int
+multi_same_counter(const subdoc_MULTI_CTX_st *ctx, size_t a, size_t b)
+{
+    const struct jsonsl_jpr_st *jpr_a = &ctx->paths[a].jpr_base;
+    const struct jsonsl_jpr_st *jpr_b = &ctx->paths[b].jpr_base;
+    const struct jsonsl_jpr_component_st *comp_a, *comp_b;
+
+    if (multi_target(&ctx->matches[a]) != multi_target(&ctx->matches[b])) {
+        return 0;
+    }
+    if (ctx->matches[a].matchres == JSONSL_MATCH_COMPLETE) {
+        return 1;
+    }
+    /* Both are to be created within the same dictionary */
+    comp_a = &jpr_a->components[jpr_a->ncomponents-1];
+    comp_b = &jpr_b->components[jpr_b->ncomponents-1];
+    return comp_a->len == comp_b->len &&
+            memcmp(comp_a->pstr, comp_b->pstr, comp_a->len) == 0;
+}
+
+/* Parses the paths of a multi-path command, and matches them all in a single
+ * pass. If `keys_only` is set, every component must be a dictionary key */
+static subdoc_ERRORS
+multi_match(subdoc_OPERATION *op, int keys_only)
+{
+    subdoc_MULTI_CTX_st *ctx = op->multi_ctx;
+    size_t ii, jj;
+    uint64_t t0;
+
+    if (op->nmulti == 0 || op->nmulti > SUBDOC_MULTI_MAX) {
+        return SUBDOC_STATUS_GLOBAL_EINVAL;
+    }
+    if (ctx == NULL) {
+        ctx = (subdoc_MULTI_CTX_st *)calloc(1, sizeof(*ctx));
+        if (ctx == NULL) {
+            return SUBDOC_STATUS_GLOBAL_ENOMEM;
+        }
+        op->multi_ctx = ctx;
+    }
+
+    t0 = phase_begin(op);
+    for (ii = 0; ii < op->nmulti; ii++) {
+        subdoc_MULTI_SPEC *spec = &op->multi[ii];
+        subdoc_PATH *pth = &ctx->paths[ii];
+
+        spec->status = SUBDOC_STATUS_SUCCESS;
+        spec->result.at = NULL;
+        spec->result.length = 0;
+
+        subdoc_path_clear(pth);
+        if (subdoc_path_parse(pth, spec->path, spec->npath) != 0) {
+            spec->status = SUBDOC_STATUS_PATH_EINVAL;
+        } else if (pth->jpr_base.ncomponents == 1) {
+            /* The root is never a number, nor a field */
+            spec->status = SUBDOC_STATUS_PATH_MISMATCH;
+        } else if (pth->has_wildcard) {
+            spec->status = SUBDOC_STATUS_PATH_EINVAL;
+        } else if (pth->has_negix) {
+            spec->status = SUBDOC_STATUS_GLOBAL_ENOSUPPORT;
+        } else if (keys_only) {
+            for (jj = 1; jj < pth->jpr_base.ncomponents; jj++) {
+                if (pth->jpr_base.components[jj].ptype != JSONSL_PATH_STRING) {
+                    spec->status = SUBDOC_STATUS_GLOBAL_ENOSUPPORT;
                 }
             }
+        }
+        if (spec->status != SUBDOC_STATUS_SUCCESS) {
+            phase_end(op, SUBDOC_PHASE_PATH_PARSE, t0);
+            return spec->status;
+        }
+        ctx->ppaths[ii] = pth;
+    }
+    phase_end(op, SUBDOC_PHASE_PATH_PARSE, t0);
+
+    t0 = phase_begin(op);
+    memset(ctx->matches, 0, sizeof(*ctx->matches) * op->nmulti);
+    subdoc_match_exec_multi(op->doc_cur.at, op->doc_cur.length, ctx->ppaths,
+        op->nmulti, op->jsn, ctx->matches);
+    phase_end(op, SUBDOC_PHASE_MATCH, t0);
+    if (ctx->matches[0].status != JSONSL_ERROR_SUCCESS) {
+        return SUBDOC_STATUS_DOC_NOTJSON;
+    }
 
-            num_i += delta;
-            n_buf = sprintf(op->numbufs, "%" PRId64, num_i);
+    /* Sort into document order, so the fragments can be emitted in a single
+     * walk. Ties keep their original order, except that repeats of a counter
+     * are placed after its first occurrence: several keys may be created at
+     * the same place, and each must be created only once */
+    for (ii = 0; ii < op->nmulti; ii++) {
+        const char *target = multi_target(&ctx->matches[ii]);
+        size_t pos;
+
+        for (jj = ii; jj > 0 && multi_target(&ctx->matches[ctx->order[jj-1]]) > target; jj--) {
         }
-    } else {
-        switch (op->optype) {
-        case SUBDOC_CMD_INCREMENT:
-        case SUBDOC_CMD_DECREMENT:
-            if (!op->match.immediate_parent_found) {
-                return SUBDOC_STATUS_PATH_ENOENT;
+        for (pos = jj; jj > 0 && multi_target(&ctx->matches[ctx->order[jj-1]]) == target; jj--) {
+            if (multi_same_counter(ctx, ctx->order[jj-1], ii)) {
+                pos = jj;
+                break;
             }
-            break;
         }
+        memmove(&ctx->order[pos + 1], &ctx->order[pos], (ii - pos) * sizeof(ctx->order[0]));
+        ctx->order[pos] = ii;
+    }
+    return SUBDOC_STATUS_SUCCESS;
+}
 
-        if (op->match.type != JSONSL_T_OBJECT) {
-            return SUBDOC_STATUS_PATH_ENOENT;
+/* Sets the pointers of fragments and results built in bkbuf_extra, which will
+ * no longer move, and makes the fragments the new document */
+static void
+multi_finish(subdoc_OPERATION *op, size_t nfrags, int set_results)
+{
+    subdoc_MULTI_CTX_st *ctx = op->multi_ctx;
+    size_t ii;
+
+    for (ii = 0; ii < nfrags; ii++) {
+        if (ctx->frags[ii].at == NULL) {
+            ctx->frags[ii].at = op->bkbuf_extra.base + ctx->fragoffs[ii];
         }
+    }
+    for (ii = 0; set_results && ii < op->nmulti; ii++) {
+        op->multi[ii].result.at = op->bkbuf_extra.base + ctx->valoffs[ii];
+    }
+    op->doc_new = ctx->frags;
+    op->doc_new_len = nfrags;
+}
 
-        n_buf = sprintf(op->numbufs, "%" PRId64, delta);
-        op->user_in.at = op->numbufs;
-        op->user_in.length = n_buf;
-        op->optype = SUBDOC_CMD_DICT_ADD_P;
-        if ((status = do_store_dict(op)) != SUBDOC_STATUS_SUCCESS) {
-            return status;
+static subdoc_ERRORS
+do_multi_arith_op(subdoc_OPERATION *op)
+{
+    subdoc_MULTI_CTX_st *ctx;
+    subdoc_ERRORS status;
+    const char *prev = op->doc_cur.at;
+    const char *last_created = NULL;
+    size_t ii, jj, kk, nfrags = 0;
+
+    if ((status = multi_match(op, 0)) != SUBDOC_STATUS_SUCCESS) {
+        return status;
+    }
+    ctx = op->multi_ctx;
+
+    for (ii = 0; ii < op->nmulti; ii = jj) {
+        size_t ix = ctx->order[ii];
+        const subdoc_MATCH *m = &ctx->matches[ix];
+        int64_t delta = op->multi[ix].delta, num_i = 0;
+        subdoc_ERRORS rv = SUBDOC_STATUS_SUCCESS;
+        char numbuf[20];
+        size_t nnum, off, valoff;
+
+        /* Repeated counters are combined into a single update */
+        for (jj = ii + 1; jj < op->nmulti && multi_same_counter(ctx, ix, ctx->order[jj]); jj++) {
+            if (subdoc_add_i64(&delta, op->multi[ctx->order[jj]].delta) != 0) {
+                rv = SUBDOC_STATUS_DELTA_E2BIG;
+            }
+        }
+
+        if (rv != SUBDOC_STATUS_SUCCESS) {
+            /* nop */
+        } else if (m->matchres == JSONSL_MATCH_COMPLETE) {
+            rv = apply_delta(m, delta, &num_i);
+        } else if (m->matchres == JSONSL_MATCH_TYPE_MISMATCH) {
+            rv = SUBDOC_STATUS_PATH_MISMATCH;
+        } else if (!m->immediate_parent_found || m->type != JSONSL_T_OBJECT) {
+            rv = SUBDOC_STATUS_PATH_ENOENT;
+        } else {
+            num_i = delta;
+        }
+
+        for (kk = ii; kk < jj; kk++) {
+            op->multi[ctx->order[kk]].status = rv;
+        }
+        if (rv != SUBDOC_STATUS_SUCCESS && status == SUBDOC_STATUS_SUCCESS) {
+            status = rv;
+        }
+        if (status != SUBDOC_STATUS_SUCCESS) {
+            /* Nothing is written, but keep going so that every counter's
+             * status is reported */
+            continue;
+        }
+
+        nnum = format_i64(numbuf, num_i);
+        ctx->frags[nfrags].at = prev;
+        ctx->frags[nfrags].length = multi_target(m) - prev;
+        nfrags++;
+
+        off = op->bkbuf_extra.nused;
+        if (m->matchres == JSONSL_MATCH_COMPLETE) {
+            prev = m->loc_match.at + m->loc_match.length;
+        } else {
+            const struct jsonsl_jpr_st *jpr = &ctx->paths[ix].jpr_base;
+            const struct jsonsl_jpr_component_st *comp =
+                    &jpr->components[jpr->ncomponents-1];
+
+            if (m->num_siblings || last_created == multi_target(m)) {
+                DO_APPENDZ(",");
+            }
+            DO_APPENDZ("\"");
+            DO_APPEND(comp->pstr, comp->len);
+            DO_APPENDZ("\":");
+            prev = last_created = multi_target(m);
+        }
+        valoff = op->bkbuf_extra.nused;
+        DO_APPEND(numbuf, nnum);
+
+        ctx->frags[nfrags].at = NULL;
+        ctx->frags[nfrags].length = op->bkbuf_extra.nused - off;
+        ctx->fragoffs[nfrags] = off;
+        nfrags++;
+
+        for (kk = ii; kk < jj; kk++) {
+            ctx->valoffs[ctx->order[kk]] = valoff;
+            op->multi[ctx->order[kk]].result.length = nnum;
         }
-        op->match.loc_match = op->user_in;
-        return SUBDOC_STATUS_SUCCESS;
     }
 
+    if (status != SUBDOC_STATUS_SUCCESS) {
+        return status;
+    }
 
-    /* Preamble */
-    mk_end_at_begin(&op->doc_cur, &op->match.loc_match, &op->doc_new[0], LOC_EXCL);
+    ctx->frags[nfrags].at = prev;
+    ctx->frags[nfrags].length = op->doc_cur.at + op->doc_cur.length - prev;
+    nfrags++;
 
-    /* New number */
-    op->doc_new[1].at = op->numbufs;
-    op->doc_new[1].length = n_buf;
+    multi_finish(op, nfrags, 1);
+    return SUBDOC_STATUS_SUCCESS;
+}
 
-    /* Postamble */
-    mk_begin_at_end(&op->doc_cur, &op->match.loc_match, &op->doc_new[2], LOC_EXCL);
-    op->doc_new_len = 3;
+/* Ends the synthesized fragment begun at `*off`, if it is not empty */
+static void
+project_synth(subdoc_OPERATION *op, size_t *nfrags, size_t *off)
+{
+    subdoc_MULTI_CTX_st *ctx = op->multi_ctx;
+    if (op->bkbuf_extra.nused == *off) {
+        return;
+    }
+    ctx->frags[*nfrags].at = NULL;
+    ctx->frags[*nfrags].length = op->bkbuf_extra.nused - *off;
+    ctx->fragoffs[*nfrags] = *off;
+    ++*nfrags;
+    *off = op->bkbuf_extra.nused;
+}
 
-    op->match.loc_match.at = op->numbufs;
-    op->match.loc_match.length = n_buf;
+static subdoc_ERRORS
+do_canonicalize(subdoc_OPERATION *op)
+{
+    subdoc_STRING *buf = &op->bkbuf_extra;
+    size_t n = 0;
+    int rv;
+
+    /* The canonical form is never longer than the original */
+    if (subdoc_string_reserve(buf, op->doc_cur.length) != 0) {
+        return SUBDOC_STATUS_GLOBAL_ENOMEM;
+    }
+    rv = subdoc_canonicalize(op->doc_cur.at, op->doc_cur.length, op->jsn,
+        buf->base + buf->nused, &n);
+    if (rv == -1) {
+        return SUBDOC_STATUS_GLOBAL_ENOMEM;
+    } else if (rv != 0) {
+        return SUBDOC_STATUS_DOC_NOTJSON;
+    }
+
+    op->doc_new[0].at = buf->base + buf->nused;
+    op->doc_new[0].length = n;
+    op->doc_new_len = 1;
+    buf->nused += n;
+    return SUBDOC_STATUS_SUCCESS;
+}
+
+static subdoc_ERRORS
+do_compact(subdoc_OPERATION *op)
+{
+    subdoc_STRING *buf = &op->bkbuf_extra;
+    size_t n = 0;
+    uint64_t t0;
+    int rv;
+
+    /* subdoc_compact() only looks for strings; anything else which isn't JSON
+     * would come out as a different document */
+    t0 = phase_begin(op);
+    rv = subdoc_validate(op->doc_cur.at, op->doc_cur.length, op->jsn,
+        SUBDOC_VALIDATE_PARENT_NONE);
+    phase_end(op, SUBDOC_PHASE_VALIDATE, t0);
+    if (rv != JSONSL_ERROR_SUCCESS) {
+        return SUBDOC_STATUS_DOC_NOTJSON;
+    }
+
+    if (subdoc_string_reserve(buf, op->doc_cur.length) != 0) {
+        return SUBDOC_STATUS_GLOBAL_ENOMEM;
+    }
+    if (subdoc_compact(op->doc_cur.at, op->doc_cur.length,
+            buf->base + buf->nused, &n) != 0) {
+        return SUBDOC_STATUS_DOC_NOTJSON;
+    }
+
+    op->doc_new[0].at = buf->base + buf->nused;
+    op->doc_new[0].length = n;
+    op->doc_new_len = 1;
+    buf->nused += n;
+    return SUBDOC_STATUS_SUCCESS;
+}
+
+static subdoc_ERRORS
+do_project(subdoc_OPERATION *op)
+{
+    subdoc_MULTI_CTX_st *ctx;
+    subdoc_ERRORS status;
+    const char *kept_end = NULL;
+    /* Keys of the enclosing objects currently open in the output, and whether
+     * each level already has a member (and so needs a comma) */
+    const struct jsonsl_jpr_component_st *open[COMPONENTS_ALLOC];
+    int has_member[COMPONENTS_ALLOC];
+    size_t ii, depth = 0, nfrags = 0, off;
+
+    if ((status = multi_match(op, 1)) != SUBDOC_STATUS_SUCCESS) {
+        return status;
+    }
+    ctx = op->multi_ctx;
+
+    off = op->bkbuf_extra.nused;
+    DO_APPENDZ("{");
+    has_member[0] = 0;
+
+    for (ii = 0; ii < op->nmulti; ii++) {
+        size_t ix = ctx->order[ii], nopen, common;
+        const subdoc_MATCH *m = &ctx->matches[ix];
+        const struct jsonsl_jpr_st *jpr = &ctx->paths[ix].jpr_base;
+
+        if (m->matchres != JSONSL_MATCH_COMPLETE) {
+            /* Missing fields are simply left out */
+            op->multi[ix].status = m->matchres == JSONSL_MATCH_TYPE_MISMATCH ?
+                    SUBDOC_STATUS_PATH_MISMATCH : SUBDOC_STATUS_PATH_ENOENT;
+            continue;
+        }
+        op->multi[ix].result = m->loc_match;
+        if (kept_end && m->loc_match.at < kept_end) {
+            /* Within (or the same as) a field already included */
+            continue;
+        }
+        kept_end = m->loc_match.at + m->loc_match.length;
+
+        /* Fields are in document order, so those sharing enclosing objects
+         * are adjacent. Close the objects not shared with this field, and
+         * open the ones it needs */
+        nopen = jpr->ncomponents - 2;
+        for (common = 0; common < depth && common < nopen; common++) {
+            const struct jsonsl_jpr_component_st *comp = &jpr->components[common+1];
+            if (open[common]->len != comp->len ||
+                    memcmp(open[common]->pstr, comp->pstr, comp->len) != 0) {
+                break;
+            }
+        }
+        for (; depth > common; depth--) {
+            DO_APPENDZ("}");
+        }
+        for (; depth < nopen; depth++) {
+            const struct jsonsl_jpr_component_st *comp = &jpr->components[depth+1];
+            if (has_member[depth]) {
+                DO_APPENDZ(",");
+            }
+            has_member[depth] = 1;
+            DO_APPENDZ("\"");
+            DO_APPEND(comp->pstr, comp->len);
+            DO_APPENDZ("\":{");
+            open[depth] = comp;
+            has_member[depth+1] = 0;
+        }
+        if (has_member[depth]) {
+            DO_APPENDZ(",");
+        }
+        has_member[depth] = 1;
+        project_synth(op, &nfrags, &off);
+
+        /* The key, colon and value, exactly as in the source */
+        ctx->frags[nfrags].at = m->loc_key.at;
+        ctx->frags[nfrags].length = kept_end - m->loc_key.at;
+        nfrags++;
+    }
+
+    for (; depth > 0; depth--) {
+        DO_APPENDZ("}");
+    }
+    DO_APPENDZ("}");
+    project_synth(op, &nfrags, &off);
+
+    multi_finish(op, nfrags, 0);
     return SUBDOC_STATUS_SUCCESS;
 }
 
+static subdoc_ERRORS exec_compiled(subdoc_OPERATION *op);
+
+static void
+timings_begin(subdoc_OPERATION *op)
+{
+    memset(&op->timings->last, 0, sizeof op->timings->last);
+    op->timings->last.begin = subdoc_cycles();
+}
+
+/* Charge the operation to its path in op->path_sketch */
+static void
+sketch_add(subdoc_OPERATION *op, const char *pth, size_t npth,
+    uint64_t t_start)
+{
+    uint64_t weight;
+
+    if (op->path_sketch->metric == SUBDOC_SKETCH_CYCLES) {
+        weight = subdoc_cycles() - t_start;
+    } else {
+        weight = op->match.bytes_scanned;
+    }
+    subdoc_sketch_add(op->path_sketch, pth, npth, weight);
+}
+
 subdoc_ERRORS
 subdoc_op_exec(subdoc_OPERATION *op, const char *pth, size_t npth)
 {
-    int rv = subdoc_path_parse(op->path, pth, npth);
+    int rv;
+    uint64_t t0, t_start = op->path_sketch ? subdoc_cycles() : 0;
+    subdoc_ERRORS status;
+
+    SUBDOC_PROBE4(op__start, op->optype, pth, npth, op->doc_cur.length);
+    op->match.bytes_scanned = 0;
+    if (op->timings == NULL) {
+        if (subdoc_path_parse(op->path, pth, npth) != 0) {
+            status = SUBDOC_STATUS_PATH_EINVAL;
+        } else {
+            status = exec_compiled(op);
+        }
+    } else {
+        timings_begin(op);
+        t0 = phase_begin(op);
+        rv = subdoc_path_parse(op->path, pth, npth);
+        phase_end(op, SUBDOC_PHASE_PATH_PARSE, t0);
+        status = rv == 0 ? exec_compiled(op) : SUBDOC_STATUS_PATH_EINVAL;
+        subdoc_timings_finish(op->timings, op->optype);
+    }
+    if (op->path_sketch) {
+        sketch_add(op, pth, npth, t_start);
+    }
+    SUBDOC_PROBE6(op__done, op->optype, pth, npth, op->doc_cur.length,
+        op->match.bytes_scanned, status);
+    return status;
+}
+
+subdoc_ERRORS
+subdoc_op_exec_compiled(subdoc_OPERATION *op)
+{
     subdoc_ERRORS status;
 
-    if (rv != 0) {
+    SUBDOC_PROBE4(op__start, op->optype, (const char *)NULL, 0,
+        op->doc_cur.length);
+    op->match.bytes_scanned = 0;
+    if (op->timings == NULL) {
+        status = exec_compiled(op);
+    } else {
+        timings_begin(op);
+        status = exec_compiled(op);
+        subdoc_timings_finish(op->timings, op->optype);
+    }
+    SUBDOC_PROBE6(op__done, op->optype, (const char *)NULL, 0,
+        op->doc_cur.length, op->match.bytes_scanned, status);
+    return status;
+}
+
+static subdoc_ERRORS
+exec_compiled(subdoc_OPERATION *op)
+{
+    int rv;
+    uint64_t t0;
+    subdoc_ERRORS status;
+
+    op->doc_new = op->doc_new_s;
+    if (op->doc_cur.length > SUBDOC_DOC_MAX ||
+            op->user_in.length > SUBDOC_DOC_MAX) {
+        return SUBDOC_STATUS_DOC_E2BIG;
+    }
+    if (op->path->has_wildcard) {
+        /* Commands act on a single location; see subdoc_match_exec_all() */
         return SUBDOC_STATUS_PATH_EINVAL;
     }
+    if (op->unique_index) {
+        switch (op->optype) {
+        case SUBDOC_CMD_GET:
+        case SUBDOC_CMD_EXISTS:
+        case SUBDOC_CMD_GET_COUNT:
+        case SUBDOC_CMD_PROJECT:
+        case SUBDOC_CMD_ARRAY_ADD_UNIQUE:
+        case SUBDOC_CMD_ARRAY_ADD_UNIQUE_P:
+            break;
+        default:
+            /* The document may no longer match the index */
+            subdoc_unique_index_clear(op->unique_index);
+            break;
+        }
+    }
 
     switch (op->optype) {
     case SUBDOC_CMD_GET:
     case SUBDOC_CMD_EXISTS:
-        status = do_match_common(op);
+        status = do_match_readonly(op);
         if (status != SUBDOC_STATUS_SUCCESS) {
             return status;
         }
         return do_get(op);
 
+    case SUBDOC_CMD_GET_COUNT:
+        status = do_match_readonly(op);
+        if (status != SUBDOC_STATUS_SUCCESS) {
+            return status;
+        }
+        return do_get_count(op);
+
     case SUBDOC_CMD_DICT_ADD:
     case SUBDOC_CMD_DICT_ADD_P:
     case SUBDOC_CMD_DICT_UPSERT:
@@ -623,9 +1706,13 @@ subdoc_op_exec(subdoc_OPERATION *op, const char *pth, size_t npth)
         }
 
         if (op->user_in.length) {
+            t0 = phase_begin(op);
             rv = subdoc_validate(op->user_in.at, op->user_in.length, op->jsn,
                 SUBDOC_VALIDATE_PARENT_DICT);
+            phase_end(op, SUBDOC_PHASE_VALIDATE, t0);
             if (rv != JSONSL_ERROR_SUCCESS) {
+                SUBDOC_PROBE4(validate__fail, op->optype, op->user_in.at,
+                    op->user_in.length, rv);
                 return SUBDOC_STATUS_VALUE_CANTINSERT;
             }
         }
@@ -640,13 +1727,29 @@ subdoc_op_exec(subdoc_OPERATION *op, const char *pth, size_t npth)
     case SUBDOC_CMD_ARRAY_PREPEND_P:
     case SUBDOC_CMD_ARRAY_ADD_UNIQUE:
     case SUBDOC_CMD_ARRAY_ADD_UNIQUE_P:
+    case SUBDOC_CMD_ARRAY_INSERT:
         if (op->user_in.length) {
+            t0 = phase_begin(op);
             rv = subdoc_validate(op->user_in.at, op->user_in.length, op->jsn,
                 SUBDOC_VALIDATE_PARENT_ARRAY);
+            phase_end(op, SUBDOC_PHASE_VALIDATE, t0);
             if (rv != JSONSL_ERROR_SUCCESS) {
+                SUBDOC_PROBE4(validate__fail, op->optype, op->user_in.at,
+                    op->user_in.length, rv);
                 return SUBDOC_STATUS_VALUE_CANTINSERT;
             }
         }
+        status = do_list_op(op);
+        if (status == SUBDOC_STATUS_SUCCESS &&
+                (op->optype == SUBDOC_CMD_ARRAY_ADD_UNIQUE ||
+                        op->optype == SUBDOC_CMD_ARRAY_ADD_UNIQUE_P)) {
+            update_unique_index(op);
+        }
+        return status;
+
+    case SUBDOC_CMD_ARRAY_POP_FRONT:
+    case SUBDOC_CMD_ARRAY_POP_BACK:
+    case SUBDOC_CMD_ARRAY_TRIM:
         return do_list_op(op);
 
     case SUBDOC_CMD_INCREMENT:
@@ -655,6 +1758,22 @@ subdoc_op_exec(subdoc_OPERATION *op, const char *pth, size_t npth)
     case SUBDOC_CMD_DECREMENT_P:
         return do_arith_op(op);
 
+    case SUBDOC_CMD_INCREMENT_FLOAT:
+    case SUBDOC_CMD_INCREMENT_FLOAT_P:
+        return do_arith_float_op(op);
+
+    case SUBDOC_CMD_MULTI_INCREMENT:
+        return do_multi_arith_op(op);
+
+    case SUBDOC_CMD_PROJECT:
+        return do_project(op);
+
+    case SUBDOC_CMD_CANONICALIZE:
+        return do_canonicalize(op);
+
+    case SUBDOC_CMD_COMPACT:
+        return do_compact(op);
+
     default:
         return SUBDOC_STATUS_GLOBAL_ENOSUPPORT;
 
@@ -673,6 +1792,7 @@ subdoc_op_alloc(void)
     op->path = subdoc_path_alloc();
     op->jsn = subdoc_jsn_alloc();
     subdoc_string_init(&op->bkbuf_extra);
+    op->doc_new = op->doc_new_s;
 
     if (op->path == NULL || op->jsn == NULL) {
         if (op->path) {
@@ -687,6 +1807,30 @@ subdoc_op_alloc(void)
     return op;
 }
 
+subdoc_OPERATION *
+subdoc_op_init(void *storage, size_t size)
+{
+    subdoc_OP_STORAGE *st = (subdoc_OP_STORAGE *)storage;
+    subdoc_OPERATION *op;
+
+    /* The parser's stack runs on from jsn into jsn_levels */
+    static_assert(offsetof(subdoc_OP_STORAGE, jsn) + SUBDOC_JSN_SIZE <=
+        sizeof(subdoc_OP_STORAGE), "parser stack exceeds its storage");
+
+    if (size < sizeof(*st) || (uintptr_t)storage % alignof(subdoc_OP_STORAGE)) {
+        return NULL;
+    }
+    op = &st->op;
+    memset(op, 0, sizeof(*op));
+    memset(&st->path, 0, sizeof(st->path));
+    op->path = &st->path;
+    op->jsn = subdoc_jsn_init(&st->jsn);
+    subdoc_string_init(&op->bkbuf_extra);
+    op->doc_new = op->doc_new_s;
+    op->in_storage = 1;
+    return op;
+}
+
 void
 subdoc_op_clear(subdoc_OPERATION *op)
 {
@@ -695,8 +1839,11 @@ subdoc_op_clear(subdoc_OPERATION *op)
 
     op->user_in.length = 0;
     op->user_in.at = NULL;
+    op->doc_new = op->doc_new_s;
     op->doc_new_len = 0;
     op->optype = SUBDOC_CMD_GET;
+    op->multi = NULL;
+    op->nmulti = 0;
 
     memset(&op->match, 0, sizeof op->match);
 }
@@ -705,10 +1852,21 @@ void
 subdoc_op_free(subdoc_OPERATION *op)
 {
     subdoc_op_clear(op);
-    subdoc_path_free(op->path);
-    subdoc_jsn_free(op->jsn);
+    if (!op->in_storage) {
+        subdoc_path_free(op->path);
+        subdoc_jsn_free(op->jsn);
+    }
     subdoc_string_release(&op->bkbuf_extra);
-    free(op);
+    if (op->multi_ctx) {
+        size_t ii;
+        for (ii = 0; ii < SUBDOC_MULTI_MAX; ii++) {
+            subdoc_path_clear(&op->multi_ctx->paths[ii]);
+        }
+        free(op->multi_ctx);
+    }
+    if (!op->in_storage) {
+        free(op);
+    }
 }
 
 /* Misc */
@@ -736,6 +1894,8 @@ subdoc_strerror(subdoc_ERRORS rc)
         return "The combination of the existing number and the delta will result in an underflow or overflow";
     case SUBDOC_STATUS_VALUE_CANTINSERT:
         return "The new value cannot be inserted in the context of the path, as it would invalidate the JSON";
+    case SUBDOC_STATUS_DOC_E2BIG:
+        return "The document is too large to be parsed";
     case SUBDOC_STATUS_GLOBAL_ENOMEM:
         return "Couldn't allocate memory";
     case SUBDOC_STATUS_GLOBAL_ENOSUPPORT:
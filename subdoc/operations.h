@@ -3,12 +3,32 @@
 #include "subdoc-api.h"
 #include "path.h"
 #include "match.h"
+#include "hint.h"
+#include "timing.h"
+#include "sketch.h"
 #include "subdoc-util.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * A path for SUBDOC_CMD_MULTI_INCREMENT or SUBDOC_CMD_PROJECT
+ */
+typedef struct {
+    const char *path;
+    size_t npath;
+    /** Amount to add (MULTI_INCREMENT only). May be negative */
+    int64_t delta;
+    /** Output: status of this path */
+    subdoc_ERRORS status;
+    /** Output: the new value of a counter, or the projected value. Valid until
+     * the operation is next cleared or executed */
+    subdoc_LOC result;
+} subdoc_MULTI_SPEC;
+
+struct subdoc_MULTI_CTX_st;
+
 typedef struct {
     /* Private; malloc'd because this block is pretty big (several k) */
     subdoc_PATH *path;
@@ -21,23 +41,100 @@ typedef struct {
 
     /* Location of original document */
     subdoc_LOC doc_cur;
+    /* Set if the keys of every dictionary in doc_cur are sorted, as they are
+     * in the output of SUBDOC_CMD_CANONICALIZE. Missing keys are then found
+     * to be absent without scanning the rest of their dictionary, and
+     * dictionary insertions keep the keys sorted. Set along with the document
+     * by SUBDOC_OP_SETDOC_SORTED() */
+    int doc_sorted;
     /* Location of the user's "Value" (if applicable) */
     subdoc_LOC user_in;
-    /* Location of the fragments consisting of the _new_ value */
-    subdoc_LOC doc_new[8];
+    /* Location of the fragments consisting of the _new_ value. Usually points
+     * to doc_new_s; operations needing more fragments provide their own */
+    subdoc_LOC *doc_new;
     /* Number of fragments active */
     size_t doc_new_len;
+    subdoc_LOC doc_new_s[8];
 
     /* Backing buffer for any of our own (in-library) required storage */
     subdoc_STRING bkbuf_extra;
 
     /* Backing buffer for various tokens we might need to insert */
     char numbufs[32];
+
+    /* If greater than 1, GET and EXISTS scan large documents using this many
+     * threads (see subdoc_match_exec_parallel()). Not reset by
+     * subdoc_op_clear() */
+    unsigned scan_threads;
+
+    /* If set, ADD_UNIQUE compares elements by hash, and maintains this index
+     * of the target array's elements. A valid index for the same path and
+     * document (or the document produced by the last ADD_UNIQUE) allows values
+     * not already present to be added without parsing the array: the document
+     * is scanned only up to it, and the array's text digested to confirm it is
+     * unchanged. Any other mutating command clears the index. Not reset by
+     * subdoc_op_clear() */
+    subdoc_UNIQUE_INDEX *unique_index;
+
+    /* If set, GET, EXISTS and GET_COUNT first try the location recorded here
+     * (see subdoc_match_exec_hinted()), and record where they found the
+     * match. Useful when looking up the same path in many documents of the
+     * same layout. Not reset by subdoc_op_clear() */
+    subdoc_PATH_HINT *path_hint;
+
+    /* If set, the time spent in each phase of the operation is recorded here
+     * (see timing.h). Not reset by subdoc_op_clear() */
+    subdoc_OP_TIMINGS *timings;
+
+    /* If set, subdoc_op_exec() adds the cost of each operation (see
+     * subdoc_PATH_SKETCH::metric) to the total of its path here. Not reset
+     * by subdoc_op_clear() */
+    subdoc_PATH_SKETCH *path_sketch;
+
+    /* Paths for SUBDOC_CMD_MULTI_INCREMENT and SUBDOC_CMD_PROJECT */
+    subdoc_MULTI_SPEC *multi;
+    size_t nmulti;
+
+    /* Private; storage for multi-path commands, allocated on first use */
+    struct subdoc_MULTI_CTX_st *multi_ctx;
+
+    /* Private; set if created by subdoc_op_init() */
+    int in_storage;
 } subdoc_OPERATION;
 
+/**
+ * Storage for an operation created by subdoc_op_init(), holding the
+ * operation along with its path and parser (and the parser's stack).
+ * Declare one of these, or reserve SUBDOC_OP_STORAGE_SIZE suitably aligned
+ * bytes. The layout is private
+ */
+typedef struct {
+    subdoc_OPERATION op;
+    subdoc_PATH path;
+    struct jsonsl_st jsn;
+    struct jsonsl_state_st jsn_levels[COMPONENTS_ALLOC - 1];
+} subdoc_OP_STORAGE;
+
+#define SUBDOC_OP_STORAGE_SIZE sizeof(subdoc_OP_STORAGE)
+
 subdoc_OPERATION *
 subdoc_op_alloc(void);
 
+/**
+ * Create an operation in caller-provided storage, e.g. on the stack or
+ * inside a larger request structure, without allocating.
+ *
+ * @param storage at least SUBDOC_OP_STORAGE_SIZE bytes, aligned as a
+ *  subdoc_OP_STORAGE (as from malloc(), or by declaring one)
+ * @param size size of the storage
+ * @return the operation, or NULL if the storage is too small or misaligned.
+ *  It must still be released with subdoc_op_free(), which then frees only
+ *  the memory the operation allocated for itself (e.g. for a long document
+ *  path, or a multi-path command), leaving the storage to the caller
+ */
+subdoc_OPERATION *
+subdoc_op_init(void *storage, size_t size);
+
 void
 subdoc_op_clear(subdoc_OPERATION *);
 
@@ -56,6 +153,15 @@ SUBDOC_OP_SETDOC(subdoc_OPERATION *op, const char *doc, size_t ndoc)
 {
     op->doc_cur.at = doc;
     op->doc_cur.length = ndoc;
+    op->doc_sorted = 0;
+}
+
+/** Like SUBDOC_OP_SETDOC(), for a document whose dictionary keys are sorted */
+static inline void
+SUBDOC_OP_SETDOC_SORTED(subdoc_OPERATION *op, const char *doc, size_t ndoc)
+{
+    SUBDOC_OP_SETDOC(op, doc, ndoc);
+    op->doc_sorted = 1;
 }
 
 static inline void
@@ -64,9 +170,32 @@ SUBDOC_OP_SETCODE(subdoc_OPERATION *op, subdoc_OPTYPE code)
     op->optype = code;
 }
 
+/**
+ * Set the paths for SUBDOC_CMD_MULTI_INCREMENT or SUBDOC_CMD_PROJECT. At most
+ * SUBDOC_MULTI_MAX may be given. The path passed to subdoc_op_exec() is
+ * ignored.
+ */
+static inline void
+SUBDOC_OP_SETMULTI(subdoc_OPERATION *op, subdoc_MULTI_SPEC *specs, size_t nspecs)
+{
+    op->multi = specs;
+    op->nmulti = nspecs;
+}
+
 subdoc_ERRORS
 subdoc_op_exec(subdoc_OPERATION *op, const char *pth, size_t npth);
 
+/**
+ * Like subdoc_op_exec(), but does not parse a path. Instead, the path already
+ * loaded into `op->path` is used. This may have been populated by a previous
+ * call to subdoc_path_parse(), or directly from a precompiled path (see
+ * subdoc::static_path in subdoc-cxx.h).
+ *
+ * Note that subdoc_op_clear() also clears the path.
+ */
+subdoc_ERRORS
+subdoc_op_exec_compiled(subdoc_OPERATION *op);
+
 const char *
 subdoc_strerror(subdoc_ERRORS rc);
 
@@ -2,12 +2,31 @@
 #include "subdoc-api.h"
 #include "path.h"
 
+/* Returns storage for an unescaped key of at most `len` bytes. This is in the
+ * path itself if there is room; commit_key() then claims what was used */
 static char *
-convert_escaped(const char *src, size_t *len)
+alloc_key(subdoc_PATH *nj, size_t len)
+{
+    if (len <= sizeof(nj->keybuf) - nj->nkeybuf) {
+        return nj->keybuf + nj->nkeybuf;
+    }
+    return (char *)malloc(len);
+}
+
+static void
+commit_key(subdoc_PATH *nj, const char *key, size_t len)
+{
+    if (key >= nj->keybuf && key < nj->keybuf + sizeof(nj->keybuf)) {
+        nj->nkeybuf += len;
+    }
+}
+
+static char *
+convert_escaped(subdoc_PATH *nj, const char *src, size_t *len)
 {
     unsigned ii, oix;
 
-    char *ret = (char *)malloc(*len);
+    char *ret = alloc_key(nj, *len);
     if (!ret) {
         return NULL;
     }
@@ -20,16 +39,19 @@ convert_escaped(const char *src, size_t *len)
         }
     }
     *len = oix;
+    commit_key(nj, ret, oix);
     return ret;
 }
 
 static int
 add_component(subdoc_PATH *nj, const char *component, size_t len, int n_backtick)
 {
-    int has_numix = 0;
-    uint64_t numix;
+    int has_numix = 0, rv;
+    uint64_t numix = 0;
     struct jsonsl_jpr_component_st *jpr_comp;
     jsonsl_jpr_t jpr = &nj->jpr_base;
+    /* An unescaped '*' is a wildcard */
+    int is_wildcard = len == 1 && *component == '*';
 
     /* Allocate first component: */
     if (len > 1 && component[0] == '`' && component[len-1] == '`') {
@@ -66,7 +88,10 @@ add_component(subdoc_PATH *nj, const char *component, size_t len, int n_backtick
 
         /* end is a ']' */
         a_len--;
-        for (ii = 1, numix = 0; ii < a_len; ii++) {
+        if (a_len == 2 && component[len+1] == '*') {
+            has_numix = 2;
+        }
+        for (ii = 1, numix = 0; ii < a_len && has_numix == 1; ii++) {
             const char *c = component + len + ii;
             if (*c < 0x30 || *c > 0x39) {
                 if (ii == 1 && c[0] == '-') {
@@ -83,10 +108,18 @@ add_component(subdoc_PATH *nj, const char *component, size_t len, int n_backtick
         }
     }
 
-    if (len) {
+    if (is_wildcard) {
+        rv = subdoc_path_add_wildcard(nj);
+        if (rv != 0) {
+            return rv;
+        }
+    } else if (len) {
         if (n_backtick) {
             /* OHNOEZ! Slow path */
-            component = convert_escaped(component, &len);
+            component = convert_escaped(nj, component, &len);
+            if (component == NULL) {
+                return JSONSL_ERROR_ENOMEM;
+            }
         }
 
         jpr_comp = &nj->components_s[jpr->ncomponents];
@@ -98,7 +131,9 @@ add_component(subdoc_PATH *nj, const char *component, size_t len, int n_backtick
         jpr->ncomponents++;
     }
 
-    if (has_numix) {
+    if (has_numix == 2) {
+        return subdoc_path_add_wildcard(nj);
+    } else if (has_numix) {
         if (has_numix == -1) {
             numix = -1;
         }
@@ -133,15 +168,31 @@ subdoc_path_add_arrindex(subdoc_PATH *pth, size_t ixnum)
     return JSONSL_ERROR_SUCCESS;
 }
 
-/* So this should somehow give us a 'JPR' object.. */
-int subdoc_path_parse(subdoc_PATH *nj, const char *path, size_t len)
+jsonsl_error_t
+subdoc_path_add_wildcard(subdoc_PATH *pth)
 {
-    /* Path's buffers cannot change */
-    const char *c, *last, *path_end = path + len;
-    int in_escape = 0;
-    int n_backtick = 0;
-    int rv;
+    jsonsl_jpr_t jpr = &pth->jpr_base;
+    struct jsonsl_jpr_component_st *comp;
+
+    if (jpr->ncomponents == COMPONENTS_ALLOC) {
+        return JSONSL_ERROR_LEVELS_EXCEEDED;
+    }
 
+    comp = &jpr->components[jpr->ncomponents];
+    comp->ptype = JSONSL_PATH_WILDCARD;
+    comp->len = 0;
+    comp->is_arridx = 0;
+    comp->is_neg = 0;
+    comp->pstr = NULL;
+    jpr->ncomponents++;
+    pth->has_wildcard = 1;
+    return JSONSL_ERROR_SUCCESS;
+}
+
+/* Common setup for all syntaxes: a path consisting only of the root */
+static void
+init_path(subdoc_PATH *nj, const char *path, size_t len)
+{
     jsonsl_jpr_t jpr = &nj->jpr_base;
     jpr->components = nj->components_s;
     jpr->ncomponents = 0;
@@ -152,6 +203,281 @@ int subdoc_path_parse(subdoc_PATH *nj, const char *path, size_t len)
     jpr->components[0].ptype = JSONSL_PATH_ROOT;
     jpr->ncomponents++;
     nj->has_negix = 0;
+    nj->has_wildcard = 0;
+    nj->nkeybuf = 0;
+}
+
+/* Adds a dictionary key. `key` must remain valid for the life of the path */
+static int
+add_key(subdoc_PATH *nj, const char *key, size_t len)
+{
+    jsonsl_jpr_t jpr = &nj->jpr_base;
+    struct jsonsl_jpr_component_st *comp;
+
+    if (jpr->ncomponents == COMPONENTS_ALLOC) {
+        return JSONSL_ERROR_LEVELS_EXCEEDED;
+    }
+    comp = &nj->components_s[jpr->ncomponents];
+    comp->pstr = (char *)key;
+    comp->ptype = JSONSL_PATH_STRING;
+    comp->len = len;
+    comp->is_arridx = 0;
+    comp->is_neg = 0;
+    jpr->ncomponents++;
+    return 0;
+}
+
+/* Writes `c` as it appears within a JSON string; returns the bytes written */
+static size_t
+put_json_escaped(char *out, unsigned char c)
+{
+    static const char hexdigits[] = "0123456789abcdef";
+    char shortesc;
+
+    switch (c) {
+    case '"': shortesc = '"'; break;
+    case '\\': shortesc = '\\'; break;
+    case '\b': shortesc = 'b'; break;
+    case '\f': shortesc = 'f'; break;
+    case '\n': shortesc = 'n'; break;
+    case '\r': shortesc = 'r'; break;
+    case '\t': shortesc = 't'; break;
+    default:
+        if (c >= 0x20) {
+            *out = c;
+            return 1;
+        }
+        memcpy(out, "\\u00", 4);
+        out[4] = hexdigits[c >> 4];
+        out[5] = hexdigits[c & 0xf];
+        return 6;
+    }
+    out[0] = '\\';
+    out[1] = shortesc;
+    return 2;
+}
+
+static size_t
+json_escaped_size(unsigned char c)
+{
+    char tmp[6];
+    return put_json_escaped(tmp, c);
+}
+
+static char
+decode_pointer(const char **src)
+{
+    char c = *(*src)++;
+    if (c == '~') {
+        c = *(*src)++ == '0' ? '~' : '/';
+    }
+    return c;
+}
+
+static char
+decode_quoted(const char **src)
+{
+    if (**src == '\\') {
+        (*src)++;
+    }
+    return *(*src)++;
+}
+
+static char
+decode_none(const char **src)
+{
+    return *(*src)++;
+}
+
+/* Adds a key written in the escaping of the path syntax, which `decode` undoes
+ * one character at a time. Keys are matched against (and inserted as) raw
+ * document bytes, so the decoded key is stored escaped as it would be in JSON.
+ * Keys needing no change point into the path string itself */
+static int
+add_decoded_key(subdoc_PATH *nj, const char *src, const char *end,
+    char (*decode)(const char **))
+{
+    const char *c;
+    size_t len = 0, ii;
+    int changed = 0;
+    char *key;
+
+    for (c = src; c < end;) {
+        const char *prev = c;
+        size_t n = json_escaped_size(decode(&c));
+        changed |= n != 1 || c - prev != 1;
+        len += n;
+    }
+    if (!changed) {
+        return add_key(nj, src, end - src);
+    }
+
+    if (nj->jpr_base.ncomponents == COMPONENTS_ALLOC) {
+        return JSONSL_ERROR_LEVELS_EXCEEDED;
+    }
+    if ((key = alloc_key(nj, len)) == NULL) {
+        return JSONSL_ERROR_ENOMEM;
+    }
+    for (ii = 0, c = src; c < end;) {
+        ii += put_json_escaped(key + ii, decode(&c));
+    }
+    commit_key(nj, key, ii);
+    return add_key(nj, key, ii);
+}
+
+static int
+add_pointer_segment(subdoc_PATH *nj, const char *seg, size_t len)
+{
+    jsonsl_jpr_t jpr = &nj->jpr_base;
+    struct jsonsl_jpr_component_st *comp;
+    unsigned long idx = 0;
+    size_t ii;
+    int rv;
+
+    if ((rv = add_decoded_key(nj, seg, seg + len, decode_pointer)) != 0) {
+        return rv;
+    }
+
+    /* An array index is "0", or digits without a leading zero. Such a segment
+     * may also name a dictionary key, so is_arridx is left clear and the
+     * string is retained for jsonsl_jpr_match() */
+    comp = &jpr->components[jpr->ncomponents-1];
+    if (comp->pstr != seg || len == 0 || len > 19 || (len > 1 && seg[0] == '0')) {
+        return 0;
+    }
+    for (ii = 0; ii < len; ii++) {
+        if (seg[ii] < '0' || seg[ii] > '9') {
+            return 0;
+        }
+        idx = idx * 10 + (seg[ii] - '0');
+    }
+    comp->ptype = JSONSL_PATH_NUMERIC;
+    comp->idx = idx;
+    return 0;
+}
+
+int
+subdoc_path_parse_pointer(subdoc_PATH *nj, const char *path, size_t len)
+{
+    const char *c, *seg, *path_end = path + len;
+    int rv;
+
+    init_path(nj, path, len);
+    if (!len) {
+        return 0;
+    }
+    if (*path != '/') {
+        return JSONSL_ERROR_JPR_NOROOT;
+    }
+
+    for (seg = path + 1;; seg = c + 1) {
+        for (c = seg; c < path_end && *c != '/'; c++) {
+            if (*c == '~') {
+                if (c + 1 == path_end || (c[1] != '0' && c[1] != '1')) {
+                    return JSONSL_ERROR_JPR_BADPATH;
+                }
+                c++;
+            }
+        }
+        if ((rv = add_pointer_segment(nj, seg, c - seg)) != 0) {
+            return rv;
+        }
+        if (c == path_end) {
+            return 0;
+        }
+    }
+}
+
+/* Parses a quoted JSONPath key starting at the quote `c`. On success, returns
+ * the position after the closing quote */
+static const char *
+add_quoted_key(subdoc_PATH *nj, const char *c, const char *path_end, int *rv)
+{
+    const char quote = *c;
+    const char *begin = ++c;
+
+    for (; c < path_end && *c != quote; c++) {
+        if (*c == '\\' && ++c == path_end) {
+            break;
+        }
+    }
+    if (c == path_end) {
+        *rv = JSONSL_ERROR_JPR_BADPATH;
+        return NULL;
+    }
+    *rv = add_decoded_key(nj, begin, c, decode_quoted);
+    return c + 1;
+}
+
+int
+subdoc_path_parse_jsonpath(subdoc_PATH *nj, const char *path, size_t len)
+{
+    const char *c, *path_end = path + len;
+    int rv = 0;
+
+    init_path(nj, path, len);
+    if (!len || *path != '$') {
+        return JSONSL_ERROR_JPR_NOROOT;
+    }
+
+    for (c = path + 1; c < path_end && rv == 0;) {
+        if (*c == '.') {
+            const char *begin = ++c;
+            while (c < path_end && *c != '.' && *c != '[') {
+                c++;
+            }
+            if (c == begin) {
+                return JSONSL_ERROR_JPR_BADPATH;
+            } else if (c - begin == 1 && *begin == '*') {
+                rv = subdoc_path_add_wildcard(nj);
+            } else {
+                rv = add_decoded_key(nj, begin, c, decode_none);
+            }
+
+        } else if (*c != '[' || ++c == path_end) {
+            return JSONSL_ERROR_JPR_BADPATH;
+
+        } else if (*c == '\'' || *c == '"') {
+            if ((c = add_quoted_key(nj, c, path_end, &rv)) == NULL) {
+                return rv;
+            }
+            if (c == path_end || *c++ != ']') {
+                return JSONSL_ERROR_JPR_BADPATH;
+            }
+
+        } else if (path_end - c >= 2 && c[0] == '*' && c[1] == ']') {
+            rv = subdoc_path_add_wildcard(nj);
+            c += 2;
+
+        } else if (path_end - c >= 3 && c[0] == '-' && c[1] == '1' && c[2] == ']') {
+            rv = subdoc_path_add_arrindex(nj, -1);
+            c += 3;
+
+        } else {
+            unsigned long idx = 0;
+            const char *begin = c;
+            for (; c < path_end && *c >= '0' && *c <= '9'; c++) {
+                idx = idx * 10 + (*c - '0');
+            }
+            if (c == begin || c - begin > 19 || c == path_end || *c++ != ']') {
+                return JSONSL_ERROR_JPR_BADPATH;
+            }
+            rv = subdoc_path_add_arrindex(nj, idx);
+        }
+    }
+    return rv;
+}
+
+/* So this should somehow give us a 'JPR' object.. */
+int subdoc_path_parse(subdoc_PATH *nj, const char *path, size_t len)
+{
+    /* Path's buffers cannot change */
+    const char *c, *last, *path_end = path + len;
+    int in_escape = 0;
+    int n_backtick = 0;
+    int rv;
+
+    init_path(nj, path, len);
 
     if (!len) {
         return 0;
@@ -202,7 +528,9 @@ subdoc_path_clear(subdoc_PATH *nj)
         struct jsonsl_jpr_component_st *comp = &jpr->components[ii];
         if (comp->pstr == NULL) {
             /* nop */
-        } else if (comp->pstr >= jpr->orig && comp->pstr < (jpr->orig + jpr->norig)) {
+        } else if (comp->pstr >= jpr->orig && comp->pstr <= (jpr->orig + jpr->norig)) {
+            /* nop; an empty final key points to the end of the path */
+        } else if (comp->pstr >= nj->keybuf && comp->pstr < nj->keybuf + sizeof(nj->keybuf)) {
             /* nop */
         } else {
             free(comp->pstr);
@@ -9,17 +9,42 @@ extern "C" {
 #endif
 
 #define COMPONENTS_ALLOC 32
+#define SUBDOC_PATH_KEYBUF 256
 typedef struct subdoc_PATH_st {
     struct jsonsl_jpr_st jpr_base;
     struct jsonsl_jpr_component_st components_s[COMPONENTS_ALLOC];
     int has_negix; /* True if there is a negative array index in the path */
+    int has_wildcard; /* True if any component is a wildcard ("*" or "[*]") */
+    /* Unescaped keys are stored here; only those which don't fit are malloc'd */
+    char keybuf[SUBDOC_PATH_KEYBUF];
+    size_t nkeybuf;
 } subdoc_PATH;
 
 struct subdoc_PATH_st *subdoc_path_alloc(void);
 void subdoc_path_free(struct subdoc_PATH_st*);
 void subdoc_path_clear(struct subdoc_PATH_st*);
 int subdoc_path_parse(struct subdoc_PATH_st *nj, const char *path, size_t len);
+
+/**
+ * Parse an RFC 6901 JSON Pointer, e.g. "/foo/0/a~1b". Numeric segments match
+ * either an array index or a dictionary key of the same text. "-" is treated
+ * as an ordinary key. Once "~0" and "~1" are decoded, a '"', '\\' or control
+ * character in a key is stored JSON-escaped, as keys are compared with (and
+ * inserted as) raw document bytes.
+ */
+int subdoc_path_parse_pointer(struct subdoc_PATH_st *nj, const char *path, size_t len);
+
+/**
+ * Parse a simple JSONPath expression: "$" followed by any number of ".key",
+ * "['key']" (or double quoted, with backslash escapes) and "[index]"
+ * components. As with subdoc_path_parse(), "[-1]" is the last element, and
+ * ".*" or "[*]" is a wildcard. Keys are stored JSON-escaped, as for
+ * subdoc_path_parse_pointer().
+ */
+int subdoc_path_parse_jsonpath(struct subdoc_PATH_st *nj, const char *path, size_t len);
 jsonsl_error_t subdoc_path_add_arrindex(subdoc_PATH *pth, size_t ixnum);
+/** Add a component matching any dictionary key or array element */
+jsonsl_error_t subdoc_path_add_wildcard(subdoc_PATH *pth);
 #define subdoc_path_pop_component(pth) do { \
     (pth)->jpr_base.ncomponents--; \
 } while (0);
@@ -0,0 +1,48 @@
+#ifndef SUBDOC_PROBES_H
+#define SUBDOC_PROBES_H
+
+/**
+ * Static tracepoints (USDT) under the provider name "subjson", for use with
+ * bpftrace, perf or SystemTap. See README.md for an example.
+ *
+ * Compiled in when SUBDOC_USDT is defined (cmake -DSUBJSON_USDT=ON) and
+ * <sys/sdt.h> is available. Each probe is then a single nop plus an ELF note
+ * describing where its arguments (all values already at hand) are found, so
+ * there is no runtime dependency and no cost beyond the nop while no tracer
+ * is attached. Otherwise the probes compile to nothing.
+ *
+ * Probes and their arguments:
+ *
+ * op__start(opcode, path, npath, doclen)
+ * op__done(opcode, path, npath, doclen, bytes_scanned, status)
+ *      Around subdoc_op_exec() and subdoc_op_exec_compiled(). `path` is
+ *      NULL for the latter. `bytes_scanned` is subdoc_MATCH::bytes_scanned
+ *
+ * match__done(opcode, matchres, match_level, doclen, bytes_scanned)
+ *      After each lookup of the path in the document
+ *
+ * validate__fail(opcode, value, nvalue, jsonsl_error)
+ *      When the user's value is rejected as not being valid JSON
+ */
+
+#if defined(SUBDOC_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SUBDOC_HAVE_USDT
+#endif
+#endif
+
+#ifdef SUBDOC_HAVE_USDT
+#define SUBDOC_PROBE4(name, a1, a2, a3, a4) \
+    DTRACE_PROBE4(subjson, name, a1, a2, a3, a4)
+#define SUBDOC_PROBE5(name, a1, a2, a3, a4, a5) \
+    DTRACE_PROBE5(subjson, name, a1, a2, a3, a4, a5)
+#define SUBDOC_PROBE6(name, a1, a2, a3, a4, a5, a6) \
+    DTRACE_PROBE6(subjson, name, a1, a2, a3, a4, a5, a6)
+#else
+#define SUBDOC_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#define SUBDOC_PROBE5(name, a1, a2, a3, a4, a5) do {} while (0)
+#define SUBDOC_PROBE6(name, a1, a2, a3, a4, a5, a6) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,430 @@
+/* Speculative parallel scanning of a single large document.
+ *
+ * The only state a chunk needs from its predecessors is whether it begins
+ * inside a string, and at which nesting depth. The former has only two
+ * possible values, so each worker scans its chunk under both assumptions and
+ * records where each one leads. A cheap serial pass then chains these
+ * summaries together, after which each worker knows the true state at its own
+ * start and can index the top-level container. See pscan.h */
+
+#include "pscan.h"
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+const size_t NPOS = (size_t)-1;
+
+struct Chunk {
+    size_t begin = 0;
+    size_t end = 0;
+
+    /* Pass 1 results, indexed by the assumed initial string state */
+    bool end_in_str[2] = { false, false };
+    long depth_delta[2] = { 0, 0 };
+
+    /* Actual state at `begin`, established by the prefix pass */
+    bool start_in_str = false;
+    long start_depth = 0;
+
+    /* Pass 2 results */
+    size_t ncommas = 0; /* Separators of the top-level container */
+    size_t key_at = NPOS; /* Opening quote of the first matching key */
+};
+
+struct Scan {
+    const char *buf;
+    size_t nbuf;
+    /* Top-level key to locate, if the root is an object */
+    const char *key;
+    size_t nkey;
+    std::vector<Chunk> chunks;
+};
+
+inline bool
+is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+size_t
+skip_ws(const char *buf, size_t nbuf, size_t pos)
+{
+    while (pos < nbuf && is_ws(buf[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+/* Whether the character at `pos` is escaped, assuming it is inside a string */
+bool
+escaped_at(const char *buf, size_t pos)
+{
+    size_t nslashes = 0;
+    while (nslashes < pos && buf[pos - nslashes - 1] == '\\') {
+        nslashes++;
+    }
+    return nslashes % 2;
+}
+
+/* Returns the offset of the quote closing the string opened at `pos` */
+size_t
+string_end(const char *buf, size_t nbuf, size_t pos)
+{
+    for (pos++; pos < nbuf; pos++) {
+        if (buf[pos] == '\\') {
+            pos++;
+        } else if (buf[pos] == '"') {
+            return pos;
+        }
+    }
+    return nbuf;
+}
+
+/* Returns the offset one past the last non-whitespace character of the value
+ * beginning at `pos`, which must be a child of the top-level container */
+size_t
+value_end(const char *buf, size_t nbuf, size_t pos)
+{
+    long depth = 0;
+    size_t last = pos;
+
+    for (; pos < nbuf; pos++) {
+        char ch = buf[pos];
+        if (ch == '"') {
+            last = pos = string_end(buf, nbuf, pos);
+            continue;
+        }
+        if (depth == 0 && (ch == ',' || ch == '}' || ch == ']')) {
+            break;
+        }
+        if (ch == '{' || ch == '[') {
+            depth++;
+        } else if (ch == '}' || ch == ']') {
+            depth--;
+        }
+        if (!is_ws(ch)) {
+            last = pos;
+        }
+    }
+    return last + 1;
+}
+
+/* Pass 1: summarize the chunk under both possible initial string states */
+void
+scan_speculative(Scan *scan, size_t ix)
+{
+    Chunk& c = scan->chunks[ix];
+    const char *buf = scan->buf;
+
+    for (int assume = 0; assume < 2; assume++) {
+        bool in_str = assume;
+        bool esc = in_str && escaped_at(buf, c.begin);
+        long depth = 0;
+
+        for (size_t pos = c.begin; pos < c.end; pos++) {
+            char ch = buf[pos];
+            if (in_str) {
+                if (esc) {
+                    esc = false;
+                } else if (ch == '\\') {
+                    esc = true;
+                } else if (ch == '"') {
+                    in_str = false;
+                }
+                continue;
+            }
+            switch (ch) {
+            case '"':
+                in_str = true;
+                break;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                break;
+            }
+        }
+        c.end_in_str[assume] = in_str;
+        c.depth_delta[assume] = depth;
+    }
+}
+
+/* Pass 2: count top-level separators, and find the first matching top-level
+ * key whose opening quote lies within this chunk. If `stop_after` is not NPOS,
+ * instead return the offset of that (0-based) separator */
+size_t
+scan_known(Scan *scan, size_t ix, size_t stop_after = NPOS)
+{
+    Chunk& c = scan->chunks[ix];
+    const char *buf = scan->buf;
+    bool in_str = c.start_in_str;
+    bool esc = in_str && escaped_at(buf, c.begin);
+    long depth = c.start_depth;
+    size_t ncommas = 0;
+    bool want_key = scan->key != NULL && stop_after == NPOS;
+
+    for (size_t pos = c.begin; pos < c.end; pos++) {
+        char ch = buf[pos];
+        if (in_str) {
+            if (esc) {
+                esc = false;
+            } else if (ch == '\\') {
+                esc = true;
+            } else if (ch == '"') {
+                in_str = false;
+            }
+            continue;
+        }
+        switch (ch) {
+        case '"':
+            if (depth == 1 && want_key) {
+                /* Strings are owned by the chunk containing their opening
+                 * quote, so the key may extend past the end of the chunk */
+                size_t close = string_end(buf, scan->nbuf, pos);
+                if (close - pos - 1 == scan->nkey &&
+                        memcmp(buf + pos + 1, scan->key, scan->nkey) == 0) {
+                    size_t next = skip_ws(buf, scan->nbuf, close + 1);
+                    if (next < scan->nbuf && buf[next] == ':') {
+                        c.key_at = pos;
+                        want_key = false;
+                    }
+                }
+                pos = close;
+            } else {
+                in_str = true;
+            }
+            break;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            depth--;
+            break;
+        case ',':
+            if (depth == 1) {
+                if (ncommas == stop_after) {
+                    return pos;
+                }
+                ncommas++;
+            }
+            break;
+        }
+    }
+    c.ncommas = ncommas;
+    return NPOS;
+}
+
+void
+run_parallel(Scan *scan, void (*fn)(Scan *, size_t))
+{
+    std::vector<std::thread> threads;
+    size_t ii;
+
+    for (ii = 1; ii < scan->chunks.size(); ii++) {
+        try {
+            threads.push_back(std::thread(fn, scan, ii));
+        } catch (std::exception&) {
+            break;
+        }
+    }
+    /* Any chunks which could not get a thread of their own are done here */
+    for (size_t jj = ii; jj < scan->chunks.size(); jj++) {
+        fn(scan, jj);
+    }
+    fn(scan, 0);
+    for (ii = 0; ii < threads.size(); ii++) {
+        threads[ii].join();
+    }
+}
+
+void
+scan_known_worker(Scan *scan, size_t ix)
+{
+    scan_known(scan, ix);
+}
+
+} // namespace
+
+int
+subdoc_match_exec_parallel(const char *value, size_t nvalue,
+    const subdoc_PATH *pth, jsonsl_t jsn, subdoc_MATCH *result,
+    unsigned nthreads)
+{
+    const struct jsonsl_jpr_st *jpr = &pth->jpr_base;
+    const struct jsonsl_jpr_component_st *first = &jpr->components[1];
+    size_t nchunks, root_begin, root_end, total, ii;
+    size_t elem_begin, elem_end, position = 0, ncommas = 0;
+    subdoc_LOC loc_key = { NULL, 0 };
+    subdoc_LOC bufs[3];
+    subdoc_PATH tmp;
+    bool in_str = false;
+    long depth = 0;
+    Scan scan;
+
+    if (nvalue > SUBDOC_DOC_MAX) {
+        result->status = SUBDOC_VALIDATE_E2BIG;
+        return 0;
+    }
+    if (nthreads == 0) {
+        nthreads = std::thread::hardware_concurrency();
+    }
+    nchunks = std::min<size_t>(nthreads, nvalue / SUBDOC_PSCAN_MIN_CHUNK);
+
+    if (nchunks < 2 || jpr->ncomponents < 2 ||
+            result->get_last_child_pos || result->ensure_unique.at) {
+        goto GT_SERIAL;
+    }
+    for (ii = 2; ii < jpr->ncomponents; ii++) {
+        if (jpr->components[ii].is_neg) {
+            goto GT_SERIAL;
+        }
+    }
+
+    root_begin = skip_ws(value, nvalue, 0);
+    root_end = nvalue;
+    while (root_end > root_begin && is_ws(value[root_end - 1])) {
+        root_end--;
+    }
+    if (root_end - root_begin < 2) {
+        goto GT_SERIAL;
+    }
+    root_end--; /* Offset of the closing bracket */
+
+    if (value[root_begin] == '[' && value[root_end] == ']' &&
+            first->ptype == JSONSL_PATH_NUMERIC) {
+        scan.key = NULL;
+        scan.nkey = 0;
+    } else if (value[root_begin] == '{' && value[root_end] == '}' &&
+            first->ptype == JSONSL_PATH_STRING) {
+        scan.key = first->pstr;
+        scan.nkey = first->len;
+    } else {
+        goto GT_SERIAL;
+    }
+    if (skip_ws(value, nvalue, root_begin + 1) == root_end) {
+        /* Empty container */
+        goto GT_SERIAL;
+    }
+
+    scan.buf = value;
+    scan.nbuf = nvalue;
+    scan.chunks.resize(nchunks);
+    for (ii = 0; ii < nchunks; ii++) {
+        scan.chunks[ii].begin = (nvalue * ii) / nchunks;
+        scan.chunks[ii].end = (nvalue * (ii + 1)) / nchunks;
+    }
+
+    run_parallel(&scan, scan_speculative);
+
+    for (ii = 0; ii < nchunks; ii++) {
+        Chunk& c = scan.chunks[ii];
+        c.start_in_str = in_str;
+        c.start_depth = depth;
+        depth += c.depth_delta[in_str];
+        in_str = c.end_in_str[in_str];
+    }
+    if (in_str || depth != 0) {
+        /* Not well-formed; let the parser report it */
+        goto GT_SERIAL;
+    }
+
+    run_parallel(&scan, scan_known_worker);
+
+    for (ii = 0, total = 1; ii < nchunks; ii++) {
+        total += scan.chunks[ii].ncommas;
+    }
+
+    if (scan.key == NULL) {
+        position = first->is_neg ? total - 1 : first->idx;
+        if (position >= total) {
+            goto GT_NOTFOUND;
+        }
+        if (position == 0) {
+            elem_begin = root_begin + 1;
+        } else {
+            /* Find the chunk containing the separator preceding the element */
+            for (ii = 0; ncommas + scan.chunks[ii].ncommas < position; ii++) {
+                ncommas += scan.chunks[ii].ncommas;
+            }
+            elem_begin = scan_known(&scan, ii, position - ncommas - 1) + 1;
+        }
+    } else {
+        ii = 0;
+        while (ii < nchunks && scan.chunks[ii].key_at == NPOS) {
+            ii++;
+        }
+        if (ii == nchunks) {
+            goto GT_NOTFOUND;
+        }
+        loc_key.at = value + scan.chunks[ii].key_at;
+        loc_key.length = string_end(value, nvalue, scan.chunks[ii].key_at);
+        loc_key.length -= scan.chunks[ii].key_at - 1;
+        elem_begin = skip_ws(value, nvalue,
+            scan.chunks[ii].key_at + loc_key.length) + 1;
+    }
+
+    elem_begin = skip_ws(value, root_end, elem_begin);
+    elem_end = value_end(value, root_end, elem_begin);
+    if (elem_begin >= root_end || elem_end > root_end) {
+        goto GT_SERIAL;
+    }
+
+    /* Match the rest of the path within the element alone, by presenting it
+     * to the parser as the sole item of a top-level array. This keeps the
+     * levels (and thus the path length) the same as in the full document. */
+    tmp.jpr_base = *jpr;
+    tmp.jpr_base.components = tmp.components_s;
+    tmp.has_negix = 0;
+    tmp.has_wildcard = 0;
+    memcpy(tmp.components_s, jpr->components,
+        sizeof(tmp.components_s[0]) * jpr->ncomponents);
+    tmp.components_s[1].ptype = JSONSL_PATH_NUMERIC;
+    tmp.components_s[1].pstr = NULL;
+    tmp.components_s[1].len = 0;
+    tmp.components_s[1].idx = 0;
+    tmp.components_s[1].is_arridx = 1;
+    tmp.components_s[1].is_neg = 0;
+
+    bufs[0].at = "[";
+    bufs[0].length = 1;
+    bufs[1].at = value + elem_begin;
+    bufs[1].length = elem_end - elem_begin;
+    bufs[2].at = "]";
+    bufs[2].length = 1;
+    subdoc_match_exec_bufs(bufs, 3, &tmp, jsn, result);
+
+    if (jpr->ncomponents == 2 && result->status == JSONSL_ERROR_SUCCESS) {
+        /* The immediate parent is the real top-level container */
+        result->loc_parent.at = value + root_begin;
+        result->loc_parent.length = root_end - root_begin + 1;
+        result->immediate_parent_found = 1;
+        result->num_siblings = total - 1;
+        result->has_key = scan.key != NULL;
+        result->loc_key = loc_key;
+    }
+    return 0;
+
+    GT_NOTFOUND:
+    /* Same as the parser reports when the top-level container is the deepest
+     * match */
+    result->status = JSONSL_ERROR_SUCCESS;
+    result->matchres = JSONSL_MATCH_POSSIBLE;
+    result->match_level = 1;
+    result->type = scan.key ? JSONSL_T_OBJECT : JSONSL_T_LIST;
+    result->loc_parent.at = value + root_begin;
+    result->loc_parent.length = root_end - root_begin + 1;
+    result->num_siblings = (unsigned)total;
+    result->immediate_parent_found = jpr->ncomponents == 2;
+    return 0;
+
+    GT_SERIAL:
+    return subdoc_match_exec(value, nvalue, pth, jsn, result);
+}
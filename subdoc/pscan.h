@@ -0,0 +1,48 @@
+#ifndef SUBDOC_PSCAN_H
+#define SUBDOC_PSCAN_H
+
+#include "match.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Minimum number of bytes each worker of subdoc_match_exec_parallel() should
+ * scan. Smaller documents (or those which would yield fewer than two such
+ * chunks) are scanned serially.
+ */
+#define SUBDOC_PSCAN_MIN_CHUNK (256 * 1024)
+
+/**
+ * Like subdoc_match_exec(), but splits a large document into chunks which are
+ * scanned by `nthreads` threads (the calling thread being one of them).
+ *
+ * Each worker first determines, for both possible starting states (inside or
+ * outside a string), where its chunk leaves the string state and how much it
+ * changes the nesting depth. A serial prefix pass over these summaries yields
+ * the true state at the start of every chunk. The workers then count the
+ * separators and locate the keys of the top-level container, which is enough
+ * to find the top-level element named by the first path component. Only that
+ * element is then handed to the regular parser, along with the rest of the
+ * path.
+ *
+ * The parallel scan does not validate the parts of the document outside the
+ * target element. Paths it cannot resolve this way (e.g. the root path, a
+ * missing top-level key, a first component not matching the root type, or
+ * negative indices past the first component) are matched serially, as are
+ * requests for `get_last_child_pos` or `ensure_unique`. The result is the
+ * same as subdoc_match_exec() would produce for a well-formed document.
+ *
+ * @param nthreads Number of threads to use. If 0, the number of hardware
+ *        threads is used
+ */
+int
+subdoc_match_exec_parallel(const char *value, size_t nvalue,
+    const subdoc_PATH *pth, jsonsl_t jsn, subdoc_MATCH *result,
+    unsigned nthreads);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,259 @@
+/* Space-Saving sketch of path costs. See sketch.h */
+
+#include "sketch.h"
+#include "unique.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+
+namespace {
+
+bool
+heavier(const subdoc_SKETCH_ENTRY& a, const subdoc_SKETCH_ENTRY& b)
+{
+    return a.weight > b.weight;
+}
+
+bool
+same_path(const subdoc_SKETCH_ENTRY *e, uint64_t hash, const char *path,
+    size_t npath)
+{
+    return e->hash == hash && e->npath == npath &&
+            memcmp(e->path, path,
+                std::min<size_t>(npath, SUBDOC_SKETCH_PATHMAX)) == 0;
+}
+
+/* Returns the index slot of the entry for `path`, or the empty slot where it
+ * belongs */
+size_t
+find_slot(const subdoc_PATH_SKETCH *s, uint64_t hash, const char *path,
+    size_t npath)
+{
+    size_t mask = s->nindex - 1;
+    size_t ix = hash & mask;
+    while (s->index[ix] != 0 &&
+            !same_path(&s->entries[s->index[ix] - 1], hash, path, npath)) {
+        ix = (ix + 1) & mask;
+    }
+    return ix;
+}
+
+size_t
+find_entry_slot(const subdoc_PATH_SKETCH *s, const subdoc_SKETCH_ENTRY *e)
+{
+    return find_slot(s, e->hash, e->path, e->npath);
+}
+
+/* Empty a slot, moving any following entries displaced past it back so that
+ * lookups don't need tombstones */
+void
+unlink_slot(subdoc_PATH_SKETCH *s, size_t hole)
+{
+    size_t mask = s->nindex - 1;
+    size_t ix = hole;
+
+    for (;;) {
+        size_t home;
+        ix = (ix + 1) & mask;
+        if (s->index[ix] == 0) {
+            break;
+        }
+        home = s->entries[s->index[ix] - 1].hash & mask;
+        /* Move it unless its home lies cyclically in (hole, ix] */
+        if (hole <= ix ? (home <= hole || home > ix) : (home <= hole && home > ix)) {
+            s->index[hole] = s->index[ix];
+            hole = ix;
+        }
+    }
+    s->index[hole] = 0;
+}
+
+subdoc_SKETCH_ENTRY *
+lightest(subdoc_PATH_SKETCH *s)
+{
+    subdoc_SKETCH_ENTRY *min = &s->entries[0];
+    for (size_t ii = 1; ii < s->nentries; ii++) {
+        if (s->entries[ii].weight < min->weight) {
+            min = &s->entries[ii];
+        }
+    }
+    return min;
+}
+
+/* Weight which every path absent from a full sketch may have */
+uint64_t
+absent_weight(const subdoc_PATH_SKETCH *s)
+{
+    if (s->nentries < s->capacity) {
+        return 0;
+    }
+    return std::min_element(s->entries, s->entries + s->nentries,
+        [](const subdoc_SKETCH_ENTRY& a, const subdoc_SKETCH_ENTRY& b) {
+            return a.weight < b.weight;
+        })->weight;
+}
+
+} // namespace
+
+subdoc_PATH_SKETCH *
+subdoc_sketch_alloc(size_t capacity, subdoc_SKETCH_METRIC metric)
+{
+    subdoc_PATH_SKETCH *s;
+
+    if (capacity == 0 || capacity > UINT32_MAX / 4) {
+        return NULL;
+    }
+    s = (subdoc_PATH_SKETCH *)calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return NULL;
+    }
+    /* Keep the index at most half full */
+    for (s->nindex = 2; s->nindex < capacity * 2; s->nindex *= 2) {
+    }
+    s->capacity = capacity;
+    s->metric = metric;
+    s->entries = (subdoc_SKETCH_ENTRY *)calloc(capacity, sizeof(*s->entries));
+    s->index = (uint32_t *)calloc(s->nindex, sizeof(*s->index));
+    if (s->entries == NULL || s->index == NULL) {
+        subdoc_sketch_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void
+subdoc_sketch_free(subdoc_PATH_SKETCH *s)
+{
+    free(s->entries);
+    free(s->index);
+    free(s);
+}
+
+void
+subdoc_sketch_clear(subdoc_PATH_SKETCH *s)
+{
+    memset(s->index, 0, sizeof(*s->index) * s->nindex);
+    s->nentries = 0;
+    s->total = 0;
+}
+
+void
+subdoc_sketch_add(subdoc_PATH_SKETCH *s, const char *path, size_t npath,
+    uint64_t weight)
+{
+    uint64_t hash = subdoc_unique_hash(path, npath);
+    size_t ix = find_slot(s, hash, path, npath);
+    subdoc_SKETCH_ENTRY *e;
+
+    s->total += weight;
+    if (s->index[ix] != 0) {
+        e = &s->entries[s->index[ix] - 1];
+        e->weight += weight;
+        e->count++;
+        return;
+    }
+
+    if (s->nentries < s->capacity) {
+        e = &s->entries[s->nentries++];
+        e->weight = weight;
+        e->error = 0;
+        e->count = 1;
+    } else {
+        /* Replace the lightest path. The newcomer may have been it, so it
+         * inherits its weight as the possible error */
+        e = lightest(s);
+        unlink_slot(s, find_entry_slot(s, e));
+        ix = find_slot(s, hash, path, npath);
+        e->error = e->weight;
+        e->weight += weight;
+        e->count++;
+    }
+    e->hash = hash;
+    e->npath = npath;
+    memcpy(e->path, path, std::min<size_t>(npath, SUBDOC_SKETCH_PATHMAX));
+    s->index[ix] = (uint32_t)(e - s->entries) + 1;
+}
+
+int
+subdoc_sketch_merge(subdoc_PATH_SKETCH *dst, const subdoc_PATH_SKETCH *src)
+{
+    std::vector<subdoc_SKETCH_ENTRY> all;
+    uint64_t dst_absent = absent_weight(dst);
+    uint64_t src_absent = absent_weight(src);
+    size_t ii;
+
+    try {
+        all.reserve(dst->nentries + src->nentries);
+    } catch (std::bad_alloc&) {
+        return -1;
+    }
+
+    /* A path missing from one side may have had up to that side's absent
+     * weight there */
+    for (ii = 0; ii < dst->nentries; ii++) {
+        subdoc_SKETCH_ENTRY e = dst->entries[ii];
+        uint32_t six = src->index[find_entry_slot(src, &e)];
+        if (six != 0) {
+            const subdoc_SKETCH_ENTRY& other = src->entries[six - 1];
+            e.weight += other.weight;
+            e.error += other.error;
+            e.count += other.count;
+        } else {
+            e.weight += src_absent;
+            e.error += src_absent;
+        }
+        all.push_back(e);
+    }
+    for (ii = 0; ii < src->nentries; ii++) {
+        subdoc_SKETCH_ENTRY e = src->entries[ii];
+        if (dst->index[find_entry_slot(dst, &e)] != 0) {
+            continue;
+        }
+        e.weight += dst_absent;
+        e.error += dst_absent;
+        all.push_back(e);
+    }
+
+    if (all.size() > dst->capacity) {
+        std::partial_sort(all.begin(), all.begin() + dst->capacity, all.end(),
+            heavier);
+        all.resize(dst->capacity);
+    }
+
+    memset(dst->index, 0, sizeof(*dst->index) * dst->nindex);
+    dst->nentries = all.size();
+    for (ii = 0; ii < all.size(); ii++) {
+        dst->entries[ii] = all[ii];
+        dst->index[find_entry_slot(dst, &all[ii])] = (uint32_t)ii + 1;
+    }
+    dst->total += src->total;
+    return 0;
+}
+
+size_t
+subdoc_sketch_top(const subdoc_PATH_SKETCH *s, subdoc_SKETCH_ENTRY *out,
+    size_t nout)
+{
+    std::vector<const subdoc_SKETCH_ENTRY *> order;
+    size_t ii;
+
+    nout = std::min(nout, s->nentries);
+    try {
+        order.resize(s->nentries);
+    } catch (std::bad_alloc&) {
+        return 0;
+    }
+    for (ii = 0; ii < s->nentries; ii++) {
+        order[ii] = &s->entries[ii];
+    }
+    std::partial_sort(order.begin(), order.begin() + nout, order.end(),
+        [](const subdoc_SKETCH_ENTRY *a, const subdoc_SKETCH_ENTRY *b) {
+            return heavier(*a, *b);
+        });
+    for (ii = 0; ii < nout; ii++) {
+        out[ii] = *order[ii];
+    }
+    return nout;
+}
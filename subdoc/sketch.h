@@ -0,0 +1,93 @@
+#ifndef SUBDOC_SKETCH_H
+#define SUBDOC_SKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Paths longer than this are truncated in the sketch (but hashed in full) */
+#define SUBDOC_SKETCH_PATHMAX 96
+
+/** What a sketch attached to an operation measures */
+typedef enum {
+    /** subdoc_MATCH::bytes_scanned */
+    SUBDOC_SKETCH_BYTES,
+    /** subdoc_cycles() spent in subdoc_op_exec() */
+    SUBDOC_SKETCH_CYCLES
+} subdoc_SKETCH_METRIC;
+
+typedef struct {
+    uint64_t hash;
+    /** Total cost of the path. Overestimated by at most #error */
+    uint64_t weight;
+    uint64_t error;
+    /** Number of operations counted, including those of any lighter path
+     * this entry replaced */
+    uint64_t count;
+    /** Length of the path. Only the first SUBDOC_SKETCH_PATHMAX bytes are
+     * kept in #path */
+    size_t npath;
+    char path[SUBDOC_SKETCH_PATHMAX];
+} subdoc_SKETCH_ENTRY;
+
+/**
+ * Space-Saving sketch of the paths with the greatest total cost. With a
+ * capacity of k, any path costing more than 1/k of the total is guaranteed
+ * to be present, and each entry's weight is within #error of its true total.
+ *
+ * A sketch has no locking; give each thread its own (e.g. attached to its
+ * subdoc_OPERATION via subdoc_OPERATION::path_sketch), and combine them
+ * with subdoc_sketch_merge() once the threads have finished with them.
+ */
+typedef struct {
+    subdoc_SKETCH_METRIC metric;
+    /** Sum of every weight added */
+    uint64_t total;
+    /* Private */
+    subdoc_SKETCH_ENTRY *entries;
+    size_t nentries;
+    size_t capacity;
+    /* Open-addressed table of entry indexes (plus one) by hash */
+    uint32_t *index;
+    size_t nindex;
+} subdoc_PATH_SKETCH;
+
+/** Allocate a sketch tracking up to `capacity` paths */
+subdoc_PATH_SKETCH *
+subdoc_sketch_alloc(size_t capacity, subdoc_SKETCH_METRIC metric);
+
+void
+subdoc_sketch_free(subdoc_PATH_SKETCH *sketch);
+
+void
+subdoc_sketch_clear(subdoc_PATH_SKETCH *sketch);
+
+/** Add `weight` to the total of `path`. If the sketch is full and the path
+ * is absent, this replaces the lightest entry, which takes O(capacity) */
+void
+subdoc_sketch_add(subdoc_PATH_SKETCH *sketch, const char *path, size_t npath,
+    uint64_t weight);
+
+/**
+ * Add the contents of `src` to `dst`. The result has the same guarantees as
+ * a single sketch, of dst's capacity, fed with both streams.
+ * @return 0 on success, -1 on allocation failure (dst is unchanged)
+ */
+int
+subdoc_sketch_merge(subdoc_PATH_SKETCH *dst, const subdoc_PATH_SKETCH *src);
+
+/**
+ * Copy up to `nout` entries, heaviest first, into `out`.
+ * @return the number of entries copied
+ */
+size_t
+subdoc_sketch_top(const subdoc_PATH_SKETCH *sketch, subdoc_SKETCH_ENTRY *out,
+    size_t nout);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -32,6 +32,9 @@ typedef enum {
     /**Invalid value for insertion. Inserting this value would invalidate
      * the JSON document */
     SUBDOC_STATUS_VALUE_CANTINSERT = 0x509,
+    /**The document or value is larger than SUBDOC_DOC_MAX, and can't be
+     * parsed by this build */
+    SUBDOC_STATUS_DOC_E2BIG = 0x50A,
 
     /* MEMCACHED ERROR CODES */
     SUBDOC_STATUS_GLOBAL_UNKNOWN_COMMAND = 0x81,
@@ -125,7 +128,12 @@ typedef enum {
     /**Adds a value to a list, ensuring that the value does not already exist.
      * Values added can only be primitives, and the list itself must already
      * only contain primitives. If any of these is violated, the error
-     * SUBDOC_PATH_MISMATCH is returned. */
+     * SUBDOC_PATH_MISMATCH is returned.
+     *
+     * If a subdoc_UNIQUE_INDEX is attached to the operation, elements are
+     * compared by hash, arrays and dictionaries may be compared as well (as
+     * raw bytes), and a still-valid index avoids parsing the array at all
+     * for values which are not present. */
     SUBDOC_CMD_ARRAY_ADD_UNIQUE = 0x08,
     SUBDOC_CMD_ARRAY_ADD_UNIQUE_P = 0x88,
 
@@ -142,7 +150,71 @@ typedef enum {
     SUBDOC_CMD_INCREMENT = 0x09,
     SUBDOC_CMD_INCREMENT_P = 0x89,
     SUBDOC_CMD_DECREMENT = 0x0A,
-    SUBDOC_CMD_DECREMENT_P = 0x8A
+    SUBDOC_CMD_DECREMENT_P = 0x8A,
+
+    /**Get the number of elements in an array, or the number of keys in a
+     * dictionary. The count is returned as a decimal string in the match
+     * location (the container itself is not returned). If the path does not
+     * point to an array or dictionary, SUBDOC_PATH_MISMATCH is returned. */
+    SUBDOC_CMD_GET_COUNT = 0x0B,
+
+    /**Insert a value into an array at a given position. The path must end in
+     * a non-negative array index (e.g. `arr[3]`); the value is placed before
+     * the element currently at that index. The index may be one past the last
+     * element, in which case the value is appended. Indices beyond that yield
+     * SUBDOC_PATH_ENOENT, and a missing or negative index yields
+     * SUBDOC_PATH_EINVAL. */
+    SUBDOC_CMD_ARRAY_INSERT = 0x0C,
+
+    /**Remove the first or last element of the array at the path. The removed
+     * element is returned in the match location. If the array is empty,
+     * SUBDOC_PATH_ENOENT is returned. */
+    SUBDOC_CMD_ARRAY_POP_FRONT = 0x0D,
+    SUBDOC_CMD_ARRAY_POP_BACK = 0x0E,
+
+    /**Remove all but the first N elements of the array at the path. As with
+     * SUBDOC_CMD_INCREMENT, the value is a 64-bit integer (N) in network
+     * order. The match location spans the removed (comma-separated) elements,
+     * and is empty if the array had no more than N elements. */
+    SUBDOC_CMD_ARRAY_TRIM = 0x0F,
+
+    /**Add a floating point delta to a number. The value is an IEEE 754 double
+     * in network byte order (i.e. its 64-bit representation is sent like the
+     * integer for SUBDOC_CMD_INCREMENT); use a negative delta to decrement.
+     * The existing number may be an integer, a float or use an exponent. The
+     * result is written in the shortest form which reads back as the same
+     * double. If the result is not finite, SUBDOC_DELTA_E2BIG is returned. */
+    SUBDOC_CMD_INCREMENT_FLOAT = 0x10,
+    SUBDOC_CMD_INCREMENT_FLOAT_P = 0x90,
+
+    /**Adds a delta to each of several integer counters in a single pass over
+     * the document. The counters and deltas are supplied with
+     * SUBDOC_OP_SETMULTI() rather than as a path and value. Missing counters
+     * are created if their immediate parent is a dictionary. Either every
+     * counter is updated, or none is and the first failure is returned. */
+    SUBDOC_CMD_MULTI_INCREMENT = 0x11,
+
+    /**Builds a new document holding only the given fields of this one,
+     * nested as in the original. The paths are supplied with
+     * SUBDOC_OP_SETMULTI(), and must consist of dictionary keys only. The
+     * result is returned in the new document fragments, which point into the
+     * original document wherever possible. Missing fields are omitted (and
+     * reported in each path's status); a field within another requested
+     * field is only included once. */
+    SUBDOC_CMD_PROJECT = 0x12,
+
+    /**Rewrites the document with the keys of every dictionary sorted and
+     * insignificant whitespace removed (see subdoc_canonicalize()). The path
+     * is not used. Lookups and dictionary insertions on a canonical document
+     * are faster if subdoc_OPERATION::doc_sorted is set */
+    SUBDOC_CMD_CANONICALIZE = 0x13,
+
+    /**Removes all whitespace outside of strings (see subdoc_compact()). The
+     * path is not used. The document is validated first, and an invalid one
+     * fails with SUBDOC_STATUS_DOC_NOTJSON. Compacting pretty-printed
+     * documents once, when they are stored, makes every later scan of them
+     * proportionally cheaper */
+    SUBDOC_CMD_COMPACT = 0x14
 } subdoc_OPTYPE;
 
 
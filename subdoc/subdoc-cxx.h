@@ -0,0 +1,467 @@
+/* C++17 convenience wrappers around the subdoc C API. This is header-only and
+ * requires no additional linkage beyond the library itself.
+ *
+ * Inputs are taken as std::string_view and results are returned as views
+ * into the caller's document (or the operation's own buffers), so no copies
+ * are made at the API boundary. The usual lifetime rules of the C API apply:
+ * a result is only valid as long as the document, the value and the
+ * operation which produced it.
+ */
+
+#ifndef SUBDOC_CXX_H
+#define SUBDOC_CXX_H
+
+#include "operations.h"
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <new>
+
+namespace subdoc {
+
+inline std::string_view
+to_string_view(const subdoc_LOC& loc)
+{
+    return std::string_view(loc.at, loc.length);
+}
+
+/** Read-only span of fragments, e.g. the fragments making up a new document */
+class Fragments {
+public:
+    class iterator {
+    public:
+        explicit iterator(const subdoc_LOC *cur = nullptr) : m_cur(cur) {}
+        std::string_view operator*() const { return to_string_view(*m_cur); }
+        iterator& operator++() { ++m_cur; return *this; }
+        bool operator==(const iterator& other) const { return m_cur == other.m_cur; }
+        bool operator!=(const iterator& other) const { return m_cur != other.m_cur; }
+    private:
+        const subdoc_LOC *m_cur;
+    };
+
+    Fragments() : m_locs(nullptr), m_size(0) {}
+    Fragments(const subdoc_LOC *locs, size_t n) : m_locs(locs), m_size(n) {}
+
+    iterator begin() const { return iterator(m_locs); }
+    iterator end() const { return iterator(m_locs + m_size); }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    std::string_view operator[](size_t ix) const { return to_string_view(m_locs[ix]); }
+    const subdoc_LOC *data() const { return m_locs; }
+
+    /** Total length of all fragments, i.e. the size of the joined buffer */
+    size_t total_length() const {
+        size_t ret = 0;
+        for (size_t ii = 0; ii < m_size; ii++) {
+            ret += m_locs[ii].length;
+        }
+        return ret;
+    }
+
+    /** Append all fragments to a string-like object */
+    template <typename T> void append_to(T& out) const {
+        for (size_t ii = 0; ii < m_size; ii++) {
+            out.append(m_locs[ii].at, m_locs[ii].length);
+        }
+    }
+
+    /** Join the fragments into a single string. This copies */
+    std::string str() const {
+        std::string ret;
+        ret.reserve(total_length());
+        append_to(ret);
+        return ret;
+    }
+
+private:
+    const subdoc_LOC *m_locs;
+    size_t m_size;
+};
+
+/** Owning wrapper for subdoc_PATH */
+class Path {
+public:
+    Path() : m_path(subdoc_path_alloc()) {
+        if (m_path == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+    ~Path() {
+        if (m_path != nullptr) {
+            subdoc_path_free(m_path);
+        }
+    }
+    Path(Path&& other) noexcept : m_path(other.m_path) {
+        other.m_path = nullptr;
+    }
+    Path& operator=(Path&& other) noexcept {
+        std::swap(m_path, other.m_path);
+        return *this;
+    }
+    Path(const Path&) = delete;
+    Path& operator=(const Path&) = delete;
+
+    /**
+     * Parse a path. Components may point into `s`, which must therefore
+     * remain valid for as long as this object is used.
+     * @return SUBDOC_STATUS_SUCCESS or SUBDOC_STATUS_PATH_EINVAL
+     */
+    subdoc_ERRORS parse(std::string_view s) {
+        subdoc_path_clear(m_path);
+        if (subdoc_path_parse(m_path, s.data(), s.size()) != 0) {
+            return SUBDOC_STATUS_PATH_EINVAL;
+        }
+        return SUBDOC_STATUS_SUCCESS;
+    }
+
+    void clear() { subdoc_path_clear(m_path); }
+
+    /** Number of components, including the implicit root */
+    size_t size() const { return m_path->jpr_base.ncomponents; }
+
+    subdoc_PATH *get() { return m_path; }
+    const subdoc_PATH *get() const { return m_path; }
+
+private:
+    subdoc_PATH *m_path;
+};
+
+/** A single component of a static_path */
+struct static_component {
+    /** Offset of the (unescaped) key within the path's buffer */
+    size_t offset = 0;
+    size_t len = 0;
+    unsigned long idx = 0;
+    bool is_arridx = false;
+    bool is_neg = false;
+    /** A bare `*` key or a `[*]` index */
+    bool is_wildcard = false;
+};
+
+/**
+ * A path parsed entirely at compile time. The syntax is the same as that
+ * accepted by subdoc_path_parse(), wildcards included; an invalid path is a
+ * compile error when the object is declared constexpr:
+ *
+ * @code
+ * static constexpr subdoc::static_path pth("meta.stats.count");
+ * op.exec(SUBDOC_CMD_GET, pth);
+ * @endcode
+ *
+ * The component array (with precomputed lengths) is bound into an
+ * operation's subdoc_PATH without any runtime parsing. The object must outlive
+ * any operation it is bound to, since components point into it.
+ */
+template <size_t N>
+class static_path {
+public:
+    constexpr static_path(const char (&s)[N])
+        : m_buf(), m_nbuf(0), m_comps(), m_ncomps(0), m_has_negix(false),
+          m_has_wildcard(false) {
+        parse(s, N - 1);
+    }
+
+    /** Number of components, excluding the root */
+    constexpr size_t depth() const { return m_ncomps; }
+    constexpr const static_component& component(size_t ix) const { return m_comps[ix]; }
+    constexpr std::string_view key(size_t ix) const {
+        return std::string_view(m_buf + m_comps[ix].offset, m_comps[ix].len);
+    }
+    constexpr bool has_negix() const { return m_has_negix; }
+    constexpr bool has_wildcard() const { return m_has_wildcard; }
+
+    /** Load the components into `pth`, replacing its existing contents */
+    void bind(subdoc_PATH *pth) const {
+        jsonsl_jpr_t jpr = &pth->jpr_base;
+        subdoc_path_clear(pth);
+        jpr->components = pth->components_s;
+        jpr->components[0].ptype = JSONSL_PATH_ROOT;
+        jpr->ncomponents = m_ncomps + 1;
+        /* Components are within 'orig', so subdoc_path_clear won't free them */
+        jpr->orig = const_cast<char *>(m_buf);
+        jpr->norig = N;
+        pth->has_negix = m_has_negix;
+        pth->has_wildcard = m_has_wildcard;
+
+        for (size_t ii = 0; ii < m_ncomps; ii++) {
+            const static_component& src = m_comps[ii];
+            struct jsonsl_jpr_component_st *dst = &jpr->components[ii + 1];
+            dst->is_arridx = src.is_arridx;
+            dst->is_neg = src.is_neg;
+            dst->idx = src.idx;
+            if (src.is_wildcard) {
+                dst->ptype = JSONSL_PATH_WILDCARD;
+                dst->pstr = NULL;
+                dst->len = 0;
+            } else if (src.is_arridx) {
+                dst->ptype = JSONSL_PATH_NUMERIC;
+                dst->pstr = NULL;
+                dst->len = 0;
+            } else {
+                dst->ptype = JSONSL_PATH_STRING;
+                dst->pstr = const_cast<char *>(m_buf + src.offset);
+                dst->len = src.len;
+            }
+        }
+    }
+
+private:
+    constexpr void parse(const char *s, size_t len) {
+        size_t last = 0;
+        size_t n_backtick = 0;
+        bool in_escape = false;
+
+        if (len == 0) {
+            return;
+        }
+        for (size_t ii = 0; ii < len; ii++) {
+            if (s[ii] == '`') {
+                n_backtick++;
+                if (ii + 1 < len && s[ii + 1] == '`') {
+                    n_backtick++, ii++;
+                } else {
+                    in_escape = !in_escape;
+                }
+                continue;
+            }
+            if (in_escape) {
+                continue;
+            }
+            if (s[ii] == '.') {
+                add_component(s + last, ii - last, n_backtick);
+                last = ii + 1;
+                n_backtick = 0;
+            }
+        }
+        add_component(s + last, len - last, n_backtick);
+    }
+
+    constexpr static_component& next_component() {
+        if (m_ncomps == COMPONENTS_ALLOC - 1) {
+            throw "subdoc::static_path: too many components";
+        }
+        return m_comps[m_ncomps++];
+    }
+
+    constexpr void add_component(const char *comp, size_t len, size_t n_backtick) {
+        size_t keylen = len;
+        bool has_index = false, is_neg = false, index_wildcard = false;
+        unsigned long idx = 0;
+
+        /* An unescaped '*' is a wildcard */
+        if (len == 1 && comp[0] == '*') {
+            static_component& out = next_component();
+            out.is_wildcard = true;
+            m_has_wildcard = true;
+            return;
+        }
+        if (len > 1 && comp[0] == '`' && comp[len - 1] == '`') {
+            comp++;
+            len -= 2;
+            keylen = len;
+        }
+        if (len == 0) {
+            throw "subdoc::static_path: empty component";
+        }
+
+        /* Array indices are always at the (unescaped) end */
+        if (comp[len - 1] == ']') {
+            size_t open = len - 1;
+            while (open > 0 && comp[open] != '[') {
+                open--;
+            }
+            if (comp[open] != '[') {
+                throw "subdoc::static_path: unbalanced ']'";
+            }
+            if (open + 4 == len && comp[open + 1] == '-' && comp[open + 2] == '1') {
+                is_neg = true;
+            } else if (open + 3 == len && comp[open + 1] == '*') {
+                index_wildcard = true;
+            } else if (open + 2 == len) {
+                throw "subdoc::static_path: empty array index";
+            } else {
+                for (size_t ii = open + 1; ii < len - 1; ii++) {
+                    if (comp[ii] < '0' || comp[ii] > '9') {
+                        throw "subdoc::static_path: bad array index";
+                    }
+                    idx = idx * 10 + (comp[ii] - '0');
+                }
+            }
+            has_index = true;
+            keylen = open;
+        }
+
+        if (keylen) {
+            static_component& out = next_component();
+            out.offset = m_nbuf;
+            for (size_t ii = 0; ii < keylen; ii++) {
+                /* Double backticks are a literal backtick; strip single ones */
+                if (n_backtick && comp[ii] == '`') {
+                    if (ii + 1 < keylen && comp[ii + 1] == '`') {
+                        m_buf[m_nbuf++] = comp[ii++];
+                    }
+                    continue;
+                }
+                m_buf[m_nbuf++] = comp[ii];
+            }
+            out.len = m_nbuf - out.offset;
+            out.idx = 0;
+            out.is_arridx = false;
+            out.is_neg = false;
+        }
+
+        if (index_wildcard) {
+            static_component& out = next_component();
+            out.is_wildcard = true;
+            m_has_wildcard = true;
+        } else if (has_index) {
+            static_component& out = next_component();
+            out.offset = 0;
+            out.len = 0;
+            out.idx = is_neg ? static_cast<unsigned long>(-1) : idx;
+            out.is_arridx = true;
+            out.is_neg = is_neg;
+            m_has_negix = m_has_negix || is_neg;
+        }
+    }
+
+    char m_buf[N];
+    size_t m_nbuf;
+    /* A component is at least one byte (or three, for an index) */
+    static_component m_comps[N];
+    size_t m_ncomps;
+    bool m_has_negix;
+    bool m_has_wildcard;
+};
+
+/**
+ * Owning wrapper for subdoc_OPERATION. Operations are move-only, so that
+ * pooled operations may be handed between stages without copying their
+ * (rather large) internal state.
+ */
+class Operation {
+public:
+    Operation() : m_op(subdoc_op_alloc()) {
+        if (m_op == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+    ~Operation() {
+        if (m_op != nullptr) {
+            subdoc_op_free(m_op);
+        }
+    }
+    Operation(Operation&& other) noexcept : m_op(other.m_op) {
+        other.m_op = nullptr;
+    }
+    Operation& operator=(Operation&& other) noexcept {
+        std::swap(m_op, other.m_op);
+        return *this;
+    }
+    Operation(const Operation&) = delete;
+    Operation& operator=(const Operation&) = delete;
+
+    /** Reset the operation for a new command. The document is retained */
+    void clear() { subdoc_op_clear(m_op); }
+
+    Operation& doc(std::string_view d) {
+        SUBDOC_OP_SETDOC(m_op, d.data(), d.size());
+        return *this;
+    }
+    Operation& value(std::string_view v) {
+        SUBDOC_OP_SETVALUE(m_op, v.data(), v.size());
+        return *this;
+    }
+    Operation& code(subdoc_OPTYPE c) {
+        SUBDOC_OP_SETCODE(m_op, c);
+        return *this;
+    }
+
+    /** Execute the currently configured command against `path` */
+    subdoc_ERRORS exec(std::string_view path) {
+        return subdoc_op_exec(m_op, path.data(), path.size());
+    }
+
+    /** Clear, configure and execute a command in one go */
+    subdoc_ERRORS exec(subdoc_OPTYPE c, std::string_view path,
+        std::string_view v = std::string_view()) {
+        clear();
+        code(c);
+        if (!v.empty()) {
+            value(v);
+        }
+        return exec(path);
+    }
+
+    /** Execute the currently configured command against a precompiled path */
+    template <size_t N> subdoc_ERRORS exec(const static_path<N>& path) {
+        path.bind(m_op->path);
+        return subdoc_op_exec_compiled(m_op);
+    }
+
+    template <size_t N> subdoc_ERRORS exec(subdoc_OPTYPE c,
+        const static_path<N>& path, std::string_view v = std::string_view()) {
+        clear();
+        code(c);
+        if (!v.empty()) {
+            value(v);
+        }
+        return exec(path);
+    }
+
+    /** The matched value (or the new value, for arithmetic operations) */
+    std::string_view match() const { return to_string_view(m_op->match.loc_match); }
+
+    /** The fragments comprising the new document for mutation commands */
+    Fragments new_doc() const { return Fragments(m_op->doc_new, m_op->doc_new_len); }
+
+    const subdoc_MATCH& match_info() const { return m_op->match; }
+
+    /**
+     * Find every match of a (possibly wildcard) path within the document in
+     * a single scan, calling `fn(const subdoc_MATCH&)` for each in document
+     * order. If `fn` returns bool, returning false stops the scan.
+     * @return SUBDOC_STATUS_SUCCESS, SUBDOC_STATUS_PATH_EINVAL,
+     * SUBDOC_STATUS_DOC_E2BIG or SUBDOC_STATUS_DOC_NOTJSON
+     */
+    template <typename F> subdoc_ERRORS for_each_match(const Path& path, F&& fn) {
+        auto thunk = [](const subdoc_MATCH *m, void *cookie) -> int {
+            auto& f = *static_cast<std::remove_reference_t<F> *>(cookie);
+            if constexpr (std::is_same_v<decltype(f(*m)), bool>) {
+                return f(*m) ? 0 : 1;
+            } else {
+                f(*m);
+                return 0;
+            }
+        };
+        if (path.get()->has_negix) {
+            return SUBDOC_STATUS_PATH_EINVAL;
+        }
+        jsonsl_error_t rv = subdoc_match_exec_all(m_op->doc_cur.at,
+            m_op->doc_cur.length, path.get(), m_op->jsn, thunk, &fn);
+        if (rv == JSONSL_ERROR_SUCCESS) {
+            return SUBDOC_STATUS_SUCCESS;
+        } else if (rv == (jsonsl_error_t)SUBDOC_VALIDATE_E2BIG) {
+            return SUBDOC_STATUS_DOC_E2BIG;
+        }
+        return SUBDOC_STATUS_DOC_NOTJSON;
+    }
+
+    /** Collect every match of a path; see for_each_match() */
+    subdoc_ERRORS match_all(const Path& path, std::vector<subdoc_MATCH>& out) {
+        return for_each_match(path, [&out](const subdoc_MATCH& m) {
+            out.push_back(m);
+        });
+    }
+    subdoc_OPERATION *get() { return m_op; }
+    const subdoc_OPERATION *get() const { return m_op; }
+
+private:
+    subdoc_OPERATION *m_op;
+};
+
+} // namespace subdoc
+
+#endif /* SUBDOC_CXX_H */
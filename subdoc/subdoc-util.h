@@ -9,6 +9,7 @@ typedef lcb_string subdoc_STRING;
 #define subdoc_string_release lcb_string_release
 #define subdoc_string_appendz lcb_string_appendz
 #define subdoc_string_append lcb_string_append
+#define subdoc_string_reserve lcb_string_reserve
 #else
 typedef struct {
     char *base;
@@ -81,6 +82,10 @@ static int subdoc_string__reserve(subdoc_STRING *str, size_t size) {
     str->nalloc = newalloc;
     return 0;
 }
+/* Ensure there is room to append `size` bytes */
+static int subdoc_string_reserve(subdoc_STRING *str, size_t size) {
+    return subdoc_string__reserve(str, size);
+}
 static int subdoc_string_append(subdoc_STRING *str, const void *data, size_t size) {
     if (subdoc_string__reserve(str, size)) {
         return -1;
@@ -91,4 +96,40 @@ static int subdoc_string_append(subdoc_STRING *str, const void *data, size_t siz
 }
 #endif /* INCLUDE_SUBDOC_STRING_SRC */
 #endif /* defined(LIBCOUCHBASE_INTERNAL) */
+
+#include <stdint.h>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>
+#endif
+
+/** Index of the lowest set bit of `v`, which must be nonzero */
+static inline unsigned
+subdoc_ctz64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(v);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long ix;
+    _BitScanForward64(&ix, v);
+    return (unsigned)ix;
+#else
+    unsigned n = 0;
+    for (; (v & 1) == 0; v >>= 1) {
+        n++;
+    }
+    return n;
+#endif
+}
+
+/** Add `b` to `*a`, unless the sum does not fit. Returns nonzero (leaving
+ * `*a` as it was) if it doesn't */
+static inline int
+subdoc_add_i64(int64_t *a, int64_t b)
+{
+    if ((b > 0 && *a > INT64_MAX - b) || (b < 0 && *a < INT64_MIN - b)) {
+        return -1;
+    }
+    *a += b;
+    return 0;
+}
 #endif /* SUBDOC_STRING_H */
@@ -0,0 +1,53 @@
+/* Per-phase operation timings. See timing.h */
+
+#include "timing.h"
+#include <string.h>
+
+const char *
+subdoc_phase_name(subdoc_PHASE phase)
+{
+    switch (phase) {
+    case SUBDOC_PHASE_PATH_PARSE:
+        return "path_parse";
+    case SUBDOC_PHASE_VALIDATE:
+        return "validate";
+    case SUBDOC_PHASE_MATCH:
+        return "match";
+    case SUBDOC_PHASE_BUILD:
+        return "build";
+    default:
+        return "unknown";
+    }
+}
+
+void
+subdoc_timings_finish(subdoc_OP_TIMINGS *timings, uint8_t code)
+{
+    subdoc_PHASE_TIMES *t = &timings->last;
+    uint64_t other = 0, last_end = t->begin;
+    int ii;
+
+    t->end = subdoc_cycles();
+    for (ii = 0; ii < SUBDOC_PHASE_BUILD; ii++) {
+        other += t->cycles[ii];
+        if (t->phase_end[ii] > last_end) {
+            last_end = t->phase_end[ii];
+        }
+    }
+    t->cycles[SUBDOC_PHASE_BUILD] = t->end - t->begin > other
+        ? t->end - t->begin - other : 0;
+    t->phase_begin[SUBDOC_PHASE_BUILD] = last_end;
+    t->phase_end[SUBDOC_PHASE_BUILD] = t->end;
+
+    timings->count[code]++;
+    for (ii = 0; ii < SUBDOC_PHASE_MAX; ii++) {
+        timings->cycles[code][ii] += t->cycles[ii];
+    }
+}
+
+void
+subdoc_timings_reset(subdoc_OP_TIMINGS *timings)
+{
+    memset(timings->count, 0, sizeof timings->count);
+    memset(timings->cycles, 0, sizeof timings->cycles);
+}
@@ -0,0 +1,98 @@
+#ifndef SUBDOC_TIMING_H
+#define SUBDOC_TIMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define SUBDOC_CYCLES_TSC
+#elif !defined(__aarch64__)
+#include <time.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Phases of subdoc_op_exec() which are timed separately */
+typedef enum {
+    /** subdoc_path_parse() of the command's path(s) */
+    SUBDOC_PHASE_PATH_PARSE,
+    /** subdoc_validate() of the user's value */
+    SUBDOC_PHASE_VALIDATE,
+    /** Locating the path(s) in the document */
+    SUBDOC_PHASE_MATCH,
+    /** Everything else; mostly building the new document's fragments */
+    SUBDOC_PHASE_BUILD,
+    SUBDOC_PHASE_MAX
+} subdoc_PHASE;
+
+/** Timings of a single operation. Units are those of subdoc_cycles() */
+typedef struct {
+    uint64_t begin;
+    uint64_t end;
+    /** Start of the first, and end of the last, interval spent in each phase.
+     * Both are 0 if the phase did not run. For SUBDOC_PHASE_BUILD these span
+     * from the end of the last other phase to the end of the operation */
+    uint64_t phase_begin[SUBDOC_PHASE_MAX];
+    uint64_t phase_end[SUBDOC_PHASE_MAX];
+    /** Total time in each phase. A phase may run more than once, e.g.
+     * matching a parent and then its first child */
+    uint64_t cycles[SUBDOC_PHASE_MAX];
+} subdoc_PHASE_TIMES;
+
+/**
+ * Per-phase timings recorded by subdoc_op_exec() and
+ * subdoc_op_exec_compiled() when subdoc_OPERATION::timings is set. Allocate
+ * zeroed, e.g. with calloc()
+ */
+typedef struct {
+    /** The most recent operation */
+    subdoc_PHASE_TIMES last;
+    /** Totals by opcode */
+    uint64_t count[256];
+    uint64_t cycles[256][SUBDOC_PHASE_MAX];
+} subdoc_OP_TIMINGS;
+
+/**
+ * Read a cheap, monotonic cycle counter: the TSC on x86, the virtual counter
+ * on aarch64, and nanoseconds elsewhere. Callers needing wall time must
+ * calibrate it themselves.
+ */
+static inline uint64_t
+subdoc_cycles(void)
+{
+#if defined(SUBDOC_CYCLES_TSC)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/** Short lowercase name of a phase, e.g. "match" */
+const char *
+subdoc_phase_name(subdoc_PHASE phase);
+
+/** End the most recent operation: stamp its end, derive its
+ * SUBDOC_PHASE_BUILD time, and add it to the totals for opcode `code` */
+void
+subdoc_timings_finish(subdoc_OP_TIMINGS *timings, uint8_t code);
+
+/** Zero every total. The most recent operation is kept */
+void
+subdoc_timings_reset(subdoc_OP_TIMINGS *timings);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,185 @@
+/* Hash set of array elements for accelerated ADD_UNIQUE. See unique.h */
+
+#include "unique.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define UNIQUE_INDEX_MINSLOTS 64
+
+static uint64_t
+mix_word(uint64_t h, uint64_t w)
+{
+    h = (h ^ w) * 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 31);
+}
+
+uint64_t
+subdoc_unique_hash(const char *s, size_t n)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ n;
+    uint64_t w;
+
+    /* Mix a word at a time; values are compared in full after a hash match,
+     * so this only needs to be fast and reasonably well distributed */
+    for (; n >= 8; s += 8, n -= 8) {
+        memcpy(&w, s, 8);
+        h = mix_word(h, w);
+    }
+    if (n) {
+        w = 0;
+        memcpy(&w, s, n);
+        h = (h ^ w) * 0x94D049BB133111EBULL;
+        h ^= h >> 29;
+    }
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+void
+subdoc_unique_digest_init(subdoc_UNIQUE_DIGEST *dg)
+{
+    dg->h = 0x9E3779B97F4A7C15ULL;
+    dg->pending = 0;
+    dg->npending = 0;
+    dg->length = 0;
+}
+
+void
+subdoc_unique_digest_update(subdoc_UNIQUE_DIGEST *dg, const char *s, size_t n)
+{
+    uint64_t w;
+
+    dg->length += n;
+    if (dg->npending) {
+        /* Complete the word left over from the previous fragment */
+        size_t ncopy = 8 - dg->npending < n ? 8 - dg->npending : n;
+        memcpy((char *)&dg->pending + dg->npending, s, ncopy);
+        dg->npending += ncopy;
+        s += ncopy;
+        n -= ncopy;
+        if (dg->npending < 8) {
+            return;
+        }
+        dg->h = mix_word(dg->h, dg->pending);
+        dg->npending = 0;
+    }
+    for (; n >= 8; s += 8, n -= 8) {
+        memcpy(&w, s, 8);
+        dg->h = mix_word(dg->h, w);
+    }
+    if (n) {
+        dg->pending = 0;
+        memcpy(&dg->pending, s, n);
+        dg->npending = n;
+    }
+}
+
+uint64_t
+subdoc_unique_digest_final(const subdoc_UNIQUE_DIGEST *dg)
+{
+    uint64_t h = dg->h;
+    if (dg->npending) {
+        h = mix_word(h, dg->pending);
+    }
+    h = mix_word(h, dg->length);
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    return h ^ (h >> 32);
+}
+
+uint64_t
+subdoc_unique_digest(const char *s, size_t n)
+{
+    subdoc_UNIQUE_DIGEST dg;
+    subdoc_unique_digest_init(&dg);
+    subdoc_unique_digest_update(&dg, s, n);
+    return subdoc_unique_digest_final(&dg);
+}
+
+subdoc_UNIQUE_INDEX *
+subdoc_unique_index_alloc(void)
+{
+    return (subdoc_UNIQUE_INDEX *)calloc(1, sizeof(subdoc_UNIQUE_INDEX));
+}
+
+void
+subdoc_unique_index_free(subdoc_UNIQUE_INDEX *uidx)
+{
+    free(uidx->slots);
+    free(uidx);
+}
+
+void
+subdoc_unique_index_clear(subdoc_UNIQUE_INDEX *uidx)
+{
+    if (uidx->nused) {
+        memset(uidx->slots, 0, sizeof(*uidx->slots) * uidx->nslots);
+    }
+    uidx->nused = 0;
+    uidx->path_hash = 0;
+    uidx->array_pos = 0;
+    uidx->array_len = 0;
+    uidx->array_digest = 0;
+    uidx->valid = 0;
+    uidx->error = 0;
+}
+
+/* Returns the slot holding `hash`, or the empty slot where it belongs */
+static uint64_t *
+find_slot(uint64_t *slots, size_t nslots, uint64_t hash)
+{
+    size_t ix = hash & (nslots - 1);
+    while (slots[ix] != 0 && slots[ix] != hash) {
+        ix = (ix + 1) & (nslots - 1);
+    }
+    return &slots[ix];
+}
+
+static int
+grow(subdoc_UNIQUE_INDEX *uidx)
+{
+    size_t ii, nslots = uidx->nslots ? uidx->nslots * 2 : UNIQUE_INDEX_MINSLOTS;
+    uint64_t *slots = (uint64_t *)calloc(nslots, sizeof(*slots));
+
+    if (slots == NULL) {
+        return -1;
+    }
+    for (ii = 0; ii < uidx->nslots; ii++) {
+        if (uidx->slots[ii]) {
+            *find_slot(slots, nslots, uidx->slots[ii]) = uidx->slots[ii];
+        }
+    }
+    free(uidx->slots);
+    uidx->slots = slots;
+    uidx->nslots = nslots;
+    return 0;
+}
+
+int
+subdoc_unique_index_add(subdoc_UNIQUE_INDEX *uidx, uint64_t hash)
+{
+    uint64_t *slot;
+
+    /* Keep the load factor at or below one half */
+    if ((uidx->nused + 1) * 2 > uidx->nslots && grow(uidx) != 0) {
+        uidx->error = 1;
+        return -1;
+    }
+    slot = find_slot(uidx->slots, uidx->nslots, hash);
+    if (*slot == 0) {
+        *slot = hash;
+        uidx->nused++;
+    }
+    return 0;
+}
+
+int
+subdoc_unique_index_has(const subdoc_UNIQUE_INDEX *uidx, uint64_t hash)
+{
+    if (uidx->nused == 0) {
+        return 0;
+    }
+    return *find_slot(uidx->slots, uidx->nslots, hash) == hash;
+}
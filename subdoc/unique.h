@@ -0,0 +1,87 @@
+#ifndef SUBDOC_UNIQUE_H
+#define SUBDOC_UNIQUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Set of element hashes for a single array, used to accelerate
+ * SUBDOC_CMD_ARRAY_ADD_UNIQUE.
+ *
+ * An index describes one array of one document. It is populated as a side
+ * effect of an ADD_UNIQUE scan, and kept up to date by subsequent ADD_UNIQUE
+ * operations on the same path. The array's location and a digest of its text
+ * are recorded as well, so that the index is only used for a document which
+ * still contains that array (such as the output of the last operation). Any
+ * other document causes it to be rebuilt.
+ */
+typedef struct subdoc_UNIQUE_INDEX_st {
+    /* Open-addressed table of hashes. 0 marks an empty slot */
+    uint64_t *slots;
+    size_t nslots;
+    size_t nused;
+    /* Identifies the path this index was built for */
+    uint64_t path_hash;
+    /* Offset and length of the array's text, from its opening bracket, within
+     * the document described, and subdoc_unique_digest() of that text */
+    size_t array_pos;
+    size_t array_len;
+    uint64_t array_digest;
+    /* True if the index holds the hash of every element of the array */
+    int valid;
+    /* Set if an insertion failed; the index cannot be used */
+    int error;
+} subdoc_UNIQUE_INDEX;
+
+/** Hash a raw JSON value. Never returns 0 */
+uint64_t
+subdoc_unique_hash(const char *s, size_t n);
+
+/** Incremental digest of text which may be split into several fragments */
+typedef struct {
+    uint64_t h;
+    uint64_t pending; /* Bytes of an incomplete word */
+    size_t npending;
+    size_t length;
+} subdoc_UNIQUE_DIGEST;
+
+void
+subdoc_unique_digest_init(subdoc_UNIQUE_DIGEST *dg);
+
+/** Add more text. The result does not depend on where the text is split */
+void
+subdoc_unique_digest_update(subdoc_UNIQUE_DIGEST *dg, const char *s, size_t n);
+
+uint64_t
+subdoc_unique_digest_final(const subdoc_UNIQUE_DIGEST *dg);
+
+/** Digest of a single fragment of text */
+uint64_t
+subdoc_unique_digest(const char *s, size_t n);
+
+subdoc_UNIQUE_INDEX *
+subdoc_unique_index_alloc(void);
+
+void
+subdoc_unique_index_free(subdoc_UNIQUE_INDEX *uidx);
+
+/** Empty and invalidate the index. The table storage is retained */
+void
+subdoc_unique_index_clear(subdoc_UNIQUE_INDEX *uidx);
+
+/** Add a hash. Returns 0 on success, -1 on allocation failure */
+int
+subdoc_unique_index_add(subdoc_UNIQUE_INDEX *uidx, uint64_t hash);
+
+/** Returns true if the hash may be present in the index */
+int
+subdoc_unique_index_has(const subdoc_UNIQUE_INDEX *uidx, uint64_t hash);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
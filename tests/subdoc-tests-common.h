@@ -3,8 +3,13 @@
 #include "subdoc/path.h"
 #include "subdoc/match.h"
 #include "subdoc/operations.h"
+#include "subdoc/batch.h"
+#include "subdoc/pscan.h"
+#include "subdoc/docfile.h"
+#include "subdoc/hint.h"
 #include <string>
 #include <iostream>
+#include <vector>
 
 namespace t_subdoc {
 using std::string;
@@ -0,0 +1,168 @@
+#include "subdoc-tests-common.h"
+#include "subdoc/subdoc-cxx.h"
+#include <vector>
+
+using std::string;
+using std::string_view;
+
+class CxxTests : public ::testing::Test {};
+
+TEST_F(CxxTests, testPath)
+{
+    subdoc::Path pth;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, pth.parse("foo.bar[1]"));
+    ASSERT_EQ(4, pth.size());
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, pth.parse("...."));
+
+    subdoc::Path other(std::move(pth));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, other.parse("baz"));
+    ASSERT_EQ(2, other.size());
+}
+
+TEST_F(CxxTests, testOperation)
+{
+    string_view doc = "{\"k1\":\"v1\",\"list\":[1,2,3]}";
+    subdoc::Operation op;
+    op.doc(doc);
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, op.exec(SUBDOC_CMD_GET, "k1"));
+    ASSERT_EQ("\"v1\"", op.match());
+    // The result must point into the original document
+    ASSERT_EQ(doc.data() + 6, op.match().data());
+
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, op.exec(SUBDOC_CMD_GET, "k2"));
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, op.exec(SUBDOC_CMD_ARRAY_APPEND, "list", "4"));
+    subdoc::Fragments frags = op.new_doc();
+    ASSERT_FALSE(frags.empty());
+    string newdoc = frags.str();
+    ASSERT_EQ("{\"k1\":\"v1\",\"list\":[1,2,3,4]}", newdoc);
+    ASSERT_EQ(newdoc.size(), frags.total_length());
+
+    size_t nfrags = 0;
+    string joined;
+    for (string_view frag : frags) {
+        joined.append(frag.data(), frag.size());
+        nfrags++;
+    }
+    ASSERT_EQ(frags.size(), nfrags);
+    ASSERT_EQ(newdoc, joined);
+}
+
+TEST_F(CxxTests, testMoveOperation)
+{
+    std::vector<subdoc::Operation> pool;
+    pool.emplace_back();
+    subdoc_OPERATION *raw = pool.back().get();
+
+    subdoc::Operation op(std::move(pool.back()));
+    pool.pop_back();
+    ASSERT_EQ(raw, op.get());
+
+    string doc = "[1,2,3]";
+    op.doc(doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, op.exec(SUBDOC_CMD_GET, "[-1]"));
+    ASSERT_EQ("3", op.match());
+
+    subdoc::Operation op2;
+    op2 = std::move(op);
+    ASSERT_EQ(raw, op2.get());
+}
+
+static constexpr subdoc::static_path StaticCount("meta.stats.count");
+static_assert(StaticCount.depth() == 3, "depth computed at compile time");
+static_assert(StaticCount.key(1) == "stats", "keys split at compile time");
+static_assert(StaticCount.component(2).len == 5, "lengths precomputed");
+
+TEST_F(CxxTests, testStaticPath)
+{
+    static constexpr subdoc::static_path escaped("`a.b`.c[1]");
+    static_assert(escaped.depth() == 3, "escaped path");
+    ASSERT_EQ("a.b", escaped.key(0));
+    ASSERT_EQ("c", escaped.key(1));
+    ASSERT_TRUE(escaped.component(2).is_arridx);
+    ASSERT_EQ(1, escaped.component(2).idx);
+
+    static constexpr subdoc::static_path backtick("`x``y`");
+    ASSERT_EQ("x`y", backtick.key(0));
+
+    string doc = "{\"meta\":{\"stats\":{\"count\":42}},\"a.b\":{\"c\":[1,2]}}";
+    subdoc::Operation op;
+    op.doc(doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, op.exec(SUBDOC_CMD_GET, StaticCount));
+    ASSERT_EQ("42", op.match());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, op.exec(SUBDOC_CMD_GET, escaped));
+    ASSERT_EQ("2", op.match());
+
+    static constexpr subdoc::static_path last("a.b.c[-1]");
+    ASSERT_TRUE(last.has_negix());
+
+    // Static paths should produce the same components as the runtime parser
+    subdoc::Path pth;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, pth.parse("meta.stats.count"));
+    ASSERT_EQ(pth.size(), StaticCount.depth() + 1);
+
+    // Mutations work just the same
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, op.exec(SUBDOC_CMD_REPLACE, StaticCount, "43"));
+    ASSERT_EQ("{\"meta\":{\"stats\":{\"count\":43}},\"a.b\":{\"c\":[1,2]}}",
+        op.new_doc().str());
+
+    // Wildcards mean the same as they do to the runtime parser, and are
+    // rejected by commands in the same way
+    static constexpr subdoc::static_path wild("a.*.b[*]");
+    static constexpr subdoc::static_path literal("a.`*`");
+    static_assert(wild.has_wildcard() && !literal.has_wildcard(), "wildcards");
+    const char *strs[] = { "a.*.b[*]", "a.`*`" };
+    subdoc_PATH *bound = subdoc_path_alloc();
+    for (size_t ii = 0; ii < 2; ii++) {
+        ASSERT_EQ(SUBDOC_STATUS_SUCCESS, pth.parse(strs[ii]));
+        if (ii == 0) {
+            wild.bind(bound);
+        } else {
+            literal.bind(bound);
+        }
+        const subdoc_PATH *parsed = pth.get();
+        ASSERT_EQ(parsed->has_wildcard, bound->has_wildcard);
+        ASSERT_EQ(parsed->jpr_base.ncomponents, bound->jpr_base.ncomponents);
+        for (size_t jj = 1; jj < parsed->jpr_base.ncomponents; jj++) {
+            const struct jsonsl_jpr_component_st *a = &parsed->jpr_base.components[jj];
+            const struct jsonsl_jpr_component_st *b = &bound->jpr_base.components[jj];
+            ASSERT_EQ(a->ptype, b->ptype) << strs[ii] << " component " << jj;
+            ASSERT_EQ(a->is_arridx, b->is_arridx);
+            ASSERT_EQ(string_view(a->pstr ? a->pstr : "", a->len),
+                string_view(b->pstr ? b->pstr : "", b->len));
+        }
+    }
+    subdoc_path_free(bound);
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, op.exec(SUBDOC_CMD_GET, wild));
+}
+
+TEST_F(CxxTests, testMatchAll)
+{
+    string_view doc = "[{\"id\":1,\"tags\":[\"x\"]},{\"id\":2},{\"name\":3},{\"id\":4}]";
+    subdoc::Operation op;
+    subdoc::Path pth;
+    op.doc(doc);
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, pth.parse("[*].id"));
+    std::vector<subdoc_MATCH> matches;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, op.match_all(pth, matches));
+    ASSERT_EQ(3, matches.size());
+    ASSERT_EQ("1", subdoc::to_string_view(matches[0].loc_match));
+    ASSERT_EQ("4", subdoc::to_string_view(matches[2].loc_match));
+    ASSERT_EQ("\"id\"", subdoc::to_string_view(matches[1].loc_key));
+
+    // A bool-returning callback may stop early
+    std::vector<string_view> ids;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, op.for_each_match(pth, [&](const subdoc_MATCH& m) {
+        ids.push_back(subdoc::to_string_view(m.loc_match));
+        return ids.size() < 2;
+    }));
+    ASSERT_EQ(2, ids.size());
+
+    // The operation itself refuses wildcards
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, op.exec(SUBDOC_CMD_GET, "[*].id"));
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, pth.parse("[-1]"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, op.match_all(pth, matches));
+}
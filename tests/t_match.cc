@@ -134,3 +134,342 @@ TEST_F(MatchTests, testSingletonComponentNotFound)
     ASSERT_NE(0, m.immediate_parent_found);
     ASSERT_EQ(json, t_subdoc::getParentString(m));
 }
+
+static void
+compareMatches(const subdoc_MATCH& serial, const subdoc_MATCH& parallel)
+{
+    ASSERT_EQ(serial.status, parallel.status);
+    ASSERT_EQ(serial.matchres, parallel.matchres);
+    ASSERT_EQ(serial.match_level, parallel.match_level);
+    ASSERT_EQ(serial.type, parallel.type);
+    ASSERT_EQ(serial.immediate_parent_found, parallel.immediate_parent_found);
+    ASSERT_EQ(serial.loc_parent.at, parallel.loc_parent.at);
+    ASSERT_EQ(serial.loc_parent.length, parallel.loc_parent.length);
+    ASSERT_EQ(serial.num_siblings, parallel.num_siblings);
+    if (serial.matchres == JSONSL_MATCH_COMPLETE) {
+        ASSERT_EQ(serial.loc_match.at, parallel.loc_match.at);
+        ASSERT_EQ(serial.loc_match.length, parallel.loc_match.length);
+        ASSERT_EQ(serial.position, parallel.position);
+        ASSERT_EQ(serial.has_key, parallel.has_key);
+        ASSERT_EQ(t_subdoc::getMatchKey(serial), t_subdoc::getMatchKey(parallel));
+        ASSERT_EQ(serial.numval, parallel.numval);
+    }
+}
+
+TEST_F(MatchTests, testParallelScan)
+{
+    // Strings containing structural characters, escaped quotes and runs of
+    // backslashes, so that chunk boundaries fall in awkward places.
+    string arr = "[";
+    string obj = "{";
+    for (size_t ii = 0; ii < 40000; ii++) {
+        string ixstr = std::to_string(ii);
+        string elem = "{\"id\":" + ixstr +
+                ",\"s\":\"a,]}[{\\\"\\\\\\\\\\\"" + ixstr + "\\\\\"" +
+                ",\"list\":[" + ixstr + ", \"" + ixstr + "\", null]}";
+        if (ii) {
+            arr += ",\n ";
+            obj += ", ";
+        }
+        arr += elem;
+        obj += "\"k" + ixstr + "\" : " + elem;
+    }
+    arr += "]";
+    obj += " }\n";
+    ASSERT_GT(arr.size(), 3 * SUBDOC_PSCAN_MIN_CHUNK);
+
+    const char *arrpaths[] = {
+        "[0]", "[1]", "[12345]", "[39999]", "[-1]", "[40000]", "[20000].s",
+        "[20000].list[1]", "[31000].list[5]", "[10].id.foo", "[5].nokey",
+        "[0].list", "[-1].id", NULL
+    };
+    const char *objpaths[] = {
+        "k0", "k1", "k23456", "k39999", "k39999.list[2]", "k100.s", "k40000",
+        "k7.nokey", "k77.id", "k8.list[9]", NULL
+    };
+    const char **pathsets[] = { arrpaths, objpaths };
+    const string *docs[] = { &arr, &obj };
+
+    for (size_t ii = 0; ii < 2; ii++) {
+        const string& doc = *docs[ii];
+        for (const char **cur = pathsets[ii]; *cur; cur++) {
+            subdoc_MATCH serial, parallel;
+            memset(&serial, 0, sizeof serial);
+            memset(&parallel, 0, sizeof parallel);
+            pth.parse(*cur);
+
+            subdoc_match_exec(doc.c_str(), doc.size(), pth.getPath(), jsn, &serial);
+            subdoc_match_exec_parallel(doc.c_str(), doc.size(), pth.getPath(),
+                jsn, &parallel, 4);
+            SCOPED_TRACE(*cur);
+            if (pth.getPath()->has_negix) {
+                // Negative index matching only guarantees the match itself
+                ASSERT_EQ(serial.matchres, parallel.matchres);
+                ASSERT_EQ(t_subdoc::getMatchString(serial),
+                    t_subdoc::getMatchString(parallel));
+                ASSERT_EQ(serial.loc_match.at, parallel.loc_match.at);
+            } else {
+                compareMatches(serial, parallel);
+            }
+        }
+    }
+
+    // And through the operation API
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    op->scan_threads = 3;
+    SUBDOC_OP_SETDOC(op, obj.c_str(), obj.size());
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_GET);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec(op, "k39000.id", 9));
+    ASSERT_EQ("39000", t_subdoc::getMatchString(op->match));
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETDOC(op, obj.c_str(), obj.size());
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_EXISTS);
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, subdoc_op_exec(op, "nokey", 5));
+    subdoc_op_free(op);
+}
+
+static int
+collectMatch(const subdoc_MATCH *m, void *cookie)
+{
+    std::vector<string> *out = (std::vector<string> *)cookie;
+    out->push_back(t_subdoc::getMatchKey(*m) + t_subdoc::getMatchString(*m));
+    return 0;
+}
+
+static int
+stopAfterTwo(const subdoc_MATCH *m, void *cookie)
+{
+    std::vector<string> *out = (std::vector<string> *)cookie;
+    out->push_back(t_subdoc::getMatchString(*m));
+    return out->size() == 2;
+}
+
+TEST_F(MatchTests, testWildcard)
+{
+    std::vector<string> res;
+    const char *items = "{\"items\":["
+        "{\"name\":\"a\",\"price\":1},"
+        "{\"name\":\"b\"},"
+        "[\"price\"],"
+        "{\"price\":{\"price\":3},\"name\":\"c\"},"
+        "{\"price\":2.5}"
+        "]}";
+
+    pth.parse("items[*].price");
+    ASSERT_EQ(JSONSL_ERROR_SUCCESS, subdoc_match_exec_all(items, strlen(items),
+        pth.getPath(), jsn, collectMatch, &res));
+    ASSERT_EQ(3, res.size());
+    ASSERT_EQ("\"price\"1", res[0]);
+    ASSERT_EQ("\"price\"{\"price\":3}", res[1]);
+    ASSERT_EQ("\"price\"2.5", res[2]);
+
+    // Dictionary wildcard
+    res.clear();
+    pth.parse("subdict.*");
+    ASSERT_EQ(JSONSL_ERROR_SUCCESS, subdoc_match_exec_all(json, strlen(json),
+        pth.getPath(), jsn, collectMatch, &res));
+    ASSERT_EQ(1, res.size());
+    ASSERT_EQ("\"subkey1\"\"subval1\"", res[0]);
+
+    // Leading wildcard. Containers report their size
+    res.clear();
+    pth.parse("*");
+    ASSERT_EQ(JSONSL_ERROR_SUCCESS, subdoc_match_exec_all(json, strlen(json),
+        pth.getPath(), jsn, collectMatch, &res));
+    ASSERT_EQ(5, res.size());
+    ASSERT_EQ("\"empty\"{}", res[4]);
+
+    // Positions and a plain path
+    std::vector<subdoc_MATCH> matches;
+    pth.parse("numbers[*]");
+    ASSERT_EQ(JSONSL_ERROR_SUCCESS, subdoc_match_exec_all(json, strlen(json),
+        pth.getPath(), jsn, [](const subdoc_MATCH *m, void *c) {
+            ((std::vector<subdoc_MATCH> *)c)->push_back(*m);
+            return 0;
+        }, &matches));
+    ASSERT_EQ(10, matches.size());
+    for (size_t ii = 0; ii < matches.size(); ii++) {
+        ASSERT_EQ(ii, matches[ii].position);
+        ASSERT_EQ((ii + 1) % 10, matches[ii].numval);
+    }
+
+    res.clear();
+    pth.parse("sublist[1]");
+    ASSERT_EQ(JSONSL_ERROR_SUCCESS, subdoc_match_exec_all(json, strlen(json),
+        pth.getPath(), jsn, collectMatch, &res));
+    ASSERT_EQ(1, res.size());
+    ASSERT_EQ("\"elem2\"", res[0]);
+
+    // Stopping early
+    res.clear();
+    pth.parse("numbers[*]");
+    ASSERT_EQ(JSONSL_ERROR_SUCCESS, subdoc_match_exec_all(json, strlen(json),
+        pth.getPath(), jsn, stopAfterTwo, &res));
+    ASSERT_EQ(2, res.size());
+
+    // Errors
+    res.clear();
+    const char *bad = "{\"items\":[1,2,}";
+    pth.parse("items[*]");
+    ASSERT_NE(JSONSL_ERROR_SUCCESS, subdoc_match_exec_all(bad, strlen(bad),
+        pth.getPath(), jsn, collectMatch, &res));
+    pth.parse("items[-1]");
+    ASSERT_NE(JSONSL_ERROR_SUCCESS, subdoc_match_exec_all(items, strlen(items),
+        pth.getPath(), jsn, collectMatch, &res));
+}
+
+TEST_F(MatchTests, testStream)
+{
+    // Push the document a byte at a time, with a long key before the match
+    // so the retained buffer is reallocated while the key is being tracked
+    string key(10000, 'k');
+    string doc = "{\"" + key + "\":{\"a\":[1,2]},\"z\":0}";
+    subdoc_STREAM *s = subdoc_stream_alloc();
+    size_t ii;
+    int rv = 0;
+
+    pth.parse(key.c_str());
+    m.stop_on_match = 1;
+    ASSERT_EQ(0, subdoc_stream_begin(s, pth.getPath(), &m));
+    for (ii = 0; ii < doc.size() && rv == 0; ii++) {
+        rv = subdoc_stream_feed(s, &doc[ii], 1);
+    }
+    ASSERT_EQ(1, rv);
+    // Done as soon as the value closes
+    ASSERT_EQ(doc.find("]") + 2, ii);
+    ASSERT_EQ(JSONSL_MATCH_COMPLETE, m.matchres);
+    ASSERT_EQ(JSONSL_ERROR_SUCCESS, m.status);
+    ASSERT_EQ("{\"a\":[1,2]}", t_subdoc::getMatchString(m));
+    ASSERT_EQ("\"" + key + "\"", t_subdoc::getMatchKey(m));
+    ASSERT_EQ(doc.substr(0, ii), string(subdoc_stream_doc(s).at, subdoc_stream_doc(s).length));
+
+    // Not found: done once the parent closes
+    pth.parse("nope");
+    memset(&m, 0, sizeof m);
+    ASSERT_EQ(0, subdoc_stream_begin(s, pth.getPath(), &m));
+    ASSERT_EQ(0, subdoc_stream_feed(s, doc.c_str(), doc.size() - 1));
+    ASSERT_EQ(1, subdoc_stream_feed(s, "}", 1));
+    ASSERT_EQ(JSONSL_MATCH_POSSIBLE, m.matchres);
+
+    // Errors are final
+    pth.parse("x");
+    memset(&m, 0, sizeof m);
+    ASSERT_EQ(0, subdoc_stream_begin(s, pth.getPath(), &m));
+    ASSERT_EQ(1, subdoc_stream_feed(s, "{\"a\":]", 6));
+    ASSERT_NE(JSONSL_ERROR_SUCCESS, m.status);
+
+    // The root is only complete at the end of the input
+    pth.parse("");
+    memset(&m, 0, sizeof m);
+    ASSERT_EQ(0, subdoc_stream_begin(s, pth.getPath(), &m));
+    ASSERT_EQ(0, subdoc_stream_feed(s, "[1", 2));
+    ASSERT_EQ(0, subdoc_stream_feed(s, "]", 1));
+    ASSERT_EQ(1, subdoc_stream_feed(s, NULL, 0));
+    ASSERT_EQ("[1]", t_subdoc::getMatchString(m));
+
+    pth.parse("a[-1]");
+    ASSERT_EQ(-1, subdoc_stream_begin(s, pth.getPath(), &m));
+    subdoc_stream_free(s);
+}
+
+TEST_F(MatchTests, testHint)
+{
+    subdoc_PATH_HINT hint;
+    subdoc_MATCH full;
+    memset(&hint, 0, sizeof hint);
+
+    // Same layout, different values
+    string doc1 = "{\"id\":1,\"user\":{\"name\":\"a\",\"tags\":[\"x\",{\"k\":1}]}}";
+    string doc2 = "{\"id\":2,\"user\":{\"name\":\"b\",\"tags\":[\"y\",{\"k\":2}]}}";
+
+    pth.parse("user.tags[1].k");
+    subdoc_match_exec_hinted(doc1.c_str(), doc1.size(), pth.getPath(), jsn, &m, &hint);
+    ASSERT_EQ(JSONSL_MATCH_COMPLETE, m.matchres);
+    ASSERT_EQ("1", t_subdoc::getMatchString(m));
+    ASSERT_EQ(1U, hint.misses);
+    ASSERT_NE(0, hint.valid);
+
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(doc2.c_str(), doc2.size(), pth.getPath(), jsn, &m, &hint);
+    ASSERT_EQ(1U, hint.hits);
+    memset(&full, 0, sizeof full);
+    full.stop_on_match = 1;
+    subdoc_match_exec(doc2.c_str(), doc2.size(), pth.getPath(), jsn, &full);
+    ASSERT_EQ(JSONSL_MATCH_COMPLETE, m.matchres);
+    ASSERT_EQ("2", t_subdoc::getMatchString(m));
+    ASSERT_EQ(t_subdoc::getMatchKey(full), t_subdoc::getMatchKey(m));
+    // Verifying the hint reads up to the member, as the full scan did
+    ASSERT_EQ(full.bytes_scanned, m.bytes_scanned);
+    ASSERT_EQ(full.loc_parent.at, m.loc_parent.at);
+    ASSERT_EQ(full.match_level, m.match_level);
+    ASSERT_EQ(full.position, m.position);
+    ASSERT_EQ(full.type, m.type);
+
+    // Array parent
+    pth.parse("user.tags[1]");
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(doc1.c_str(), doc1.size(), pth.getPath(), jsn, &m, &hint);
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(doc2.c_str(), doc2.size(), pth.getPath(), jsn, &m, &hint);
+    ASSERT_EQ(2U, hint.hits);
+    ASSERT_EQ("{\"k\":2}", t_subdoc::getMatchString(m));
+    ASSERT_EQ(1U, m.position);
+    ASSERT_EQ(1U, m.numval);
+    ASSERT_EQ(0, m.has_key);
+
+    // The same offsets under a different key, or inside a string, must not
+    // be taken for the match
+    pth.parse("user.name");
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(doc1.c_str(), doc1.size(), pth.getPath(), jsn, &m, &hint);
+    string other = "{\"id\":3,\"uzer\":{\"name\":\"c\"}}";
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(other.c_str(), other.size(), pth.getPath(), jsn, &m, &hint);
+    ASSERT_NE(JSONSL_MATCH_COMPLETE, m.matchres);
+    string instr = "{\"id\":\"{\\\"name\\\":\\\"d\\\"}\",\"user\":{\"name\":\"e\"}}";
+    size_t hits = hint.hits;
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(instr.c_str(), instr.size(), pth.getPath(), jsn, &m, &hint);
+    ASSERT_EQ(hits, hint.hits);
+    ASSERT_EQ("\"e\"", t_subdoc::getMatchString(m));
+
+    // Shifted by a longer value: a miss, which relearns the location
+    string longer = "{\"id\":12345,\"user\":{\"name\":\"f\"}}";
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(longer.c_str(), longer.size(), pth.getPath(), jsn, &m, &hint);
+    ASSERT_EQ("\"f\"", t_subdoc::getMatchString(m));
+    string longer2 = "{\"id\":67890,\"user\":{\"name\":\"g\"}}";
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(longer2.c_str(), longer2.size(), pth.getPath(), jsn, &m, &hint);
+    ASSERT_EQ(hits + 1, hint.hits);
+    ASSERT_EQ("\"g\"", t_subdoc::getMatchString(m));
+}
+
+TEST_F(MatchTests, testBytesScanned)
+{
+    string doc = "{\"a\":1,\"b\":[1,2,3],\"c\":{\"d\":\"" + string(100, 'x') + "\"}}";
+
+    // Without stop_on_match the whole document is read
+    pth.parse("a");
+    subdoc_match_exec(doc.c_str(), doc.size(), pth.getPath(), jsn, &m);
+    ASSERT_EQ(JSONSL_MATCH_COMPLETE, m.matchres);
+    ASSERT_EQ(doc.size(), m.bytes_scanned);
+
+    memset(&m, 0, sizeof m);
+    m.stop_on_match = 1;
+    subdoc_match_exec(doc.c_str(), doc.size(), pth.getPath(), jsn, &m);
+    ASSERT_EQ(JSONSL_MATCH_COMPLETE, m.matchres);
+    ASSERT_GT(10U, m.bytes_scanned);
+
+    // A negative index is resolved once the end of the array is seen
+    pth.parse("b[-1]");
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec(doc.c_str(), doc.size(), pth.getPath(), jsn, &m);
+    ASSERT_EQ("3", t_subdoc::getMatchString(m));
+    ASSERT_EQ(doc.find(']') + 1, m.bytes_scanned);
+
+    // Further matches add to it
+    size_t first = m.bytes_scanned;
+    subdoc_match_exec(doc.c_str(), doc.size(), pth.getPath(), jsn, &m);
+    ASSERT_EQ(first * 2, m.bytes_scanned);
+}
@@ -1,5 +1,8 @@
 #define INCLUDE_SUBDOC_NTOHLL
 #include "subdoc-tests-common.h"
+#include <limits>
+#include <errno.h>
+#include "subdoc/canonical.h"
 
 using std::string;
 using std::cerr;
@@ -440,3 +443,1152 @@ TEST_F(OpTests, testWhitespace)
     ASSERT_EQ("4", t_subdoc::getMatchString(op->match));
     subdoc_op_free(op);
 }
+
+TEST_F(OpTests, testBatch)
+{
+    std::vector<string> strs;
+    std::vector<subdoc_LOC> docs;
+    for (size_t ii = 0; ii < 1000; ii++) {
+        char buf[64];
+        if (ii % 10 == 9) {
+            sprintf(buf, "{\"owner\":{\"name\":\"n%u\"}}", (unsigned)ii);
+        } else {
+            sprintf(buf, "{\"owner\":{\"id\":%u}}", (unsigned)ii);
+        }
+        strs.push_back(buf);
+    }
+    for (size_t ii = 0; ii < strs.size(); ii++) {
+        subdoc_LOC loc = { strs[ii].c_str(), strs[ii].size() };
+        docs.push_back(loc);
+    }
+
+    std::vector<subdoc_BATCH_RESULT> results(docs.size());
+    const char *path = "owner.id";
+    subdoc_ERRORS rv = subdoc_batch_exec(&docs[0], docs.size(), path,
+        strlen(path), SUBDOC_CMD_GET, &results[0], 4);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, rv);
+
+    for (size_t ii = 0; ii < results.size(); ii++) {
+        if (ii % 10 == 9) {
+            ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, results[ii].status);
+        } else {
+            ASSERT_EQ(SUBDOC_STATUS_SUCCESS, results[ii].status);
+            string match(results[ii].loc.at, results[ii].loc.length);
+            ASSERT_EQ(std::to_string(ii), match);
+            // Points into the original document
+            ASSERT_TRUE(results[ii].loc.at > docs[ii].at);
+            ASSERT_TRUE(results[ii].loc.at < docs[ii].at + docs[ii].length);
+        }
+    }
+
+    // Single threaded should yield the same
+    std::vector<subdoc_BATCH_RESULT> results2(docs.size());
+    rv = subdoc_batch_exec(&docs[0], docs.size(), path, strlen(path),
+        SUBDOC_CMD_GET, &results2[0], 1);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, rv);
+    for (size_t ii = 0; ii < results.size(); ii++) {
+        ASSERT_EQ(results[ii].status, results2[ii].status);
+        ASSERT_EQ(results[ii].loc.at, results2[ii].loc.at);
+    }
+
+    path = "....";
+    rv = subdoc_batch_exec(&docs[0], docs.size(), path, strlen(path),
+        SUBDOC_CMD_GET, &results[0], 4);
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, rv);
+
+    // Mutations can't be batched, since results would refer to worker storage
+    path = "owner.id";
+    rv = subdoc_batch_exec(&docs[0], docs.size(), path, strlen(path),
+        SUBDOC_CMD_DELETE, &results[0], 4);
+    ASSERT_EQ(SUBDOC_STATUS_GLOBAL_ENOSUPPORT, rv);
+}
+
+TEST_F(OpTests, testGetCount)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    string json = "{\"list\":[1,[2,3],{\"a\":1,\"b\":[4]}],\"empty\":[],"
+            "\"dict\":{\"x\":1,\"y\":{\"z\":[]}},\"edict\":{ },\"num\":42}";
+    SUBDOC_OP_SETDOC(op, json.c_str(), json.size());
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, ""));
+    ASSERT_EQ("5", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(5, op->match.numval);
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "list"));
+    ASSERT_EQ("3", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "list[1]"));
+    ASSERT_EQ("2", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "list[-1]"));
+    ASSERT_EQ("2", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "list[2].b"));
+    ASSERT_EQ("1", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "empty"));
+    ASSERT_EQ("0", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "dict"));
+    ASSERT_EQ("2", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "dict.y"));
+    ASSERT_EQ("1", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "edict"));
+    ASSERT_EQ("0", t_subdoc::getMatchString(op->match));
+
+    // Not a container
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, performNewOp(op, SUBDOC_CMD_GET_COUNT, "num"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, performNewOp(op, SUBDOC_CMD_GET_COUNT, "list[0]"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_GET_COUNT, "nonexist"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_GET_COUNT, "list[5]"));
+
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testArrayInsert)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    string doc = "{\"arr\":[],\"dict\":{}, \"nested\":{\"x\":[1, 3 ]}}";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    // Insert into empty array
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "arr[0]", "1"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "arr"));
+    ASSERT_EQ("[1]", t_subdoc::getMatchString(op->match));
+
+    // Before the first element
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "arr[0]", "0"));
+    getAssignNewDoc(op, doc);
+    // One past the end
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "arr[2]", "3"));
+    getAssignNewDoc(op, doc);
+    // In the middle
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "arr[2]", "{\"two\":2}"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "arr"));
+    ASSERT_EQ("[0,1,{\"two\":2},3]", t_subdoc::getMatchString(op->match));
+
+    // Nested, with whitespace before the closing bracket
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "nested.x[1]", "2"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "nested.x[3]", "4"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "nested.x"));
+    ASSERT_EQ("4", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "nested.x[3]"));
+    ASSERT_EQ("4", t_subdoc::getMatchString(op->match));
+
+    // Errors
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "arr[5]", "5"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "nonexist[0]", "5"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "arr[-1]", "5"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "arr", "5"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "dict[0]", "5"));
+    ASSERT_EQ(SUBDOC_STATUS_VALUE_CANTINSERT, performNewOp(op, SUBDOC_CMD_ARRAY_INSERT, "arr[0]", "{"));
+
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testArrayPopTrim)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    string doc = "{\"events\":[ 1, {\"two\":2}, [3], \"four\" ],\"dict\":{},\"empty\":[]}";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_POP_FRONT, "events"));
+    ASSERT_EQ("1", t_subdoc::getMatchString(op->match));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_POP_BACK, "events"));
+    ASSERT_EQ("\"four\"", t_subdoc::getMatchString(op->match));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "events"));
+    ASSERT_EQ("[  {\"two\":2}, [3]]", t_subdoc::getMatchString(op->match));
+
+    // Pop the remaining items from both ends
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_POP_BACK, "events"));
+    ASSERT_EQ("[3]", t_subdoc::getMatchString(op->match));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_POP_FRONT, "events"));
+    ASSERT_EQ("{\"two\":2}", t_subdoc::getMatchString(op->match));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "events"));
+    ASSERT_EQ("0", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_ARRAY_POP_FRONT, "events"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_ARRAY_POP_BACK, "events"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, performNewOp(op, SUBDOC_CMD_ARRAY_POP_BACK, "dict"));
+
+    // Trim
+    doc = "{\"events\":[0,1,2,3,4,5 ],\"empty\":[]}";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_ARRAY_TRIM, "events", 10));
+    ASSERT_EQ(0, op->match.loc_match.length);
+    ASSERT_EQ(doc, getNewDoc(op));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_ARRAY_TRIM, "events", 6));
+    ASSERT_EQ(doc, getNewDoc(op));
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_ARRAY_TRIM, "events", 3));
+    ASSERT_EQ("3,4,5", t_subdoc::getMatchString(op->match));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"events\":[0,1,2],\"empty\":[]}", doc);
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_ARRAY_TRIM, "events", 0));
+    ASSERT_EQ("0,1,2", t_subdoc::getMatchString(op->match));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"events\":[],\"empty\":[]}", doc);
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_ARRAY_TRIM, "empty", 0));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performArith(op, SUBDOC_CMD_ARRAY_TRIM, "nonexist", 1));
+    ASSERT_EQ(SUBDOC_STATUS_GLOBAL_EINVAL, performNewOp(op, SUBDOC_CMD_ARRAY_TRIM, "events", "1"));
+
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testUniqueIndex)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    subdoc_UNIQUE_INDEX *uidx = subdoc_unique_index_alloc();
+    string doc = "{\"tags\":[";
+    for (size_t ii = 0; ii < 1000; ii++) {
+        if (ii) {
+            doc += ",";
+        }
+        doc += "\"tag" + std::to_string(ii) + "\"";
+    }
+    doc += ",[1,2],{\"a\":1},null],\"other\":[]}";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    op->unique_index = uidx;
+
+    // First use builds the index, even if the value is found
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"tag5\""));
+    ASSERT_TRUE(uidx->valid);
+    ASSERT_EQ(1003, uidx->nused);
+
+    // Containers are compared too
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "[1,2]"));
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "{\"a\":1}"));
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "null"));
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"tag999\""));
+
+    // New values are added, and recorded in the index
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"tag1000\""));
+    getAssignNewDoc(op, doc);
+    ASSERT_TRUE(uidx->valid);
+    ASSERT_EQ(1004, uidx->nused);
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"tag1000\""));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "[2,1]"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "tags[1]"));
+    ASSERT_EQ("\"tag1000\"", t_subdoc::getMatchString(op->match));
+
+    // A different path rebuilds the index
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "other", "\"tag1000\""));
+    getAssignNewDoc(op, doc);
+    ASSERT_TRUE(uidx->valid);
+    ASSERT_EQ(1, uidx->nused);
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "other", "\"tag1000\""));
+
+    // Other mutations invalidate it
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_APPEND, "other", "\"x\""));
+    getAssignNewDoc(op, doc);
+    ASSERT_FALSE(uidx->valid);
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "other", "\"x\""));
+    ASSERT_TRUE(uidx->valid);
+    ASSERT_EQ(2, uidx->nused);
+
+    // Without an index, containers in the array are still a mismatch
+    op->unique_index = NULL;
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"tag1\""));
+
+    subdoc_op_free(op);
+    subdoc_unique_index_free(uidx);
+}
+
+TEST_F(OpTests, testUniqueIndexDocument)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    subdoc_UNIQUE_INDEX *uidx = subdoc_unique_index_alloc();
+    op->unique_index = uidx;
+
+    // The index describes one document; a different one with an array of the
+    // same shape, at the same place, is not mistaken for it
+    string doc = "{\"tags\":[\"a\"]}";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"b\""));
+    ASSERT_TRUE(uidx->valid);
+    doc = "{\"tags\":[\"c\"]}";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"c\""));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"a\""));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"tags\":[\"a\",\"c\"]}", doc);
+
+    // Nor is the previous document, if the result wasn't used
+    string olddoc = doc;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"d\""));
+    SUBDOC_OP_SETDOC(op, olddoc.c_str(), olddoc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"d\""));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"tags\":[\"d\",\"a\",\"c\"]}", doc);
+
+    // The same path leading to a different array
+    doc = "{\"tags\":{\"x\":1},\"tags2\":[\"d\",\"a\",\"c\"]}";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "\"e\""));
+
+    // Each result is recognized in turn, and a new value is added without
+    // parsing the array or anything after it
+    string pad(10000, 'x');
+    doc = "{\"tags\":[ ],\"pad\":\"" + pad + "\"}";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "1"));
+    getAssignNewDoc(op, doc);
+    for (int ii = 2; ii < 20; ii++) {
+        string val = std::to_string(ii);
+        ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+            performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", val.c_str()));
+        ASSERT_LT(op->match.bytes_scanned, pad.size());
+        getAssignNewDoc(op, doc);
+        ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+            performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "1"));
+    }
+    ASSERT_EQ(19, uidx->nused);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "tags"));
+    ASSERT_EQ("[19,18,17,16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1]",
+        t_subdoc::getMatchString(op->match));
+
+    // Whitespace within the array is kept
+    doc = "{\"tags\": [ 1 , 2 ] }";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "3"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "4"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"tags\": [ 4,3,1 , 2 ] }", doc);
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "tags", "2"));
+
+    // Likewise a root array
+    doc = "[]";
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "", "1"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "", "2"));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_DOC_EEXISTS,
+        performNewOp(op, SUBDOC_CMD_ARRAY_ADD_UNIQUE, "", "1"));
+    ASSERT_EQ("[2,1]", doc);
+
+    subdoc_op_free(op);
+    subdoc_unique_index_free(uidx);
+}
+
+static subdoc_ERRORS
+performFloatArith(subdoc_OPERATION *op, subdoc_OPTYPE opcode, const char *path, double delta)
+{
+    uint64_t ntmp;
+    memcpy(&ntmp, &delta, sizeof ntmp);
+    return performArith(op, opcode, path, ntmp);
+}
+
+TEST_F(OpTests, testNumericLimits)
+{
+    string doc = "{\"max\":9223372036854775806,\"min\":-9223372036854775807,"
+            "\"big\":9223372036854775808,\"nbig\":-9223372036854775809,"
+            "\"long\":12345678901234567890123,\"lowest\":-9223372036854775808}";
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    ASSERT_EQ(SUBDOC_STATUS_DELTA_E2BIG, performArith(op, SUBDOC_CMD_INCREMENT, "max", 1));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_DECREMENT, "max", 1));
+    ASSERT_EQ("9223372036854775805", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_DELTA_E2BIG, performArith(op, SUBDOC_CMD_DECREMENT, "min", 1));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_INCREMENT, "min", 7));
+    ASSERT_EQ("-9223372036854775800", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_INCREMENT, "lowest", 8));
+    ASSERT_EQ("-9223372036854775800", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_NUM_E2BIG, performArith(op, SUBDOC_CMD_INCREMENT, "big", 1));
+    ASSERT_EQ(SUBDOC_STATUS_NUM_E2BIG, performArith(op, SUBDOC_CMD_INCREMENT, "nbig", 1));
+    ASSERT_EQ(SUBDOC_STATUS_NUM_E2BIG, performArith(op, SUBDOC_CMD_INCREMENT, "long", 1));
+
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testFloatArith)
+{
+    string doc = "{\"int\":41,\"float\":0.1,\"exp\":1.5e3,\"str\":\"1.0\",\"huge\":1e308}";
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "int", 1.5));
+    ASSERT_EQ("42.5", t_subdoc::getMatchString(op->match));
+    // Shortest round-trip formatting
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "float", 0.2));
+    ASSERT_EQ("0.30000000000000004", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "exp", -500));
+    ASSERT_EQ("1000", t_subdoc::getMatchString(op->match));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"int\":41,\"float\":0.1,\"exp\":1000,\"str\":\"1.0\",\"huge\":1e308}", doc);
+
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "str", 1));
+    ASSERT_EQ(SUBDOC_STATUS_DELTA_E2BIG, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "huge", 1e308));
+    ASSERT_EQ(SUBDOC_STATUS_GLOBAL_EINVAL, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "int", std::numeric_limits<double>::infinity()));
+
+    // Existing values outside the range of a double are left alone
+    string rangedoc = "{\"big\":1e400,\"tiny\":1e-400}";
+    SUBDOC_OP_SETDOC(op, rangedoc.c_str(), rangedoc.size());
+    ASSERT_EQ(SUBDOC_STATUS_NUM_E2BIG, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "big", 1.5));
+    ASSERT_EQ(SUBDOC_STATUS_NUM_E2BIG, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "tiny", 1.5));
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    // Creation
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "a.b", 0.25));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT, "new", 0.25));
+    ASSERT_EQ("0.25", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performFloatArith(op, SUBDOC_CMD_INCREMENT_FLOAT_P, "a.b", -2e-10));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "a.b"));
+    ASSERT_EQ("-2e-10", t_subdoc::getMatchString(op->match));
+
+    subdoc_op_free(op);
+}
+
+static subdoc_ERRORS
+performMulti(subdoc_OPERATION *op, std::vector<subdoc_MULTI_SPEC>& specs)
+{
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_MULTI_INCREMENT);
+    SUBDOC_OP_SETMULTI(op, specs.data(), specs.size());
+    return subdoc_op_exec_compiled(op);
+}
+
+static subdoc_MULTI_SPEC
+mkSpec(const char *path, int64_t delta)
+{
+    subdoc_MULTI_SPEC spec = {};
+    spec.path = path;
+    spec.npath = strlen(path);
+    spec.delta = delta;
+    return spec;
+}
+
+TEST_F(OpTests, testMultiIncrement)
+{
+    string doc = "{\"a\":1,\"b\":{\"c\":-5,\"d\":[10,20]},\"e\":{},\"s\":\"str\"}";
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    std::vector<subdoc_MULTI_SPEC> specs;
+    specs.push_back(mkSpec("b.d[1]", 5));
+    specs.push_back(mkSpec("a", 1));
+    specs.push_back(mkSpec("b.c", 10));
+    specs.push_back(mkSpec("e.x", 3));
+    specs.push_back(mkSpec("e.y", -3));
+    specs.push_back(mkSpec("b.new", 7));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performMulti(op, specs));
+    ASSERT_EQ("25", string(specs[0].result.at, specs[0].result.length));
+    ASSERT_EQ("2", string(specs[1].result.at, specs[1].result.length));
+    ASSERT_EQ("5", string(specs[2].result.at, specs[2].result.length));
+    ASSERT_EQ("-3", string(specs[4].result.at, specs[4].result.length));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"a\":2,\"b\":{\"c\":5,\"d\":[10,25],\"new\":7},\"e\":{\"x\":3,\"y\":-3},\"s\":\"str\"}", doc);
+
+    // Repeated counters, including one being created, are combined
+    specs.clear();
+    specs.push_back(mkSpec("a", 1));
+    specs.push_back(mkSpec("`a`", 1));
+    specs.push_back(mkSpec("e.z", 2));
+    specs.push_back(mkSpec("e.z", 2));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performMulti(op, specs));
+    ASSERT_EQ("4", string(specs[0].result.at, specs[0].result.length));
+    ASSERT_EQ("4", string(specs[1].result.at, specs[1].result.length));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"a\":4,\"b\":{\"c\":5,\"d\":[10,25],\"new\":7},\"e\":{\"x\":3,\"y\":-3,\"z\":4},\"s\":\"str\"}", doc);
+
+    // Even when not adjacent
+    string newdoc = "{\"a\":{}}";
+    SUBDOC_OP_SETDOC(op, newdoc.c_str(), newdoc.size());
+    specs.clear();
+    specs.push_back(mkSpec("a.x", 1));
+    specs.push_back(mkSpec("a.y", 2));
+    specs.push_back(mkSpec("a.x", 3));
+    specs.push_back(mkSpec("a.z", 4));
+    specs.push_back(mkSpec("a.y", 5));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performMulti(op, specs));
+    ASSERT_EQ("4", string(specs[0].result.at, specs[0].result.length));
+    ASSERT_EQ("7", string(specs[1].result.at, specs[1].result.length));
+    ASSERT_EQ("4", string(specs[2].result.at, specs[2].result.length));
+    ASSERT_EQ("4", string(specs[3].result.at, specs[3].result.length));
+    getAssignNewDoc(op, newdoc);
+    ASSERT_EQ("{\"a\":{\"x\":4,\"y\":7,\"z\":4}}", newdoc);
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    // All or nothing. Each counter's status is reported
+    specs.clear();
+    specs.push_back(mkSpec("a", 1));
+    specs.push_back(mkSpec("s", 1));
+    specs.push_back(mkSpec("x.y", 1));
+    specs.push_back(mkSpec("b.d.foo", 1));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, performMulti(op, specs));
+    ASSERT_EQ(0, op->doc_new_len);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, specs[0].status);
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, specs[1].status);
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, specs[2].status);
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, specs[3].status);
+
+    // Overflow is checked per counter, and across repeated counters
+    string maxdoc = "{\"n\":9223372036854775806}";
+    SUBDOC_OP_SETDOC(op, maxdoc.c_str(), maxdoc.size());
+    specs.clear();
+    specs.push_back(mkSpec("n", std::numeric_limits<int64_t>::max()));
+    specs.push_back(mkSpec("n", std::numeric_limits<int64_t>::max()));
+    ASSERT_EQ(SUBDOC_STATUS_DELTA_E2BIG, performMulti(op, specs));
+    specs.pop_back();
+    ASSERT_EQ(SUBDOC_STATUS_DELTA_E2BIG, performMulti(op, specs));
+    specs[0].delta = -1;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performMulti(op, specs));
+    ASSERT_EQ("9223372036854775805", string(specs[0].result.at, specs[0].result.length));
+
+    // Unsupported paths
+    specs.clear();
+    specs.push_back(mkSpec("", 1));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, performMulti(op, specs));
+    specs[0] = mkSpec("n[-1]", 1);
+    ASSERT_EQ(SUBDOC_STATUS_GLOBAL_ENOSUPPORT, performMulti(op, specs));
+    specs.clear();
+    ASSERT_EQ(SUBDOC_STATUS_GLOBAL_EINVAL, performMulti(op, specs));
+
+    // Many counters in a larger document; the results must agree with
+    // individual increments
+    string counters = "{\"stats\":{";
+    std::vector<string> paths;
+    for (size_t ii = 0; ii < SUBDOC_MULTI_MAX; ii++) {
+        char buf[64];
+        snprintf(buf, sizeof buf, "%s\"k%u\":{\"pad\":[1,2,{}],\"v\":%u}",
+            ii ? "," : "", (unsigned)ii, (unsigned)ii * 7);
+        counters += buf;
+        snprintf(buf, sizeof buf, "stats.k%u.v", (unsigned)(SUBDOC_MULTI_MAX - ii - 1));
+        paths.push_back(buf);
+    }
+    counters += "}}";
+    string expected = counters;
+    SUBDOC_OP_SETDOC(op, expected.c_str(), expected.size());
+    for (size_t ii = 0; ii < paths.size(); ii++) {
+        ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performArith(op, SUBDOC_CMD_INCREMENT, paths[ii].c_str(), ii + 1));
+        getAssignNewDoc(op, expected);
+    }
+
+    specs.clear();
+    for (size_t ii = 0; ii < paths.size(); ii++) {
+        specs.push_back(mkSpec(paths[ii].c_str(), ii + 1));
+    }
+    SUBDOC_OP_SETDOC(op, counters.c_str(), counters.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performMulti(op, specs));
+    ASSERT_EQ(expected, getNewDoc(op));
+
+    specs.push_back(mkSpec("stats.k0.v", 1));
+    ASSERT_EQ(SUBDOC_STATUS_GLOBAL_EINVAL, performMulti(op, specs));
+
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testPointerOps)
+{
+    string doc = "{\"a/b\":{\"0\":\"key\"},\"arr\":[\"idx\",{\"x\":1}]}";
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    const char *pth = "/a~1b/0";
+    subdoc_op_clear(op);
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, pth, strlen(pth)));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_GET);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    ASSERT_EQ("\"key\"", t_subdoc::getMatchString(op->match));
+
+    // The same segment is an index within an array
+    pth = "/arr/0";
+    subdoc_op_clear(op);
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, pth, strlen(pth)));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_GET);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    ASSERT_EQ("\"idx\"", t_subdoc::getMatchString(op->match));
+
+    // Out of range is ENOENT rather than a mismatch, and no key is created
+    // within the array
+    pth = "/arr/5";
+    subdoc_op_clear(op);
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, pth, strlen(pth)));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_DICT_UPSERT);
+    SUBDOC_OP_SETVALUE(op, "1", 1);
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, subdoc_op_exec_compiled(op));
+
+    // Creating a numeric key within a dictionary
+    pth = "/a~1b/1";
+    subdoc_op_clear(op);
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, pth, strlen(pth)));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_DICT_ADD);
+    SUBDOC_OP_SETVALUE(op, "true", 4);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    getAssignNewDoc(op, doc);
+    ASSERT_EQ("{\"a/b\":{\"0\":\"key\",\"1\":true},\"arr\":[\"idx\",{\"x\":1}]}", doc);
+
+    pth = "$.arr[1]['x']";
+    subdoc_op_clear(op);
+    ASSERT_EQ(0, subdoc_path_parse_jsonpath(op->path, pth, strlen(pth)));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_GET);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    ASSERT_EQ("1", t_subdoc::getMatchString(op->match));
+
+    // Commands act on a single location
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, performNewOp(op, SUBDOC_CMD_GET, "arr[*]"));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, performNewOp(op, SUBDOC_CMD_DICT_UPSERT, "*.x", "1"));
+
+    // Previously, a missing index beneath an array created a key there
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_DICT_ADD_P, "arr[5].b", "1"));
+
+    // A numeric segment naming (or following) a dictionary key is not an
+    // index to insert at
+    const char *dicts[][2] = {
+        { "{\"0\":1,\"1\":2}", "/0" },
+        { "{\"a\":1}", "/1" },
+        { "{\"a\":{}}", "/a/0" }
+    };
+    for (size_t ii = 0; ii < sizeof dicts / sizeof dicts[0]; ii++) {
+        string dictdoc = dicts[ii][0];
+        subdoc_op_clear(op);
+        SUBDOC_OP_SETDOC(op, dictdoc.c_str(), dictdoc.size());
+        ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, dicts[ii][1], strlen(dicts[ii][1])));
+        SUBDOC_OP_SETCODE(op, SUBDOC_CMD_ARRAY_INSERT);
+        SUBDOC_OP_SETVALUE(op, "9", 1);
+        ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, subdoc_op_exec_compiled(op)) << dicts[ii][1];
+    }
+
+    // The same pointers within arrays
+    string arrdoc = "[[0],[]]";
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETDOC(op, arrdoc.c_str(), arrdoc.size());
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, "/0/1", 4));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_ARRAY_INSERT);
+    SUBDOC_OP_SETVALUE(op, "9", 1);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    getAssignNewDoc(op, arrdoc);
+    ASSERT_EQ("[[0,9],[]]", arrdoc);
+
+    subdoc_op_clear(op);
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, "/1/0", 4));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_ARRAY_INSERT);
+    SUBDOC_OP_SETVALUE(op, "9", 1);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    getAssignNewDoc(op, arrdoc);
+    ASSERT_EQ("[[0,9],[9]]", arrdoc);
+
+    subdoc_op_clear(op);
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, "/0/0", 4));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_ARRAY_INSERT);
+    SUBDOC_OP_SETVALUE(op, "8", 1);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    getAssignNewDoc(op, arrdoc);
+    ASSERT_EQ("[[8,0,9],[9]]", arrdoc);
+
+    // Keys with quotes and backslashes match the escaped document keys
+    string escdoc = "{\"a\\\"b\":0,\"c\\\\d\":1}";
+    const char *escpaths[][2] = {
+        { "/a\"b", "0" }, { "$['a\\\"b']", "0" }, { "$.a\"b", "0" },
+        { "/c\\d", "1" }, { "$[\"c\\\\d\"]", "1" }
+    };
+    for (size_t ii = 0; ii < sizeof escpaths / sizeof escpaths[0]; ii++) {
+        const char *escpth = escpaths[ii][0];
+        subdoc_op_clear(op);
+        SUBDOC_OP_SETDOC(op, escdoc.c_str(), escdoc.size());
+        if (*escpth == '/') {
+            ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, escpth, strlen(escpth)));
+        } else {
+            ASSERT_EQ(0, subdoc_path_parse_jsonpath(op->path, escpth, strlen(escpth)));
+        }
+        SUBDOC_OP_SETCODE(op, SUBDOC_CMD_GET);
+        ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op)) << escpth;
+        ASSERT_EQ(escpaths[ii][1], t_subdoc::getMatchString(op->match)) << escpth;
+    }
+
+    // An existing key is replaced rather than duplicated
+    pth = "/a\"b";
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETDOC(op, escdoc.c_str(), escdoc.size());
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, pth, strlen(pth)));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_DICT_UPSERT);
+    SUBDOC_OP_SETVALUE(op, "2", 1);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    getAssignNewDoc(op, escdoc);
+    ASSERT_EQ("{\"a\\\"b\":2,\"c\\\\d\":1}", escdoc);
+
+    // New keys (and their parents) are written escaped
+    escdoc = "{}";
+    pth = "/x\"y/\\z";
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETDOC(op, escdoc.c_str(), escdoc.size());
+    ASSERT_EQ(0, subdoc_path_parse_pointer(op->path, pth, strlen(pth)));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_DICT_ADD_P);
+    SUBDOC_OP_SETVALUE(op, "true", 4);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    getAssignNewDoc(op, escdoc);
+    ASSERT_EQ("{\"x\\\"y\":{\"\\\\z\":true}}", escdoc);
+
+    pth = "$['q\\'\\\\'][\"\\\"\"]";
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETDOC(op, escdoc.c_str(), escdoc.size());
+    ASSERT_EQ(0, subdoc_path_parse_jsonpath(op->path, pth, strlen(pth)));
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_DICT_ADD_P);
+    SUBDOC_OP_SETVALUE(op, "null", 4);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    getAssignNewDoc(op, escdoc);
+    ASSERT_EQ("{\"x\\\"y\":{\"\\\\z\":true},\"q'\\\\\":{\"\\\"\":null}}", escdoc);
+
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testProject)
+{
+    string doc = "{\"id\":7, \"user\" : {\"name\":\"n\",\"email\":\"e\",\"addr\":{\"city\":\"c\",\"zip\":1}},"
+        "\"tags\":[1,2],\"meta\":{\"a\":1}}";
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+
+    std::vector<subdoc_MULTI_SPEC> specs;
+    specs.push_back(mkSpec("tags", 0));
+    specs.push_back(mkSpec("user.addr.zip", 0));
+    specs.push_back(mkSpec("id", 0));
+    specs.push_back(mkSpec("user.email", 0));
+    specs.push_back(mkSpec("missing", 0));
+    specs.push_back(mkSpec("user.addr.city", 0));
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_PROJECT);
+    SUBDOC_OP_SETMULTI(op, specs.data(), specs.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    // Fields appear in document order, with keys and values as in the source
+    ASSERT_EQ("{\"id\":7,\"user\":{\"email\":\"e\",\"addr\":{\"city\":\"c\",\"zip\":1}},\"tags\":[1,2]}", getNewDoc(op));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, specs[4].status);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, specs[1].status);
+    ASSERT_EQ("[1,2]", string(specs[0].result.at, specs[0].result.length));
+    // Values are not copied
+    ASSERT_EQ(doc.c_str() + doc.find("[1,2]"), specs[0].result.at);
+
+    // Nested requests are subsumed by their ancestors
+    specs.clear();
+    specs.push_back(mkSpec("user.addr.zip", 0));
+    specs.push_back(mkSpec("meta", 0));
+    specs.push_back(mkSpec("user.addr", 0));
+    specs.push_back(mkSpec("meta", 0));
+    specs.push_back(mkSpec("tags.x", 0));
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_PROJECT);
+    SUBDOC_OP_SETMULTI(op, specs.data(), specs.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    ASSERT_EQ("{\"user\":{\"addr\":{\"city\":\"c\",\"zip\":1}},\"meta\":{\"a\":1}}", getNewDoc(op));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_MISMATCH, specs[4].status);
+
+    // Nothing found
+    specs.clear();
+    specs.push_back(mkSpec("nope", 0));
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_PROJECT);
+    SUBDOC_OP_SETMULTI(op, specs.data(), specs.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec_compiled(op));
+    ASSERT_EQ("{}", getNewDoc(op));
+
+    // Only dictionary keys
+    specs[0] = mkSpec("tags[0]", 0);
+    ASSERT_EQ(SUBDOC_STATUS_GLOBAL_ENOSUPPORT, subdoc_op_exec_compiled(op));
+
+    string notjson = "{\"x\":[1,},\"a\":1}";
+    SUBDOC_OP_SETDOC(op, notjson.c_str(), notjson.size());
+    specs[0] = mkSpec("a", 0);
+    ASSERT_EQ(SUBDOC_STATUS_DOC_NOTJSON, subdoc_op_exec_compiled(op));
+
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testDocFile)
+{
+    const char *fname = "subdoc-docfile-test.json";
+    // Anything after the match is never looked at by read-only commands
+    string contents = "{\"a\":{\"b\":[1,2,3]},\"c\":\"d\", garbage";
+    FILE *fp = fopen(fname, "wb");
+    ASSERT_TRUE(fp != NULL);
+    fwrite(contents.c_str(), 1, contents.size(), fp);
+    fclose(fp);
+
+    subdoc_DOCFILE df;
+    ASSERT_EQ(0, subdoc_docfile_open(&df, fname));
+    ASSERT_EQ(contents, string(df.doc.at, df.doc.length));
+
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    SUBDOC_OP_SETDOC(op, df.doc.at, df.doc.length);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "a.b[1]"));
+    ASSERT_EQ("2", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET_COUNT, "a.b"));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_EXISTS, "c"));
+    ASSERT_EQ("\"d\"", t_subdoc::getMatchString(op->match));
+
+    // Missing paths must still read (and validate) up to their parent's end
+    ASSERT_EQ(SUBDOC_STATUS_DOC_NOTJSON, performNewOp(op, SUBDOC_CMD_GET, "e"));
+    // Mutations still require a valid document
+    ASSERT_EQ(SUBDOC_STATUS_DOC_NOTJSON,
+        performNewOp(op, SUBDOC_CMD_DICT_UPSERT, "c", "1"));
+
+    subdoc_op_free(op);
+    subdoc_docfile_close(&df);
+    remove(fname);
+
+    ASSERT_EQ(ENOENT, subdoc_docfile_open(&df, fname));
+}
+
+TEST_F(OpTests, testCanonicalize)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    string doc = "{ \"b\" : 1, \"a\" : {\"d\":[ 3, {\"z\":1,\"y\":2} ], \"c\":null},\n"
+            "  \"ab\": \"x y\" }";
+    string newdoc;
+
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_CANONICALIZE, ""));
+    getAssignNewDoc(op, newdoc);
+    ASSERT_EQ("{\"a\":{\"c\":null,\"d\":[3,{\"y\":2,\"z\":1}]},\"ab\":\"x y\",\"b\":1}", newdoc);
+
+    // Sorted lookups
+    string canonical = newdoc;
+    SUBDOC_OP_SETDOC_SORTED(op, canonical.c_str(), canonical.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "ab"));
+    ASSERT_EQ("\"x y\"", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_GET, "aa"));
+    ASSERT_EQ("\"ab\"", string(op->match.loc_next_key.at, op->match.loc_next_key.length));
+
+    // New keys are inserted in order
+    SUBDOC_OP_SETDOC_SORTED(op, canonical.c_str(), canonical.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_DICT_UPSERT, "aa", "5"));
+    getAssignNewDoc(op, newdoc);
+    ASSERT_EQ("{\"a\":{\"c\":null,\"d\":[3,{\"y\":2,\"z\":1}]},\"aa\":5,\"ab\":\"x y\",\"b\":1}", newdoc);
+
+    op->doc_sorted = 1;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_DICT_ADD_P, "a.cc.e", "7"));
+    getAssignNewDoc(op, newdoc);
+    ASSERT_EQ("{\"a\":{\"c\":null,\"cc\":{\"e\":7},\"d\":[3,{\"y\":2,\"z\":1}]},\"aa\":5,\"ab\":\"x y\",\"b\":1}", newdoc);
+
+    op->doc_sorted = 1;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_DICT_ADD, "zz", "0"));
+    getAssignNewDoc(op, newdoc);
+    ASSERT_EQ("{\"a\":{\"c\":null,\"cc\":{\"e\":7},\"d\":[3,{\"y\":2,\"z\":1}]},\"aa\":5,\"ab\":\"x y\",\"b\":1,\"zz\":0}", newdoc);
+
+    // Absent keys are known to be absent once a greater key is seen. Nothing
+    // past that point is read
+    string partial = "{\"a\":1,\"c\":2,garbage";
+    SUBDOC_OP_SETDOC(op, partial.c_str(), partial.size());
+    ASSERT_EQ(SUBDOC_STATUS_DOC_NOTJSON, performNewOp(op, SUBDOC_CMD_EXISTS, "b"));
+    SUBDOC_OP_SETDOC_SORTED(op, partial.c_str(), partial.size());
+    ASSERT_EQ(SUBDOC_STATUS_PATH_ENOENT, performNewOp(op, SUBDOC_CMD_EXISTS, "b"));
+
+    string bad = "{\"a\":[1,}";
+    SUBDOC_OP_SETDOC(op, bad.c_str(), bad.size());
+    ASSERT_EQ(SUBDOC_STATUS_DOC_NOTJSON, performNewOp(op, SUBDOC_CMD_CANONICALIZE, ""));
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testCompact)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    string newdoc;
+
+    // Pretty-printed, with strings containing whitespace, quotes and
+    // backslashes, and long enough runs to exercise the block paths
+    string doc = "{\n"
+            "    \"name\" : \"Allagash   Brewing, est. 1995 \\\"Portland\\\"\",\n"
+            "    \"path\"\t:\t\"C:\\\\ \\\\ \",\n"
+            "    \"list\" : [ 1 , 2 ,\r\n                        3 ],\n"
+            "    \"x\": \"" + string(40, ' ') + "\"\n"
+            "}\n";
+    string expected = "{\"name\":\"Allagash   Brewing, est. 1995 \\\"Portland\\\"\","
+            "\"path\":\"C:\\\\ \\\\ \",\"list\":[1,2,3],"
+            "\"x\":\"" + string(40, ' ') + "\"}";
+
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_COMPACT, ""));
+    ASSERT_EQ(expected, getNewDoc(op));
+
+    // Every split between the block and byte paths
+    for (size_t ii = 0; ii < 20; ii++) {
+        string shifted = string(ii, ' ') + doc;
+        SUBDOC_OP_SETDOC(op, shifted.c_str(), shifted.size());
+        ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_COMPACT, ""));
+        ASSERT_EQ(expected, getNewDoc(op));
+    }
+
+    getAssignNewDoc(op, newdoc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "list[2]"));
+    ASSERT_EQ("3", t_subdoc::getMatchString(op->match));
+
+    // Invalid documents are rejected, rather than changed into a different
+    // (and perhaps valid) document
+    const char *bad[] = { "{\"a\":\"unterminated  }", "[1 2]",
+        "{\"a\" : tr ue}", "{\"a\":1", "[1] [2]", "" };
+    for (size_t ii = 0; ii < sizeof bad / sizeof bad[0]; ii++) {
+        SUBDOC_OP_SETDOC(op, bad[ii], strlen(bad[ii]));
+        ASSERT_EQ(SUBDOC_STATUS_DOC_NOTJSON, performNewOp(op, SUBDOC_CMD_COMPACT, "")) << bad[ii];
+    }
+    // Tokens separated by whitespace long enough for the block path
+    string pad(40, ' ');
+    string badpad[] = { "[1" + pad + "2]", "[\"a\"" + pad + "\"b\"]",
+        "[true" + pad + "\n1]", "[1," + pad + "2" + pad + "3]" };
+    for (size_t ii = 0; ii < sizeof badpad / sizeof badpad[0]; ii++) {
+        SUBDOC_OP_SETDOC(op, badpad[ii].c_str(), badpad[ii].size());
+        ASSERT_EQ(SUBDOC_STATUS_DOC_NOTJSON, performNewOp(op, SUBDOC_CMD_COMPACT, "")) << badpad[ii];
+    }
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testTimings)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    subdoc_OP_TIMINGS *tm = (subdoc_OP_TIMINGS *)calloc(1, sizeof(*tm));
+    const subdoc_PHASE_TIMES *last = &tm->last;
+    string doc = "{\"a\":{\"b\":[1,2,3]}}";
+    string value = "{\"c\":true}";
+    uint64_t total;
+
+    op->timings = tm;
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_DICT_UPSERT, "a.d", value.c_str()));
+
+    // Every phase ran, in order, within the operation
+    ASSERT_LT(0, last->begin);
+    ASSERT_LE(last->begin, last->phase_begin[SUBDOC_PHASE_PATH_PARSE]);
+    ASSERT_LE(last->phase_end[SUBDOC_PHASE_PATH_PARSE], last->phase_begin[SUBDOC_PHASE_VALIDATE]);
+    ASSERT_LE(last->phase_end[SUBDOC_PHASE_VALIDATE], last->phase_begin[SUBDOC_PHASE_MATCH]);
+    ASSERT_EQ(last->phase_end[SUBDOC_PHASE_MATCH], last->phase_begin[SUBDOC_PHASE_BUILD]);
+    ASSERT_EQ(last->end, last->phase_end[SUBDOC_PHASE_BUILD]);
+    total = 0;
+    for (int ii = 0; ii < SUBDOC_PHASE_MAX; ii++) {
+        total += last->cycles[ii];
+    }
+    ASSERT_EQ(last->end - last->begin, total);
+    ASSERT_EQ(1, tm->count[SUBDOC_CMD_DICT_UPSERT]);
+
+    // Reads don't validate anything. Totals accumulate by opcode
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "a.b[1]"));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "a.b[2]"));
+    ASSERT_EQ(0, last->phase_begin[SUBDOC_PHASE_VALIDATE]);
+    ASSERT_LT(0, last->phase_begin[SUBDOC_PHASE_MATCH]);
+    ASSERT_EQ(2, tm->count[SUBDOC_CMD_GET]);
+    ASSERT_EQ(1, tm->count[SUBDOC_CMD_DICT_UPSERT]);
+    ASSERT_LE(last->cycles[SUBDOC_PHASE_MATCH],
+        tm->cycles[SUBDOC_CMD_GET][SUBDOC_PHASE_MATCH]);
+
+    // Failed path parses are counted too
+    ASSERT_EQ(SUBDOC_STATUS_PATH_EINVAL, performNewOp(op, SUBDOC_CMD_GET, "a..b"));
+    ASSERT_EQ(3, tm->count[SUBDOC_CMD_GET]);
+    ASSERT_EQ(0, last->phase_begin[SUBDOC_PHASE_MATCH]);
+    ASSERT_STREQ("match", subdoc_phase_name(SUBDOC_PHASE_MATCH));
+
+    subdoc_timings_reset(tm);
+    ASSERT_EQ(0, tm->count[SUBDOC_CMD_GET]);
+    op->timings = NULL;
+    free(tm);
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testPathSketch)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    subdoc_PATH_SKETCH *sk = subdoc_sketch_alloc(4, SUBDOC_SKETCH_BYTES);
+    subdoc_SKETCH_ENTRY top[4];
+    string doc = "{\"first\":1,\"pad\":\"" + string(200, 'x') + "\",\"last\":2}";
+
+    // Reads stop at the match, so the later field costs more
+    op->path_sketch = sk;
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    for (int ii = 0; ii < 10; ii++) {
+        ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "first"));
+    }
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "last"));
+    ASSERT_EQ(2U, subdoc_sketch_top(sk, top, 4));
+    ASSERT_EQ("last", string(top[0].path, top[0].npath));
+    ASSERT_EQ(1U, top[0].count);
+    ASSERT_EQ("first", string(top[1].path, top[1].npath));
+    ASSERT_EQ(10U, top[1].count);
+    ASSERT_EQ(top[0].weight + top[1].weight, sk->total);
+    ASSERT_EQ(0U, top[0].error);
+
+    // Heavy paths survive a stream of distinct light ones
+    subdoc_sketch_clear(sk);
+    for (int ii = 0; ii < 1000; ii++) {
+        string light = "light" + std::to_string(ii);
+        subdoc_sketch_add(sk, "heavy1", 6, 10);
+        subdoc_sketch_add(sk, light.c_str(), light.size(), 1);
+        if (ii % 2 == 0) {
+            subdoc_sketch_add(sk, "heavy2", 6, 10);
+        }
+    }
+    ASSERT_EQ(4U, subdoc_sketch_top(sk, top, 4));
+    ASSERT_EQ("heavy1", string(top[0].path, top[0].npath));
+    ASSERT_EQ(10000U, top[0].weight);
+    ASSERT_EQ("heavy2", string(top[1].path, top[1].npath));
+    ASSERT_EQ(5000U, top[1].weight);
+    ASSERT_EQ(16000U, sk->total);
+
+    // Merging another thread's sketch
+    subdoc_PATH_SKETCH *other = subdoc_sketch_alloc(4, SUBDOC_SKETCH_BYTES);
+    subdoc_sketch_add(other, "heavy2", 6, 20000);
+    subdoc_sketch_add(other, "heavy3", 6, 3000);
+    ASSERT_EQ(0, subdoc_sketch_merge(sk, other));
+    ASSERT_EQ(39000U, sk->total);
+    ASSERT_EQ(4U, subdoc_sketch_top(sk, top, 4));
+    ASSERT_EQ("heavy2", string(top[0].path, top[0].npath));
+    ASSERT_EQ(25000U, top[0].weight);
+    ASSERT_EQ("heavy1", string(top[1].path, top[1].npath));
+    ASSERT_EQ("heavy3", string(top[2].path, top[2].npath));
+    ASSERT_LE(3000U, top[2].weight);
+    ASSERT_GE(3000U, top[2].weight - top[2].error);
+
+    // Long paths are truncated, but kept apart
+    string long1 = string(200, 'a') + "1", long2 = string(200, 'a') + "2";
+    subdoc_sketch_clear(sk);
+    subdoc_sketch_add(sk, long1.c_str(), long1.size(), 1);
+    subdoc_sketch_add(sk, long2.c_str(), long2.size(), 2);
+    ASSERT_EQ(2U, subdoc_sketch_top(sk, top, 4));
+    ASSERT_EQ(long2.size(), top[0].npath);
+    ASSERT_EQ(2U, top[0].weight);
+
+    subdoc_sketch_free(other);
+    subdoc_sketch_free(sk);
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testOpInit)
+{
+    subdoc_OP_STORAGE storage;
+    char small[64];
+    string doc = "{\"a\":[1,2,3],\"b\":{\"c\":0}}";
+    string newdoc;
+    string longkey(SUBDOC_PATH_KEYBUF + 10, 'k');
+    string longpath = "b." + longkey;
+
+    ASSERT_EQ(NULL, subdoc_op_init(small, sizeof small));
+    ASSERT_EQ(NULL, subdoc_op_init((char *)&storage + 1, sizeof storage - 1));
+
+    subdoc_OPERATION *op = subdoc_op_init(&storage, SUBDOC_OP_STORAGE_SIZE);
+    ASSERT_TRUE(op != NULL);
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "a[-1]"));
+    ASSERT_EQ("3", t_subdoc::getMatchString(op->match));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_ARRAY_APPEND, "a", "4"));
+    getAssignNewDoc(op, newdoc);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "a[3]"));
+    ASSERT_EQ("4", t_subdoc::getMatchString(op->match));
+
+    // Deep documents use the whole parser stack
+    string nested = string(COMPONENTS_ALLOC - 2, '[') + string(COMPONENTS_ALLOC - 2, ']');
+    string deep = "{\"a\":" + nested + "}";
+    SUBDOC_OP_SETDOC(op, deep.c_str(), deep.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "a"));
+    ASSERT_EQ(nested, t_subdoc::getMatchString(op->match));
+
+    // Memory the operation allocates itself is still released
+    SUBDOC_OP_SETDOC(op, newdoc.c_str(), newdoc.size());
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        performNewOp(op, SUBDOC_CMD_DICT_UPSERT, longpath.c_str(), "true"));
+    subdoc_MULTI_SPEC spec = {};
+    spec.path = "b.c";
+    spec.npath = 3;
+    spec.delta = 1;
+    subdoc_op_clear(op);
+    SUBDOC_OP_SETCODE(op, SUBDOC_CMD_MULTI_INCREMENT);
+    SUBDOC_OP_SETMULTI(op, &spec, 1);
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, subdoc_op_exec(op, "", 0));
+    ASSERT_EQ("1", string(spec.result.at, spec.result.length));
+    subdoc_op_free(op);
+}
+
+TEST_F(OpTests, testDocE2big)
+{
+    subdoc_OPERATION *op = subdoc_op_alloc();
+    string doc = "{\"a\":1}";
+
+#if defined(JSONSL_STATE_COMPACT) && !defined(JSONSL_STATE_POS64)
+    ASSERT_EQ(24U, sizeof(struct jsonsl_state_st));
+#endif
+    if (SUBDOC_DOC_MAX == (size_t)-1) {
+        subdoc_op_free(op);
+        return;
+    }
+
+    // Rejected before anything is read
+    SUBDOC_OP_SETDOC(op, doc.c_str(), SUBDOC_DOC_MAX + 1);
+    ASSERT_EQ(SUBDOC_STATUS_DOC_E2BIG, performNewOp(op, SUBDOC_CMD_GET, "a"));
+    SUBDOC_OP_SETDOC(op, doc.c_str(), doc.size());
+    ASSERT_EQ(SUBDOC_STATUS_DOC_E2BIG,
+        performNewOp(op, SUBDOC_CMD_DICT_UPSERT, "b", "1", SUBDOC_DOC_MAX + 1));
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS, performNewOp(op, SUBDOC_CMD_GET, "a"));
+
+    // As are the lower level functions
+    size_t nbig = SUBDOC_DOC_MAX + 1;
+    subdoc_MATCH m;
+    memset(&m, 0, sizeof m);
+    ASSERT_EQ(0, subdoc_path_parse(op->path, "a", 1));
+    ASSERT_EQ(0, subdoc_match_exec(doc.c_str(), nbig, op->path, op->jsn, &m));
+    ASSERT_EQ(SUBDOC_VALIDATE_E2BIG, m.status);
+
+    subdoc_LOC bufs[2] = { { doc.c_str(), SUBDOC_DOC_MAX }, { doc.c_str(), 1 } };
+    memset(&m, 0, sizeof m);
+    ASSERT_EQ(0, subdoc_match_exec_bufs(bufs, 2, op->path, op->jsn, &m));
+    ASSERT_EQ(SUBDOC_VALIDATE_E2BIG, m.status);
+
+    subdoc_PATH_HINT hint;
+    memset(&hint, 0, sizeof hint);
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_hinted(doc.c_str(), nbig, op->path, op->jsn, &m, &hint);
+    ASSERT_EQ(SUBDOC_VALIDATE_E2BIG, m.status);
+
+    memset(&m, 0, sizeof m);
+    subdoc_match_exec_parallel(doc.c_str(), nbig, op->path, op->jsn, &m, 4);
+    ASSERT_EQ(SUBDOC_VALIDATE_E2BIG, m.status);
+
+    const subdoc_PATH *paths[] = { op->path };
+    memset(&m, 0, sizeof m);
+    ASSERT_EQ(0, subdoc_match_exec_multi(doc.c_str(), nbig, paths, 1, op->jsn, &m));
+    ASSERT_EQ(SUBDOC_VALIDATE_E2BIG, m.status);
+
+    ASSERT_EQ(SUBDOC_VALIDATE_E2BIG, subdoc_match_exec_all(doc.c_str(), nbig,
+        op->path, op->jsn, [](const subdoc_MATCH *, void *) { return 0; }, NULL));
+    ASSERT_EQ(SUBDOC_VALIDATE_E2BIG,
+        subdoc_validate(doc.c_str(), nbig, op->jsn, SUBDOC_VALIDATE_PARENT_NONE));
+
+    char out[16];
+    size_t nout;
+    ASSERT_EQ(SUBDOC_VALIDATE_E2BIG,
+        subdoc_canonicalize(doc.c_str(), nbig, op->jsn, out, &nout));
+
+    subdoc_LOC docs[] = { { doc.c_str(), nbig } };
+    subdoc_BATCH_RESULT res;
+    ASSERT_EQ(SUBDOC_STATUS_SUCCESS,
+        subdoc_batch_exec(docs, 1, "a", 1, SUBDOC_CMD_GET, &res, 1));
+    ASSERT_EQ(SUBDOC_STATUS_DOC_E2BIG, res.status);
+    subdoc_op_free(op);
+}
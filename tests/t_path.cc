@@ -119,3 +119,149 @@ TEST_F(PathTests, testNegativePath) {
 
     subdoc_path_free(ss);
 }
+
+TEST_F(PathTests, testPointer)
+{
+    subdoc_PATH *ss = subdoc_path_alloc();
+    jsonsl_jpr_t jpr = &ss->jpr_base;
+    const char *pth;
+
+    pth = "";
+    ASSERT_EQ(0, subdoc_path_parse_pointer(ss, pth, strlen(pth)));
+    ASSERT_EQ(1, jpr->ncomponents);
+
+    pth = "/foo/0/bar/01/-";
+    ASSERT_EQ(0, subdoc_path_parse_pointer(ss, pth, strlen(pth)));
+    ASSERT_EQ(6, jpr->ncomponents);
+    ASSERT_EQ("foo", getComponentString(ss, 1));
+    // Numeric, but may also match a key
+    ASSERT_EQ(JSONSL_PATH_NUMERIC, jpr->components[2].ptype);
+    ASSERT_EQ(0, jpr->components[2].is_arridx);
+    ASSERT_EQ(0, getComponentNumber(ss, 2));
+    ASSERT_EQ("0", getComponentString(ss, 2));
+    // Leading zeroes aren't indices
+    ASSERT_EQ(JSONSL_PATH_STRING, jpr->components[4].ptype);
+    ASSERT_EQ("01", getComponentString(ss, 4));
+    ASSERT_EQ("-", getComponentString(ss, 5));
+    subdoc_path_clear(ss);
+
+    // Escapes and empty keys
+    pth = "/a~1b/m~0n/~01//";
+    ASSERT_EQ(0, subdoc_path_parse_pointer(ss, pth, strlen(pth)));
+    ASSERT_EQ(6, jpr->ncomponents);
+    ASSERT_EQ("a/b", getComponentString(ss, 1));
+    ASSERT_EQ("m~n", getComponentString(ss, 2));
+    ASSERT_EQ("~1", getComponentString(ss, 3));
+    ASSERT_EQ("", getComponentString(ss, 4));
+    ASSERT_EQ("", getComponentString(ss, 5));
+    // Unescaped keys live in the path itself
+    ASSERT_TRUE(jpr->components[1].pstr >= ss->keybuf &&
+        jpr->components[1].pstr < ss->keybuf + sizeof ss->keybuf);
+    subdoc_path_clear(ss);
+
+    // Keys are stored as they appear within a document
+    pth = "/a\"b/c\\d/~1\n\x01";
+    ASSERT_EQ(0, subdoc_path_parse_pointer(ss, pth, strlen(pth)));
+    ASSERT_EQ(4, jpr->ncomponents);
+    ASSERT_EQ("a\\\"b", getComponentString(ss, 1));
+    ASSERT_EQ("c\\\\d", getComponentString(ss, 2));
+    ASSERT_EQ("/\\n\\u0001", getComponentString(ss, 3));
+    subdoc_path_clear(ss);
+
+    // Keys too long for the inline buffer are allocated
+    std::string longkey(SUBDOC_PATH_KEYBUF * 2, 'x');
+    std::string longpth = "/~0" + longkey + "/~1" + longkey;
+    ASSERT_EQ(0, subdoc_path_parse_pointer(ss, longpth.c_str(), longpth.size()));
+    ASSERT_EQ("~" + longkey, getComponentString(ss, 1));
+    ASSERT_EQ("/" + longkey, getComponentString(ss, 2));
+    subdoc_path_clear(ss);
+
+    pth = "foo";
+    ASSERT_NE(0, subdoc_path_parse_pointer(ss, pth, strlen(pth)));
+    pth = "/foo~";
+    ASSERT_NE(0, subdoc_path_parse_pointer(ss, pth, strlen(pth)));
+    pth = "/foo~2";
+    ASSERT_NE(0, subdoc_path_parse_pointer(ss, pth, strlen(pth)));
+    subdoc_path_free(ss);
+}
+
+TEST_F(PathTests, testJsonPath)
+{
+    subdoc_PATH *ss = subdoc_path_alloc();
+    jsonsl_jpr_t jpr = &ss->jpr_base;
+    const char *pth;
+
+    pth = "$";
+    ASSERT_EQ(0, subdoc_path_parse_jsonpath(ss, pth, strlen(pth)));
+    ASSERT_EQ(1, jpr->ncomponents);
+
+    pth = "$.foo['bar.baz'][0][12].x[\"q\\\"uo\\\\te\"]";
+    ASSERT_EQ(0, subdoc_path_parse_jsonpath(ss, pth, strlen(pth)));
+    ASSERT_EQ(7, jpr->ncomponents);
+    ASSERT_EQ("foo", getComponentString(ss, 1));
+    ASSERT_EQ("bar.baz", getComponentString(ss, 2));
+    ASSERT_EQ(1, jpr->components[3].is_arridx);
+    ASSERT_EQ(0, getComponentNumber(ss, 3));
+    ASSERT_EQ(12, getComponentNumber(ss, 4));
+    ASSERT_EQ("x", getComponentString(ss, 5));
+    // Stored as the key is written within a document
+    ASSERT_EQ("q\\\"uo\\\\te", getComponentString(ss, 6));
+    subdoc_path_clear(ss);
+
+    pth = "$.a.*[*]";
+    ASSERT_EQ(0, subdoc_path_parse_jsonpath(ss, pth, strlen(pth)));
+    ASSERT_EQ(4, jpr->ncomponents);
+    ASSERT_EQ(JSONSL_PATH_WILDCARD, jpr->components[2].ptype);
+    ASSERT_EQ(JSONSL_PATH_WILDCARD, jpr->components[3].ptype);
+    ASSERT_NE(0, ss->has_wildcard);
+    subdoc_path_clear(ss);
+
+    pth = "$.arr[-1]";
+    ASSERT_EQ(0, subdoc_path_parse_jsonpath(ss, pth, strlen(pth)));
+    ASSERT_NE(0, ss->has_negix);
+    subdoc_path_clear(ss);
+
+    const char *bad[] = { "", "foo", "$.", "$..a", "$[", "$[]", "$[1", "$['a'",
+        "$['a']x", "$[-2]", "$[a]" };
+    for (size_t ii = 0; ii < sizeof bad / sizeof bad[0]; ii++) {
+        ASSERT_NE(0, subdoc_path_parse_jsonpath(ss, bad[ii], strlen(bad[ii]))) << bad[ii];
+        subdoc_path_clear(ss);
+    }
+    subdoc_path_free(ss);
+}
+
+TEST_F(PathTests, testWildcard)
+{
+    subdoc_PATH *ss = subdoc_path_alloc();
+    jsonsl_jpr_t jpr = &ss->jpr_base;
+    const char *pth;
+
+    pth = "items[*].price";
+    ASSERT_EQ(0, subdoc_path_parse(ss, pth, strlen(pth)));
+    ASSERT_EQ(4, jpr->ncomponents);
+    ASSERT_EQ("items", getComponentString(ss, 1));
+    ASSERT_EQ(JSONSL_PATH_WILDCARD, jpr->components[2].ptype);
+    ASSERT_EQ("price", getComponentString(ss, 3));
+    ASSERT_NE(0, ss->has_wildcard);
+    subdoc_path_clear(ss);
+
+    pth = "users.*.email";
+    ASSERT_EQ(0, subdoc_path_parse(ss, pth, strlen(pth)));
+    ASSERT_EQ(JSONSL_PATH_WILDCARD, jpr->components[2].ptype);
+    subdoc_path_clear(ss);
+
+    // An escaped asterisk is an ordinary key
+    pth = "users.`*`.email";
+    ASSERT_EQ(0, subdoc_path_parse(ss, pth, strlen(pth)));
+    ASSERT_EQ(JSONSL_PATH_STRING, jpr->components[2].ptype);
+    ASSERT_EQ("*", getComponentString(ss, 2));
+    ASSERT_EQ(0, ss->has_wildcard);
+    subdoc_path_clear(ss);
+
+    // Pointers have no wildcard syntax
+    pth = "/users/*";
+    ASSERT_EQ(0, subdoc_path_parse_pointer(ss, pth, strlen(pth)));
+    ASSERT_EQ(JSONSL_PATH_STRING, jpr->components[2].ptype);
+    ASSERT_EQ(0, ss->has_wildcard);
+    subdoc_path_free(ss);
+}